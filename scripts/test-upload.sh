@@ -0,0 +1,112 @@
+#!/bin/bash
+# Checks the wireless import upload endpoint of a running iDescriptor
+# against what the companion Shortcut sends: a raw PUT, a raw PUT resumed
+# with ?size=&offset= and a multipart POST. Also checks that uploads
+# without the manifest's token and oversized uploads are refused.
+#
+# Open the wireless import dialog and tick "Let the phone send files back",
+# then
+#   ./scripts/test-upload.sh <upload URL from the manifest> [upload folder]
+# With the folder given, the files received are compared byte for byte.
+
+set -e
+UPLOAD_URL=$1
+UPLOAD_DIR=$2
+if [ -z "$UPLOAD_URL" ]; then
+    echo "Usage: $0 <upload URL> [upload folder]"
+    exit 1
+fi
+# The manifest URL ends in a slash, the file name goes after it
+UPLOAD_URL=${UPLOAD_URL%/}
+
+for tool in curl sha256sum head; do
+    if ! command -v $tool &> /dev/null; then
+        echo "ERROR: $tool not found"
+        exit 1
+    fi
+done
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+# Names of their own so a rerun doesn't resume an earlier run's part file
+RUN=$$-$RANDOM
+
+fail() {
+    echo "FAIL: $1"
+    exit 1
+}
+
+sha() {
+    sha256sum "$1" | cut -d' ' -f1
+}
+
+# The reply lists the stored files, "sha256":"<hex>"
+expect_sha() {
+    local reply=$1 file=$2
+    grep -q "\"sha256\":\"$(sha "$file")\"" <<< "$reply" ||
+        fail "unexpected reply for $(basename "$file"): $reply"
+}
+
+expect_stored() {
+    local name=$1 file=$2
+    [ -z "$UPLOAD_DIR" ] && return
+    cmp -s "$file" "$UPLOAD_DIR/$name" ||
+        fail "$UPLOAD_DIR/$name differs from what was sent"
+}
+
+# HTTP status of a one byte PUT
+put_status() {
+    curl -s -o /dev/null -w '%{http_code}' -X PUT --data-binary x "$1"
+}
+
+# The token is the last path component of the upload URL
+STATUS=$(put_status "${UPLOAD_URL%/*}/token-$RUN.bin")
+[ "$STATUS" = 403 ] || fail "upload without the token answered $STATUS"
+STATUS=$(curl -s -o /dev/null -w '%{http_code}' \
+    "${UPLOAD_URL%/*}/token-$RUN.bin?size=1")
+[ "$STATUS" = 403 ] || fail "offset query without the token answered $STATUS"
+echo "Token: ok"
+
+STATUS=$(put_status "$UPLOAD_URL/big-$RUN.bin?size=$((1 << 40))&offset=0")
+[ "$STATUS" = 413 ] || fail "1 TB announced size answered $STATUS"
+echo "Size limit: ok"
+
+# Raw PUT
+head -c 3000000 /dev/urandom > "$WORK/put.bin"
+NAME="put-$RUN.bin"
+REPLY=$(curl -sS --fail-with-body -T "$WORK/put.bin" "$UPLOAD_URL/$NAME")
+expect_sha "$REPLY" "$WORK/put.bin"
+expect_stored "$NAME" "$WORK/put.bin"
+echo "PUT: ok"
+
+# Resumed PUT, the first half is sent as if the connection dropped after it
+head -c 5000000 /dev/urandom > "$WORK/resume.bin"
+SIZE=$(stat -c %s "$WORK/resume.bin")
+HALF=$((SIZE / 2))
+NAME="resume-$RUN.bin"
+head -c $HALF "$WORK/resume.bin" > "$WORK/first.bin"
+tail -c +$((HALF + 1)) "$WORK/resume.bin" > "$WORK/rest.bin"
+
+REPLY=$(curl -sS --fail-with-body -T "$WORK/first.bin" \
+    "$UPLOAD_URL/$NAME?size=$SIZE&offset=0")
+grep -q '"complete":false' <<< "$REPLY" ||
+    fail "first half of the resumed upload: $REPLY"
+REPLY=$(curl -sS --fail-with-body "$UPLOAD_URL/$NAME?size=$SIZE")
+grep -q "\"offset\":$HALF" <<< "$REPLY" ||
+    fail "expected offset $HALF, got $REPLY"
+REPLY=$(curl -sS --fail-with-body -T "$WORK/rest.bin" \
+    "$UPLOAD_URL/$NAME?size=$SIZE&offset=$HALF")
+expect_sha "$REPLY" "$WORK/resume.bin"
+expect_stored "$NAME" "$WORK/resume.bin"
+echo "Resumed PUT: ok"
+
+# Multipart POST with two files
+head -c 1000000 /dev/urandom > "$WORK/a-$RUN.bin"
+head -c 2000000 /dev/urandom > "$WORK/b-$RUN.bin"
+REPLY=$(curl -sS --fail-with-body \
+    -F "file=@$WORK/a-$RUN.bin" -F "file=@$WORK/b-$RUN.bin" "$UPLOAD_URL/")
+expect_sha "$REPLY" "$WORK/a-$RUN.bin"
+expect_sha "$REPLY" "$WORK/b-$RUN.bin"
+expect_stored "a-$RUN.bin" "$WORK/a-$RUN.bin"
+expect_stored "b-$RUN.bin" "$WORK/b-$RUN.bin"
+echo "Multipart POST: ok"
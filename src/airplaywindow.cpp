@@ -18,6 +18,7 @@
  */
 
 #include "airplaywindow.h"
+#include "iDescriptor.h"
 #include <QApplication>
 #include <QCheckBox>
 #include <QCloseEvent>
@@ -238,13 +239,12 @@ void AirPlayWindow::updateVideoFrame(QByteArray frameData, int width,
 
     QImage image((const uchar *)frameData.data(), width, height,
                  QImage::Format_RGB888);
-    QPixmap pixmap = QPixmap::fromImage(image);
 
-    // Scale pixmap to fit label while maintaining aspect ratio
+    // Scale the frame to fit label while maintaining aspect ratio, before it
+    // becomes a pixmap so only the small frame is uploaded
     QSize labelSize = m_videoLabel->size();
-    QPixmap scaledPixmap =
-        pixmap.scaled(labelSize, Qt::KeepAspectRatio, Qt::SmoothTransformation);
-    m_videoLabel->setPixmap(scaledPixmap);
+    m_videoLabel->setPixmap(
+        QPixmap::fromImage(downscale_image(image, labelSize)));
 }
 
 void AirPlayWindow::onServerStatusChanged(bool running)
@@ -0,0 +1,518 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "capturedate.h"
+#include "devicefile.h"
+#include "isobmff.h"
+#include "servicemanager.h"
+#include "thumbnailcache.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QTimeZone>
+
+namespace
+{
+using namespace IsoBmff;
+
+// JPEG files start with APP0/APP1, the EXIF segment is almost always within
+// the first read
+constexpr qint64 JPEG_HEAD_SIZE = 16 * 1024;
+constexpr int MAX_JPEG_SEGMENTS = 32;
+// An APP1 segment can't be larger than this
+constexpr qint64 MAX_EXIF_SIZE = 64 * 1024;
+// HEIC meta boxes are a few KB, EXIF items rarely more than 64 KB
+constexpr qint64 MAX_META_SIZE = 1024 * 1024;
+constexpr qint64 MAX_EXIF_ITEM_SIZE = 256 * 1024;
+// mvhd is the first child of moov, no need to read the sample tables
+constexpr qint64 MOVIE_HEAD_SIZE = 4096;
+// Size, type and the 64 bit size of large boxes
+constexpr qint64 BOX_HEADER_MAX_SIZE = 16;
+// Seconds between 1904-01-01 (QuickTime epoch) and 1970-01-01
+constexpr qint64 QUICKTIME_EPOCH_OFFSET = 2082844800;
+
+enum ExifTag : quint16 {
+    DateTime = 0x0132,
+    ExifIfdPointer = 0x8769,
+    DateTimeOriginal = 0x9003,
+    DateTimeDigitized = 0x9004,
+    OffsetTimeOriginal = 0x9011,
+    SubSecTimeOriginal = 0x9291,
+};
+
+class TiffReader
+{
+public:
+    explicit TiffReader(const QByteArray &tiff)
+        : m_data(reinterpret_cast<const uchar *>(tiff.constData())),
+          m_size(tiff.size())
+    {
+    }
+
+    bool init()
+    {
+        if (m_size < 8)
+            return false;
+        if (m_data[0] == 'I' && m_data[1] == 'I')
+            m_littleEndian = true;
+        else if (!(m_data[0] == 'M' && m_data[1] == 'M'))
+            return false;
+        return u16(2) == 42;
+    }
+
+    quint32 firstIfd() const { return u32(4); }
+
+    quint16 u16(qint64 offset) const
+    {
+        if (offset < 0 || offset + 2 > m_size)
+            return 0;
+        const uchar *p = m_data + offset;
+        return m_littleEndian ? quint16(p[0] | (p[1] << 8)) : readU16(p);
+    }
+
+    quint32 u32(qint64 offset) const
+    {
+        if (offset < 0 || offset + 4 > m_size)
+            return 0;
+        const uchar *p = m_data + offset;
+        return m_littleEndian ? quint32(p[0]) | (quint32(p[1]) << 8) |
+                                    (quint32(p[2]) << 16) |
+                                    (quint32(p[3]) << 24)
+                              : readU32(p);
+    }
+
+    // Calls visit(tag, entryOffset) for every entry of the IFD
+    template <typename Visitor>
+    void forEachEntry(quint32 ifdOffset, Visitor visit) const
+    {
+        const quint16 count = u16(ifdOffset);
+        for (quint16 i = 0; i < count; ++i) {
+            const qint64 entry = qint64(ifdOffset) + 2 + i * 12;
+            if (entry + 12 > m_size)
+                return;
+            visit(u16(entry), entry);
+        }
+    }
+
+    // ASCII values of up to 4 bytes are stored in the entry itself
+    QByteArray ascii(qint64 entry) const
+    {
+        if (u16(entry + 2) != 2)
+            return QByteArray();
+        const quint32 count = u32(entry + 4);
+        const qint64 offset = count <= 4 ? entry + 8 : qint64(u32(entry + 8));
+        if (count == 0 || offset + count > m_size)
+            return QByteArray();
+
+        QByteArray value(reinterpret_cast<const char *>(m_data + offset),
+                         count);
+        const qsizetype nul = value.indexOf('\0');
+        if (nul >= 0)
+            value.truncate(nul);
+        return value.trimmed();
+    }
+
+private:
+    const uchar *m_data;
+    qint64 m_size;
+    bool m_littleEndian = false;
+};
+
+// "2021:03:14 15:09:26" in the camera's local time, with the UTC offset as
+// "+01:00" when the camera recorded one
+QDateTime exifDateTime(const QByteArray &value, const QByteArray &offset,
+                       const QByteArray &subSec)
+{
+    QDateTime dateTime = QDateTime::fromString(QString::fromLatin1(value),
+                                               "yyyy:MM:dd HH:mm:ss");
+    if (!dateTime.isValid())
+        return QDateTime();
+
+    static const QRegularExpression offsetPattern(
+        R"(^([+-])(\d{2}):(\d{2})$)");
+    const QRegularExpressionMatch match =
+        offsetPattern.match(QString::fromLatin1(offset));
+    if (match.hasMatch()) {
+        const int seconds = (match.captured(2).toInt() * 60 +
+                             match.captured(3).toInt()) *
+                            60 * (match.captured(1) == "-" ? -1 : 1);
+        dateTime.setTimeZone(QTimeZone(seconds));
+    }
+
+    // Sub-second digits are a fraction, "5" is 500 ms
+    if (!subSec.isEmpty()) {
+        bool ok = false;
+        const int millis = subSec.left(3).leftJustified(3, '0').toInt(&ok);
+        if (ok)
+            dateTime = dateTime.addMSecs(millis);
+    }
+    return dateTime;
+}
+
+QByteArray readJpegExif(DeviceFile &file, qint64 fileSize)
+{
+    const QByteArray head = file.read(0, qMin(JPEG_HEAD_SIZE, fileSize));
+    auto bytes = [&](qint64 offset, qint64 length) {
+        if (offset + length <= head.size())
+            return head.mid(offset, length);
+        return file.read(offset, length);
+    };
+    auto byteAt = [](const QByteArray &data, int i) {
+        return uchar(data.at(i));
+    };
+
+    if (head.size() < 4 || byteAt(head, 0) != 0xFF || byteAt(head, 1) != 0xD8)
+        return QByteArray();
+
+    qint64 pos = 2;
+    for (int i = 0; i < MAX_JPEG_SEGMENTS && pos + 4 <= fileSize; ++i) {
+        const QByteArray marker = bytes(pos, 4);
+        if (marker.size() < 4 || byteAt(marker, 0) != 0xFF)
+            return QByteArray();
+
+        const uchar type = byteAt(marker, 1);
+        // Start of scan or end of image, the metadata is always before
+        if (type == 0xDA || type == 0xD9)
+            return QByteArray();
+
+        const qint64 length = (byteAt(marker, 2) << 8) | byteAt(marker, 3);
+        if (length < 2)
+            return QByteArray();
+
+        if (type == 0xE1 && length - 2 <= MAX_EXIF_SIZE) {
+            const QByteArray segment = bytes(pos + 4, length - 2);
+            if (segment.startsWith(QByteArray("Exif\0\0", 6)))
+                return segment.mid(6);
+        }
+        pos += 2 + length;
+    }
+    return QByteArray();
+}
+
+// Item number of the EXIF block in the HEIF item info box
+bool findExifItem(const uchar *data, const Box &iinf, quint32 &itemId)
+{
+    if (iinf.bodySize() < 6)
+        return false;
+    const uchar *body = data + iinf.bodyOffset();
+    const bool version0 = body[0] == 0;
+    qint64 pos = iinf.bodyOffset() + 4 + (version0 ? 2 : 4);
+
+    while (pos < iinf.end()) {
+        Box infe;
+        if (!parseBox(data, pos, iinf.end(), infe))
+            return false;
+        pos = infe.end();
+        // Only version 2 and 3 entries carry an item type
+        if (infe.type != fourcc("infe") || infe.bodySize() < 12)
+            continue;
+
+        const uchar *entry = data + infe.bodyOffset();
+        const int version = entry[0];
+        if (version < 2)
+            continue;
+        const int idSize = version == 2 ? 2 : 4;
+        if (infe.bodySize() < 4 + idSize + 2 + 4)
+            continue;
+
+        const quint32 id =
+            idSize == 2 ? readU16(entry + 4) : readU32(entry + 4);
+        if (readU32(entry + 4 + idSize + 2) == fourcc("Exif")) {
+            itemId = id;
+            return true;
+        }
+    }
+    return false;
+}
+
+// File range of an item from the HEIF item location box
+bool findItemLocation(const uchar *data, const Box &iloc, quint32 itemId,
+                      qint64 &offset, qint64 &length)
+{
+    const qint64 end = iloc.end();
+    qint64 pos = iloc.bodyOffset();
+    if (pos + 6 > end)
+        return false;
+
+    const int version = data[pos];
+    const int offsetSize = data[pos + 4] >> 4;
+    const int lengthSize = data[pos + 4] & 0x0F;
+    const int baseOffsetSize = data[pos + 5] >> 4;
+    const int indexSize = version >= 1 ? (data[pos + 5] & 0x0F) : 0;
+    pos += 6;
+
+    auto readSized = [&](int size, quint64 &value) {
+        if (size != 0 && size != 4 && size != 8)
+            return false;
+        if (pos + size > end)
+            return false;
+        value = size == 8 ? readU64(data + pos)
+                : size == 4 ? readU32(data + pos)
+                            : 0;
+        pos += size;
+        return true;
+    };
+
+    quint64 itemCount = 0;
+    if (version < 2) {
+        if (pos + 2 > end)
+            return false;
+        itemCount = readU16(data + pos);
+        pos += 2;
+    } else if (!readSized(4, itemCount)) {
+        return false;
+    }
+
+    for (quint64 i = 0; i < itemCount; ++i) {
+        quint64 id = 0;
+        if (version < 2) {
+            if (pos + 2 > end)
+                return false;
+            id = readU16(data + pos);
+            pos += 2;
+        } else if (!readSized(4, id)) {
+            return false;
+        }
+
+        int constructionMethod = 0;
+        if (version >= 1) {
+            if (pos + 2 > end)
+                return false;
+            constructionMethod = readU16(data + pos) & 0x0F;
+            pos += 2;
+        }
+
+        quint64 baseOffset = 0;
+        pos += 2; // data reference index
+        if (!readSized(baseOffsetSize, baseOffset) || pos + 2 > end)
+            return false;
+        const quint16 extentCount = readU16(data + pos);
+        pos += 2;
+
+        for (quint16 e = 0; e < extentCount; ++e) {
+            quint64 extentIndex = 0, extentOffset = 0, extentLength = 0;
+            if ((indexSize && !readSized(indexSize, extentIndex)) ||
+                !readSized(offsetSize, extentOffset) ||
+                !readSized(lengthSize, extentLength)) {
+                return false;
+            }
+
+            // Only items stored in the file itself, in a single extent
+            if (id == itemId && e == 0) {
+                if (constructionMethod != 0 || extentCount != 1)
+                    return false;
+                offset = qint64(baseOffset + extentOffset);
+                length = qint64(extentLength);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+QByteArray readHeifExif(DeviceFile &file, qint64 fileSize)
+{
+    qint64 metaOffset = 0, metaSize = 0;
+    if (!locateTopLevelBox(file, fileSize, fourcc("meta"), metaOffset,
+                           metaSize) ||
+        metaSize > MAX_META_SIZE)
+        return QByteArray();
+
+    const QByteArray meta = file.read(metaOffset, metaSize);
+    const uchar *data = reinterpret_cast<const uchar *>(meta.constData());
+    Box root;
+    if (meta.size() != metaSize || !parseBox(data, 0, metaSize, root))
+        return QByteArray();
+    // meta is a full box, its children start after version and flags
+    root.headerSize += 4;
+
+    Box iinf, iloc;
+    quint32 itemId = 0;
+    qint64 offset = 0, length = 0;
+    if (!findChild(data, root, fourcc("iinf"), iinf) ||
+        !findChild(data, root, fourcc("iloc"), iloc) ||
+        !findExifItem(data, iinf, itemId) ||
+        !findItemLocation(data, iloc, itemId, offset, length) ||
+        length < 8 || length > MAX_EXIF_ITEM_SIZE ||
+        offset + length > fileSize)
+        return QByteArray();
+
+    // The item starts with the offset of the TIFF header, which usually
+    // skips an "Exif\0\0" marker
+    const QByteArray item = file.read(offset, length);
+    if (item.size() != length)
+        return QByteArray();
+    const quint32 tiffOffset =
+        readU32(reinterpret_cast<const uchar *>(item.constData()));
+    if (tiffOffset > quint32(length - 8))
+        return QByteArray();
+    return item.mid(4 + tiffOffset);
+}
+
+// Creation time from the movie header, QuickTime stores it in UTC
+QDateTime readMovieCreationTime(DeviceFile &file, qint64 fileSize)
+{
+    qint64 moovOffset = 0, moovSize = 0;
+    if (!locateTopLevelBox(file, fileSize, fourcc("moov"), moovOffset,
+                           moovSize))
+        return QDateTime();
+
+    const QByteArray head =
+        file.read(moovOffset, qMin(moovSize, MOVIE_HEAD_SIZE));
+    // parseBox() checks sizes against the real box, a box header may be
+    // up to 16 bytes and has to be within what was read
+    if (head.size() < BOX_HEADER_MAX_SIZE)
+        return QDateTime();
+    const uchar *data = reinterpret_cast<const uchar *>(head.constData());
+    Box moov;
+    if (!parseBox(data, 0, moovSize, moov))
+        return QDateTime();
+
+    // Only the box headers that were read can be looked at, later siblings
+    // (the tracks) are larger than the buffer
+    for (qint64 pos = moov.bodyOffset();
+         pos + BOX_HEADER_MAX_SIZE <= head.size();) {
+        Box child;
+        if (!parseBox(data, pos, moov.end(), child))
+            return QDateTime();
+        if (child.type == fourcc("mvhd")) {
+            if (child.end() > head.size() || child.bodySize() < 12)
+                return QDateTime();
+            const uchar *body = data + child.bodyOffset();
+            const quint64 created =
+                body[0] == 1 ? readU64(body + 4) : readU32(body + 4);
+            if (created <= quint64(QUICKTIME_EPOCH_OFFSET))
+                return QDateTime();
+            return QDateTime::fromSecsSinceEpoch(
+                qint64(created) - QUICKTIME_EPOCH_OFFSET, Qt::UTC);
+        }
+        pos = child.end();
+    }
+    return QDateTime();
+}
+
+QDateTime readEmbeddedDate(iDescriptorDevice *device, const QString &filePath,
+                           qint64 fileSize)
+{
+    const QString suffix = QFileInfo(filePath).suffix().toUpper();
+    const bool isJpeg = suffix == "JPG" || suffix == "JPEG";
+    const bool isHeif = suffix == "HEIC" || suffix == "HEIF";
+    const bool isMovie = suffix == "MOV" || suffix == "MP4" || suffix == "M4V";
+    if (!isJpeg && !isHeif && !isMovie)
+        return QDateTime();
+
+    DeviceFile file(device, filePath);
+    if (!file.isOpen())
+        return QDateTime();
+
+    if (isMovie)
+        return readMovieCreationTime(file, fileSize);
+    return CaptureDate::fromExif(isJpeg ? readJpegExif(file, fileSize)
+                                        : readHeifExif(file, fileSize));
+}
+
+// Names like IMG_20231025_143052.jpg from other cameras and apps
+QDateTime dateFromFileName(const QString &filePath)
+{
+    static const QRegularExpression dateRegex(
+        R"((\d{4})(\d{2})(\d{2})_(\d{2})(\d{2})(\d{2}))");
+    const QRegularExpressionMatch match =
+        dateRegex.match(QFileInfo(filePath).baseName());
+    if (!match.hasMatch())
+        return QDateTime();
+
+    return QDateTime(QDate(match.captured(1).toInt(), match.captured(2).toInt(),
+                           match.captured(3).toInt()),
+                     QTime(match.captured(4).toInt(), match.captured(5).toInt(),
+                           match.captured(6).toInt()));
+}
+} // namespace
+
+QDateTime CaptureDate::fromExif(const QByteArray &tiff)
+{
+    TiffReader reader(tiff);
+    if (!reader.init())
+        return QDateTime();
+
+    QByteArray dateTime, original, digitized, offset, subSec;
+    quint32 exifIfd = 0;
+    reader.forEachEntry(reader.firstIfd(), [&](quint16 tag, qint64 entry) {
+        if (tag == DateTime)
+            dateTime = reader.ascii(entry);
+        else if (tag == ExifIfdPointer)
+            exifIfd = reader.u32(entry + 8);
+    });
+    if (exifIfd) {
+        reader.forEachEntry(exifIfd, [&](quint16 tag, qint64 entry) {
+            if (tag == DateTimeOriginal)
+                original = reader.ascii(entry);
+            else if (tag == DateTimeDigitized)
+                digitized = reader.ascii(entry);
+            else if (tag == OffsetTimeOriginal)
+                offset = reader.ascii(entry);
+            else if (tag == SubSecTimeOriginal)
+                subSec = reader.ascii(entry);
+        });
+    }
+
+    if (!original.isEmpty())
+        return exifDateTime(original, offset, subSec);
+    if (!digitized.isEmpty())
+        return exifDateTime(digitized, QByteArray(), QByteArray());
+    return exifDateTime(dateTime, QByteArray(), QByteArray());
+}
+
+QDateTime CaptureDate::read(iDescriptorDevice *device, const QString &filePath)
+{
+    plist_t info = nullptr;
+    if (ServiceManager::safeAfcGetFileInfoPlist(
+            device, filePath.toUtf8().constData(), &info) != AFC_E_SUCCESS ||
+        !info) {
+        qDebug() << "Could not stat" << filePath << "for its capture date";
+        return dateFromFileName(filePath);
+    }
+    PlistNavigator nav(info);
+    const qint64 fileSize = qint64(nav["st_size"].getUInt());
+    const quint64 mtime = nav["st_mtime"].getUInt();
+    const quint64 birthtime = nav["st_birthtime"].getUInt();
+    plist_free(info);
+
+    auto *cache = ThumbnailCache::sharedInstance();
+    const QString cacheKey = ThumbnailCache::key(device, filePath);
+    const QString version = QString("%1_%2").arg(fileSize).arg(mtime);
+    qint64 msecs = 0;
+    if (cache->findCaptureTime(cacheKey, version, &msecs))
+        return QDateTime::fromMSecsSinceEpoch(msecs, Qt::UTC);
+
+    QDateTime dateTime = readEmbeddedDate(device, filePath, fileSize);
+    if (!dateTime.isValid())
+        dateTime = dateFromFileName(filePath);
+
+    // AFC times are in nanoseconds
+    if (!dateTime.isValid() && (birthtime || mtime)) {
+        dateTime = QDateTime::fromMSecsSinceEpoch(
+            qint64((birthtime ? birthtime : mtime) / 1000000ULL),
+            Qt::UTC);
+    }
+
+    if (dateTime.isValid())
+        cache->insertCaptureTime(cacheKey, version,
+                                 dateTime.toMSecsSinceEpoch());
+    return dateTime;
+}
@@ -0,0 +1,51 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CAPTUREDATE_H
+#define CAPTUREDATE_H
+
+#include "iDescriptor.h"
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+
+/**
+ * @brief Reads when a photo or video on the device was taken
+ *
+ * The date comes from the file's own metadata, EXIF DateTimeOriginal for
+ * JPEG and HEIC and the movie header for MOV/MP4. Only the metadata ranges
+ * are read over AFC, a few KB per file, never the whole original. The AFC
+ * timestamps tell when the file was written to the device, which is wrong
+ * for restored or imported media, so they are only the last resort.
+ *
+ * Results are kept in the ThumbnailCache keyed by the file's size and
+ * modification time. Blocks on AFC, call it from a worker thread.
+ */
+class CaptureDate
+{
+public:
+    // Invalid if the file has no usable date at all
+    static QDateTime read(iDescriptorDevice *device, const QString &filePath);
+
+    // Parses a TIFF structured EXIF block, e.g. the body of a JPEG APP1
+    // segment after the "Exif\0\0" marker
+    static QDateTime fromExif(const QByteArray &tiff);
+};
+
+#endif // CAPTUREDATE_H
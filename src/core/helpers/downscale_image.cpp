@@ -0,0 +1,185 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "../../iDescriptor.h"
+#include <QImage>
+#include <QtGlobal>
+#include <cstdint>
+#include <vector>
+
+// IDESCRIPTOR_DOWNSCALE_SCALAR forces the plain C++ loops, the benchmark
+// builds this file a second time with it to compare both paths
+#if defined(IDESCRIPTOR_DOWNSCALE_SCALAR)
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IDESCRIPTOR_DOWNSCALE_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define IDESCRIPTOR_DOWNSCALE_NEON
+#endif
+
+/*
+    Area-average downscaling for large RGB frames (photos, screenshots,
+    AirPlay/video frames). The image is first reduced by integer factors
+    with a box filter, which is an exact area average for those factors and
+    vectorizes well, and Qt's smooth scaler only does the remaining < 2x step
+    on the much smaller intermediate.
+
+    Only SSE2/NEON are used as both are baseline on x86-64/arm64, AVX2 would
+    need per-file compile flags and runtime dispatch for little gain since
+    the vertical pass is memory bound.
+*/
+
+namespace
+{
+// 16-bit accumulators hold up to 257 rows of 255
+constexpr int MAX_FACTOR = 256;
+
+// acc[i] += row[i] for n bytes
+void accumulateRow(uint16_t *acc, const uint8_t *row, int n)
+{
+    int i = 0;
+#if defined(IDESCRIPTOR_DOWNSCALE_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        const __m128i bytes =
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + i));
+        __m128i *lo = reinterpret_cast<__m128i *>(acc + i);
+        __m128i *hi = reinterpret_cast<__m128i *>(acc + i + 8);
+        _mm_storeu_si128(lo, _mm_add_epi16(_mm_loadu_si128(lo),
+                                           _mm_unpacklo_epi8(bytes, zero)));
+        _mm_storeu_si128(hi, _mm_add_epi16(_mm_loadu_si128(hi),
+                                           _mm_unpackhi_epi8(bytes, zero)));
+    }
+#elif defined(IDESCRIPTOR_DOWNSCALE_NEON)
+    for (; i + 16 <= n; i += 16) {
+        const uint8x16_t bytes = vld1q_u8(row + i);
+        vst1q_u16(acc + i, vaddw_u8(vld1q_u16(acc + i), vget_low_u8(bytes)));
+        vst1q_u16(acc + i + 8,
+                  vaddw_u8(vld1q_u16(acc + i + 8), vget_high_u8(bytes)));
+    }
+#endif
+    for (; i < n; ++i)
+        acc[i] += row[i];
+}
+
+// Sums kx accumulated pixels horizontally and divides by the block area
+template <int Channels>
+void reduceRow(const uint16_t *acc, uint8_t *out, int outWidth, int kx,
+               uint32_t area)
+{
+    const uint32_t half = area / 2;
+    for (int x = 0; x < outWidth; ++x) {
+        const uint16_t *block = acc + x * kx * Channels;
+        uint32_t sum[Channels] = {};
+        for (int j = 0; j < kx; ++j) {
+            for (int c = 0; c < Channels; ++c)
+                sum[c] += block[j * Channels + c];
+        }
+        for (int c = 0; c < Channels; ++c)
+            out[x * Channels + c] = uint8_t((sum[c] + half) / area);
+    }
+}
+
+/*
+    Box-filters src by (kx, ky) into dst, which is (srcWidth / kx) x
+    (srcHeight / ky). Right/bottom remainders smaller than a block are
+    dropped, that is under kx/ky pixels of a multi-megapixel frame.
+    Channels are averaged independently, so 4 channel data must be
+    premultiplied.
+*/
+void boxDownscale(const uint8_t *src, qsizetype srcStride, int srcWidth,
+                  int srcHeight, int channels, int kx, int ky, uint8_t *dst,
+                  qsizetype dstStride)
+{
+    const int outWidth = srcWidth / kx;
+    const int outHeight = srcHeight / ky;
+    const int rowBytes = outWidth * kx * channels;
+    const uint32_t area = uint32_t(kx) * uint32_t(ky);
+
+    std::vector<uint16_t> acc(rowBytes);
+    for (int oy = 0; oy < outHeight; ++oy) {
+        std::fill(acc.begin(), acc.end(), 0);
+        const uint8_t *row = src + qsizetype(oy) * ky * srcStride;
+        for (int j = 0; j < ky; ++j, row += srcStride)
+            accumulateRow(acc.data(), row, rowBytes);
+
+        uint8_t *out = dst + qsizetype(oy) * dstStride;
+        if (channels == 3)
+            reduceRow<3>(acc.data(), out, outWidth, kx, area);
+        else
+            reduceRow<4>(acc.data(), out, outWidth, kx, area);
+    }
+}
+} // namespace
+
+QImage downscale_image(const QImage &image, const QSize &size,
+                       Qt::AspectRatioMode mode)
+{
+    if (image.isNull() || size.isEmpty())
+        return QImage();
+
+    const QSize target = image.size().scaled(size, mode);
+    if (target.isEmpty())
+        return QImage();
+
+    const int kx = qBound(1, image.width() / target.width(), MAX_FACTOR);
+    const int ky = qBound(1, image.height() / target.height(), MAX_FACTOR);
+    if (kx == 1 && ky == 1) {
+        // Upscaling or close to it, nothing to gain
+        return image.scaled(target, Qt::IgnoreAspectRatio,
+                            Qt::SmoothTransformation);
+    }
+
+    QImage source = image;
+    int channels = 4;
+    switch (image.format()) {
+    case QImage::Format_RGB888:
+    case QImage::Format_BGR888:
+        channels = 3;
+        break;
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32_Premultiplied:
+    case QImage::Format_RGBX8888:
+    case QImage::Format_RGBA8888_Premultiplied:
+        break;
+    case QImage::Format_RGBA8888:
+        source = image.convertToFormat(QImage::Format_RGBA8888_Premultiplied);
+        break;
+    default:
+        source = image.convertToFormat(image.hasAlphaChannel()
+                                           ? QImage::Format_ARGB32_Premultiplied
+                                           : QImage::Format_RGB32);
+        break;
+    }
+
+    QImage reduced(source.width() / kx, source.height() / ky, source.format());
+    if (reduced.isNull())
+        return image.scaled(target, Qt::IgnoreAspectRatio,
+                            Qt::SmoothTransformation);
+
+    boxDownscale(source.constBits(), source.bytesPerLine(), source.width(),
+                 source.height(), channels, kx, ky, reduced.bits(),
+                 reduced.bytesPerLine());
+
+    if (reduced.size() == target)
+        return reduced;
+    return reduced.scaled(target, Qt::IgnoreAspectRatio,
+                          Qt::SmoothTransformation);
+}
@@ -22,22 +22,68 @@
 #include <QDebug>
 #include <QImage>
 #include <QPixmap>
+#include <QThread>
 #include <libheif/heif.h>
 
-QPixmap load_heic(const QByteArray &imageData)
+namespace
+{
+// Picks the smallest embedded thumbnail that still covers the target size,
+// iPhone HEICs carry a ~320px one which is plenty for the gallery grid
+heif_image_handle *findThumbnail(heif_image_handle *primary,
+                                 const QSize &target)
+{
+    const int count = heif_image_handle_get_number_of_thumbnails(primary);
+    if (count <= 0)
+        return nullptr;
+
+    QList<heif_item_id> ids(count);
+    heif_image_handle_get_list_of_thumbnail_IDs(primary, ids.data(), count);
+
+    heif_image_handle *best = nullptr;
+    for (heif_item_id id : ids) {
+        heif_image_handle *thumbnail = nullptr;
+        if (heif_image_handle_get_thumbnail(primary, id, &thumbnail).code !=
+            heif_error_Ok)
+            continue;
+
+        const int width = heif_image_handle_get_width(thumbnail);
+        const int height = heif_image_handle_get_height(thumbnail);
+        const bool largeEnough =
+            qMax(width, height) >= qMax(target.width(), target.height());
+        if (largeEnough &&
+            (!best || width < heif_image_handle_get_width(best))) {
+            if (best)
+                heif_image_handle_release(best);
+            best = thumbnail;
+        } else {
+            heif_image_handle_release(thumbnail);
+        }
+    }
+    return best;
+}
+} // namespace
+
+QImage load_heic_image(const QByteArray &imageData, const QSize &maxSize)
 {
     heif_context *ctx = heif_context_alloc();
     if (!ctx) {
         qWarning() << "Failed to allocate heif_context";
-        return QPixmap();
+        return QImage();
     }
 
+#ifdef LIBHEIF_HAVE_VERSION
+#if LIBHEIF_HAVE_VERSION(1, 13, 0)
+    // Grid images (the full size primary) are decoded tile by tile
+    heif_context_set_max_decoding_threads(ctx, QThread::idealThreadCount());
+#endif
+#endif
+
     heif_error err = heif_context_read_from_memory(ctx, imageData.constData(),
                                                    imageData.size(), nullptr);
     if (err.code != heif_error_Ok) {
         qWarning() << "Failed to read HEIC from memory:" << err.message;
         heif_context_free(ctx);
-        return QPixmap();
+        return QImage();
     }
 
     heif_image_handle *handle;
@@ -45,7 +91,17 @@ QPixmap load_heic(const QByteArray &imageData)
     if (err.code != heif_error_Ok) {
         qWarning() << "Failed to get primary image handle:" << err.message;
         heif_context_free(ctx);
-        return QPixmap();
+        return QImage();
+    }
+
+    if (maxSize.isValid()) {
+        const QSize primarySize(heif_image_handle_get_width(handle),
+                                heif_image_handle_get_height(handle));
+        const QSize target = primarySize.scaled(maxSize, Qt::KeepAspectRatio);
+        if (heif_image_handle *thumbnail = findThumbnail(handle, target)) {
+            heif_image_handle_release(handle);
+            handle = thumbnail;
+        }
     }
 
     heif_image *img;
@@ -55,7 +111,7 @@ QPixmap load_heic(const QByteArray &imageData)
         qWarning() << "Failed to decode HEIC image:" << err.message;
         heif_image_handle_release(handle);
         heif_context_free(ctx);
-        return QPixmap();
+        return QImage();
     }
 
     int width = heif_image_get_width(img, heif_channel_interleaved);
@@ -73,11 +129,15 @@ QPixmap load_heic(const QByteArray &imageData)
         heif_image_release(img);
         heif_image_handle_release(handle);
         heif_context_free(ctx);
-        return QPixmap();
+        return QImage();
     }
 
     QImage qimg(data, width, height, stride, QImage::Format_RGB888);
-    QPixmap result = QPixmap::fromImage(qimg);
+    // Scaling produces a new image, otherwise detach from the heif buffer
+    QImage result = maxSize.isValid() && (width > maxSize.width() ||
+                                          height > maxSize.height())
+                        ? downscale_image(qimg, maxSize)
+                        : qimg.copy();
 
     heif_image_release(img);
     heif_image_handle_release(handle);
@@ -85,3 +145,8 @@ QPixmap load_heic(const QByteArray &imageData)
 
     return result;
 }
+
+QPixmap load_heic(const QByteArray &imageData)
+{
+    return QPixmap::fromImage(load_heic_image(imageData));
+}
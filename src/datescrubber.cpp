@@ -0,0 +1,203 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "datescrubber.h"
+#include <QDate>
+#include <QLocale>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QToolTip>
+
+DateScrubber::DateScrubber(QWidget *parent) : QWidget(parent)
+{
+    setFixedWidth(fontMetrics().horizontalAdvance("0000") + 16);
+    setMouseTracking(true);
+    setCursor(Qt::PointingHandCursor);
+}
+
+QString DateScrubber::monthLabel(int month)
+{
+    if (month == 0)
+        return "Unknown date";
+    return QLocale().toString(QDate(month / 100, month % 100, 1), "MMMM yyyy");
+}
+
+// Day buckets are folded into months, the model keeps them in row order so
+// a month is always a run of consecutive buckets
+void DateScrubber::setBuckets(const QList<PhotoModel::DateBucket> &buckets,
+                              int rowCount)
+{
+    m_months.clear();
+    for (const PhotoModel::DateBucket &bucket : buckets) {
+        const int month = bucket.day / 100;
+        if (m_months.isEmpty() || m_months.last().month != month) {
+            m_months.append(Month{month, bucket.firstRow, 0});
+        }
+        m_months.last().count += bucket.count;
+    }
+    m_rowCount = rowCount;
+    m_hoverMonth = -1;
+    m_pickedMonth = -1;
+
+    rebuildLookup();
+    update();
+}
+
+void DateScrubber::setCurrentRow(int row)
+{
+    if (m_currentRow != row) {
+        m_currentRow = row;
+        update();
+    }
+}
+
+void DateScrubber::rebuildLookup()
+{
+    m_monthAtY.fill(-1, height());
+    if (m_months.isEmpty() || m_rowCount <= 0)
+        return;
+
+    int month = 0;
+    for (int y = 0; y < height(); ++y) {
+        const qint64 row = qint64(y) * m_rowCount / height();
+        while (month + 1 < m_months.size() &&
+               m_months[month + 1].firstRow <= row) {
+            ++month;
+        }
+        m_monthAtY[y] = month;
+    }
+}
+
+int DateScrubber::monthAt(int y) const
+{
+    if (m_monthAtY.isEmpty())
+        return -1;
+    return m_monthAtY.at(qBound(0, y, int(m_monthAtY.size()) - 1));
+}
+
+int DateScrubber::yForRow(int row) const
+{
+    if (m_rowCount <= 0)
+        return 0;
+    return int(qint64(row) * height() / m_rowCount);
+}
+
+void DateScrubber::pick(int y)
+{
+    const int month = monthAt(y);
+    if (month < 0)
+        return;
+
+    QToolTip::showText(mapToGlobal(QPoint(0, y)),
+                       monthLabel(m_months[month].month), this);
+    if (month == m_pickedMonth)
+        return;
+
+    m_pickedMonth = month;
+    const Month &picked = m_months[month];
+    emit rowsRequested(picked.firstRow, picked.firstRow + picked.count - 1);
+}
+
+void DateScrubber::paintEvent(QPaintEvent *)
+{
+    if (m_months.isEmpty() || m_rowCount <= 0)
+        return;
+
+    QPainter painter(this);
+    const QColor text = palette().color(QPalette::Text);
+    QColor tick = text;
+    tick.setAlphaF(0.35);
+
+    // A tick for every month and the year where a new one starts, labels
+    // that would overlap the previous one are skipped
+    const int labelHeight = fontMetrics().height();
+    int lastLabelBottom = -labelHeight;
+    int lastYear = -1;
+    for (int i = 0; i < m_months.size(); ++i) {
+        const Month &month = m_months[i];
+        const int y = yForRow(month.firstRow);
+
+        painter.setPen(i == m_hoverMonth ? palette().color(QPalette::Highlight)
+                                         : tick);
+        painter.drawLine(width() - 6, y, width() - 2, y);
+
+        const int year = month.month / 100;
+        if (year == lastYear || y < lastLabelBottom)
+            continue;
+        lastYear = year;
+        lastLabelBottom = y + labelHeight;
+
+        painter.setPen(text);
+        painter.drawText(QRect(0, y, width() - 8, labelHeight),
+                         Qt::AlignRight | Qt::AlignTop,
+                         year == 0 ? "?" : QString::number(year));
+    }
+
+    if (m_currentRow >= 0) {
+        const int y = yForRow(m_currentRow);
+        painter.setPen(QPen(palette().color(QPalette::Highlight), 2));
+        painter.drawLine(0, y, width(), y);
+    }
+}
+
+void DateScrubber::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    rebuildLookup();
+}
+
+void DateScrubber::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() != Qt::LeftButton)
+        return;
+    m_dragging = true;
+    m_pickedMonth = -1;
+    pick(event->position().toPoint().y());
+}
+
+void DateScrubber::mouseMoveEvent(QMouseEvent *event)
+{
+    const int y = event->position().toPoint().y();
+    if (m_dragging) {
+        pick(y);
+    }
+
+    const int hover = monthAt(y);
+    if (hover != m_hoverMonth) {
+        m_hoverMonth = hover;
+        if (!m_dragging && hover >= 0) {
+            QToolTip::showText(mapToGlobal(QPoint(0, y)),
+                               monthLabel(m_months[hover].month), this);
+        }
+        update();
+    }
+}
+
+void DateScrubber::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton)
+        m_dragging = false;
+}
+
+void DateScrubber::leaveEvent(QEvent *event)
+{
+    QWidget::leaveEvent(event);
+    m_hoverMonth = -1;
+    update();
+}
@@ -0,0 +1,79 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DATESCRUBBER_H
+#define DATESCRUBBER_H
+
+#include "photomodel.h"
+#include <QList>
+#include <QWidget>
+
+/**
+ * @brief Vertical timeline next to the photo grid for jumping to a month
+ *
+ * Months take up space in proportion to their number of rows, like the
+ * scroll bar does. Which month is under each pixel is precomputed whenever
+ * the buckets or the height change, so dragging maps straight to a row.
+ */
+class DateScrubber : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit DateScrubber(QWidget *parent = nullptr);
+
+    void setBuckets(const QList<PhotoModel::DateBucket> &buckets,
+                    int rowCount);
+    void setCurrentRow(int row);
+
+    static QString monthLabel(int month);
+
+signals:
+    // First and last row of the month that was picked
+    void rowsRequested(int firstRow, int lastRow);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void mousePressEvent(QMouseEvent *event) override;
+    void mouseMoveEvent(QMouseEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
+    void leaveEvent(QEvent *event) override;
+
+private:
+    struct Month {
+        int month; // yyyymm, 0 for photos without a known date
+        int firstRow;
+        int count;
+    };
+
+    void rebuildLookup();
+    int monthAt(int y) const;
+    int yForRow(int row) const;
+    void pick(int y);
+
+    QList<Month> m_months;
+    QList<int> m_monthAtY;
+    int m_rowCount = 0;
+    int m_currentRow = -1;
+    int m_hoverMonth = -1;
+    int m_pickedMonth = -1;
+    bool m_dragging = false;
+};
+
+#endif // DATESCRUBBER_H
@@ -0,0 +1,63 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "devicefile.h"
+#include "servicemanager.h"
+
+DeviceFile::DeviceFile(iDescriptorDevice *device, const QString &path)
+    : m_device(device)
+{
+    afc_error_t result = ServiceManager::safeAfcFileOpen(
+        device, path.toUtf8().constData(), AFC_FOPEN_RDONLY, &m_handle);
+    if (result != AFC_E_SUCCESS)
+        m_handle = 0;
+}
+
+DeviceFile::~DeviceFile()
+{
+    if (m_handle)
+        ServiceManager::safeAfcFileClose(m_device, m_handle);
+}
+
+QByteArray DeviceFile::read(qint64 offset, qint64 length)
+{
+    if (m_position != offset) {
+        if (ServiceManager::safeAfcFileSeek(m_device, m_handle, offset,
+                                            SEEK_SET) != AFC_E_SUCCESS)
+            return QByteArray();
+        m_position = offset;
+    }
+
+    QByteArray data(length, Qt::Uninitialized);
+    qint64 filled = 0;
+    while (filled < length) {
+        uint32_t bytesRead = 0;
+        afc_error_t result = ServiceManager::safeAfcFileRead(
+            m_device, m_handle, data.data() + filled,
+            uint32_t(length - filled), &bytesRead);
+        if (result != AFC_E_SUCCESS || bytesRead == 0)
+            break;
+        filled += bytesRead;
+    }
+
+    m_position += filled;
+    m_bytesRead += filled;
+    data.truncate(filled);
+    return data;
+}
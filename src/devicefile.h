@@ -0,0 +1,54 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DEVICEFILE_H
+#define DEVICEFILE_H
+
+#include "iDescriptor.h"
+#include <QByteArray>
+#include <QString>
+
+/**
+ * @brief Read-only AFC file with positioned reads
+ *
+ * For parsers that only need a few ranges of a file on the device (box
+ * headers, metadata, a single video sample) instead of the whole file.
+ * Blocks on AFC, use it from worker threads.
+ */
+class DeviceFile
+{
+public:
+    DeviceFile(iDescriptorDevice *device, const QString &path);
+    ~DeviceFile();
+    Q_DISABLE_COPY(DeviceFile)
+
+    bool isOpen() const { return m_handle != 0; }
+    qint64 bytesRead() const { return m_bytesRead; }
+
+    // Returns fewer bytes than asked for at the end of the file or on error
+    QByteArray read(qint64 offset, qint64 length);
+
+private:
+    iDescriptorDevice *m_device;
+    uint64_t m_handle = 0;
+    qint64 m_position = 0;
+    qint64 m_bytesRead = 0;
+};
+
+#endif // DEVICEFILE_H
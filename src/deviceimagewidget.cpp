@@ -240,7 +240,7 @@ QRect DeviceImageWidget::findScreenArea(const QPixmap &mockup) const
 QPixmap DeviceImageWidget::createCompositeImage() const
 {
     QPixmap mockup(m_mockupPath);
-    QPixmap wallpaper(m_wallpaperPath);
+    QImage wallpaper(m_wallpaperPath);
 
     if (mockup.isNull()) {
         qWarning() << "Failed to load mockup:" << m_mockupPath;
@@ -291,8 +291,8 @@ QPixmap DeviceImageWidget::createCompositeImage() const
                            mockup.width() * 0.76, mockup.height() * 0.84);
     }
 
-    QPixmap scaledWallpaper = wallpaper.scaled(
-        screenRect.size(), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+    QPixmap scaledWallpaper = QPixmap::fromImage(
+        downscale_image(wallpaper, screenRect.size(), Qt::IgnoreAspectRatio));
 
     // Create a clipping path with rounded corners
     if (useRoundedCorners) {
@@ -0,0 +1,169 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "faststartlayout.h"
+#include "devicefile.h"
+#include "isobmff.h"
+#include <QDebug>
+
+using namespace IsoBmff;
+
+namespace
+{
+// Bigger moov boxes are served as they are, the sample tables of even
+// hour long recordings stay well below this
+constexpr qint64 MAX_MOOV_SIZE = 64 * 1024 * 1024;
+
+void writeU32(uchar *p, quint32 value)
+{
+    p[0] = uchar(value >> 24);
+    p[1] = uchar(value >> 16);
+    p[2] = uchar(value >> 8);
+    p[3] = uchar(value);
+}
+
+void writeU64(uchar *p, quint64 value)
+{
+    writeU32(p, quint32(value >> 32));
+    writeU32(p + 4, quint32(value));
+}
+} // namespace
+
+std::shared_ptr<const FastStartLayout>
+FastStartLayout::build(DeviceFile &file, qint64 fileSize)
+{
+    QList<Box> boxes;
+    if (!file.isOpen() || !readTopLevelBoxes(file, fileSize, boxes))
+        return nullptr;
+
+    const Box *moov = nullptr;
+    const Box *mdat = nullptr;
+    for (const Box &box : std::as_const(boxes)) {
+        if (box.type == fourcc("moov") && !moov)
+            moov = &box;
+        else if (box.type == fourcc("mdat") && !mdat)
+            mdat = &box;
+    }
+    if (!moov || !mdat || moov->offset < mdat->offset ||
+        moov->size > MAX_MOOV_SIZE) {
+        return nullptr;
+    }
+
+    auto layout = std::make_shared<FastStartLayout>();
+    const qint64 prefixSize = mdat->offset;
+    layout->m_header = file.read(0, prefixSize);
+    layout->m_header += file.read(moov->offset, moov->size);
+    if (layout->m_header.size() != prefixSize + moov->size)
+        return nullptr;
+
+    const qint64 headerSize = layout->m_header.size();
+    const qint64 between = moov->offset - mdat->offset;
+    layout->m_runs.append({headerSize, mdat->offset, between});
+    if (moov->end() < fileSize) {
+        layout->m_runs.append(
+            {headerSize + between, moov->end(), fileSize - moov->end()});
+    }
+    layout->m_size = fileSize;
+
+    uchar *data = reinterpret_cast<uchar *>(layout->m_header.data());
+    Box moovCopy;
+    if (!parseBox(data, prefixSize, headerSize, moovCopy) ||
+        !layout->rewriteChunkOffsets(data, moovCopy.bodyOffset(),
+                                     moovCopy.end())) {
+        qWarning() << "FastStartLayout: could not rewrite the chunk offsets";
+        return nullptr;
+    }
+    return layout;
+}
+
+bool FastStartLayout::mapOffset(qint64 offset, qint64 &sourceOffset,
+                                qint64 &length) const
+{
+    for (const Run &run : m_runs) {
+        if (offset >= run.offset && offset < run.offset + run.length) {
+            sourceOffset = run.sourceOffset + (offset - run.offset);
+            length = run.length - (offset - run.offset);
+            return true;
+        }
+    }
+    return false;
+}
+
+// -1 for offsets that don't point at moved data, e.g. into the old moov
+qint64 FastStartLayout::toVirtual(qint64 sourceOffset) const
+{
+    for (const Run &run : m_runs) {
+        if (sourceOffset >= run.sourceOffset &&
+            sourceOffset < run.sourceOffset + run.length) {
+            return run.offset + (sourceOffset - run.sourceOffset);
+        }
+    }
+    return -1;
+}
+
+/*
+ * Chunk offsets are absolute file offsets, they live in the stco (32 bit)
+ * and co64 (64 bit) box of every track's sample table. Only the containers
+ * on the way there are descended into. The moov box keeps its size, so an
+ * offset that no longer fits in 32 bits fails the whole layout instead of
+ * converting stco to co64.
+ */
+bool FastStartLayout::rewriteChunkOffsets(uchar *data, qint64 offset,
+                                          qint64 end) const
+{
+    while (offset < end) {
+        Box box;
+        if (!parseBox(data, offset, end, box))
+            return false;
+        offset = box.end();
+
+        if (box.type == fourcc("trak") || box.type == fourcc("mdia") ||
+            box.type == fourcc("minf") || box.type == fourcc("stbl")) {
+            if (!rewriteChunkOffsets(data, box.bodyOffset(), box.end()))
+                return false;
+            continue;
+        }
+
+        const bool is64 = box.type == fourcc("co64");
+        if (!is64 && box.type != fourcc("stco"))
+            continue;
+
+        // Full box header, then the entry count
+        if (box.bodySize() < 8)
+            return false;
+        uchar *entries = data + box.bodyOffset() + 8;
+        const qint64 count = readU32(entries - 4);
+        const int entrySize = is64 ? 8 : 4;
+        if (count * entrySize > box.bodySize() - 8)
+            return false;
+
+        for (qint64 i = 0; i < count; ++i) {
+            uchar *p = entries + i * entrySize;
+            const qint64 moved =
+                toVirtual(is64 ? qint64(readU64(p)) : qint64(readU32(p)));
+            if (moved < 0 || (!is64 && moved > 0xFFFFFFFFLL))
+                return false;
+            if (is64)
+                writeU64(p, quint64(moved));
+            else
+                writeU32(p, quint32(moved));
+        }
+    }
+    return true;
+}
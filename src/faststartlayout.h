@@ -0,0 +1,86 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FASTSTARTLAYOUT_H
+#define FASTSTARTLAYOUT_H
+
+#include <QByteArray>
+#include <QList>
+#include <QtGlobal>
+#include <memory>
+
+class DeviceFile;
+
+/**
+ * @brief Virtual "fast start" version of a MOV/MP4 whose moov box is at
+ * the end of the file
+ *
+ * The virtual file starts with the boxes in front of the media data (ftyp)
+ * and the moov box, with every chunk offset in its stco/co64 tables
+ * rewritten for the new position of the samples. The rest of the file
+ * follows in its original order, minus the moov box. A player can start as
+ * soon as the first samples after the header have arrived instead of
+ * fetching the tail of the file first.
+ *
+ * The header is kept in memory, everything after it maps onto runs of the
+ * original file. Immutable once built, safe to share between threads.
+ */
+class FastStartLayout
+{
+public:
+    /**
+     * @brief Read the box layout and the moov box of a file on the device
+     * @return nullptr when the moov box already comes before the media
+     * data, or when the file can't be remuxed this way
+     */
+    static std::shared_ptr<const FastStartLayout> build(DeviceFile &file,
+                                                        qint64 fileSize);
+
+    // Size of the virtual file
+    qint64 size() const { return m_size; }
+
+    // Leading boxes and the rewritten moov box, served from memory
+    const QByteArray &header() const { return m_header; }
+
+    /**
+     * @brief Map an offset of the virtual file past the header to the
+     * original file
+     * @param sourceOffset Offset in the original file
+     * @param length Bytes that follow contiguously in the original file
+     * @return false if the offset is outside the virtual file
+     */
+    bool mapOffset(qint64 offset, qint64 &sourceOffset, qint64 &length) const;
+
+private:
+    // Bytes of the original file at offset in the virtual one
+    struct Run {
+        qint64 offset;
+        qint64 sourceOffset;
+        qint64 length;
+    };
+
+    qint64 toVirtual(qint64 sourceOffset) const;
+    bool rewriteChunkOffsets(uchar *data, qint64 offset, qint64 end) const;
+
+    QByteArray m_header;
+    QList<Run> m_runs;
+    qint64 m_size = 0;
+};
+
+#endif // FASTSTARTLAYOUT_H
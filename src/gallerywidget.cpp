@@ -18,11 +18,14 @@
  */
 
 #include "gallerywidget.h"
+#include "datescrubber.h"
 #include "exportmanager.h"
 #include "iDescriptor.h"
 #include "mediapreviewdialog.h"
+#include "photodelegate.h"
 #include "photomodel.h"
 #include "servicemanager.h"
+#include "thumbnailcache.h"
 #include <QComboBox>
 #include <QDebug>
 #include <QFileDialog>
@@ -31,28 +34,98 @@
 #include <QItemSelectionModel>
 #include <QLabel>
 #include <QListView>
+#include <QLocale>
 #include <QMenu>
 #include <QMessageBox>
 #include <QPushButton>
 #include <QRegularExpression>
 #include <QStackedWidget>
 #include <QStandardItemModel>
+#include <QScrollBar>
 #include <QStandardPaths>
+#include <QTimer>
 #include <QVBoxLayout>
 #include <QtConcurrent/QtConcurrent>
 
-/*
-    FIXME: this needs to be refactored once we
-    figure out how to query Photos.sqlite
-    Check out:
-    https://github.com/ScottKjr3347/iOS_Local_PL_Photos.sqlite_Queries
-*/
+namespace
+{
+// Set on the "All Photos" entry of the album list, which has no path
+constexpr int AllPhotosRole = Qt::UserRole + 1;
+// Set on favorites and user albums from Photos.sqlite, which are a list of
+// files spread over the DCIM folders instead of a folder
+constexpr int AssetPathsRole = Qt::UserRole + 2;
+
+struct DcimAlbum {
+    QString name;
+    QString path;
+    quint64 mtime = 0;
+};
+
+struct DcimListing {
+    bool success = false;
+    QList<DcimAlbum> albums;
+};
+
+// Runs on a worker thread, only the album candidates are statted
+DcimListing listDcimAlbums(iDescriptorDevice *device)
+{
+    // Common iOS photo album patterns
+    static const QRegularExpression appleAlbum("^\\d{3}APPLE$");
+    static const QRegularExpression dateAlbum("^\\d{4}\\d{2}\\d{2}$");
+
+    DcimListing listing;
+    char **entries = nullptr;
+    if (ServiceManager::safeAfcReadDirectory(device, "/DCIM", &entries) !=
+        AFC_E_SUCCESS) {
+        return listing;
+    }
+    listing.success = true;
+
+    for (int i = 0; entries && entries[i]; i++) {
+        const QString albumName = QString::fromUtf8(entries[i]);
+        if (!(albumName.contains("APPLE") ||
+              appleAlbum.match(albumName).hasMatch() ||
+              dateAlbum.match(albumName).hasMatch())) {
+            continue;
+        }
+
+        const QString fullPath = QString("/DCIM/%1").arg(albumName);
+        plist_t info = nullptr;
+        if (ServiceManager::safeAfcGetFileInfoPlist(
+                device, fullPath.toUtf8().constData(), &info) !=
+                AFC_E_SUCCESS ||
+            !info) {
+            continue;
+        }
+
+        PlistNavigator nav(info);
+        const bool isDir = nav["st_ifmt"].getString() == "S_IFDIR";
+        const quint64 mtime = nav["st_mtime"].getUInt();
+        plist_free(info);
+
+        if (isDir) {
+            listing.albums.append({albumName, fullPath, mtime});
+        }
+    }
+    if (entries) {
+        afc_dictionary_free(entries);
+    }
+
+    std::sort(listing.albums.begin(), listing.albums.end(),
+              [](const DcimAlbum &a, const DcimAlbum &b) {
+                  return a.name < b.name;
+              });
+    return listing;
+}
+} // namespace
 
 GalleryWidget::GalleryWidget(iDescriptorDevice *device, QWidget *parent)
     : QWidget{parent}, m_device(device), m_model(nullptr),
       m_stackedWidget(nullptr), m_albumSelectionWidget(nullptr),
       m_albumListView(nullptr), m_photoGalleryWidget(nullptr),
-      m_listView(nullptr), m_backButton(nullptr)
+      m_listView(nullptr), m_visibleRangeTimer(nullptr),
+      m_dateHeaderLabel(nullptr), m_dateScrubber(nullptr),
+      m_backButton(nullptr)
 {
 }
 /*Load is called when the tab is active*/
@@ -91,6 +164,7 @@ void GalleryWidget::setupUI()
     m_stackedWidget->setCurrentWidget(m_albumSelectionWidget);
     setControlsEnabled(false); // Disable controls until album is selected
     loadAlbumList();
+    loadLibraryIndex();
 }
 
 void GalleryWidget::setupControlsLayout()
@@ -342,8 +416,29 @@ void GalleryWidget::setupAlbumSelectionView()
             [this](const QModelIndex &index) {
                 if (!index.isValid())
                     return;
-                QString albumPath = index.data(Qt::UserRole).toString();
-                onAlbumSelected(albumPath);
+                if (index.data(AssetPathsRole).isValid()) {
+                    onAssetAlbumSelected(
+                        index.data(AssetPathsRole).toStringList());
+                    return;
+                }
+                if (!index.data(AllPhotosRole).toBool()) {
+                    onAlbumSelected({index.data(Qt::UserRole).toString()});
+                    return;
+                }
+
+                // Newest folders first, with the default sort order their
+                // photos fill the top of the view while older folders are
+                // still being listed
+                QStringList albumPaths;
+                const QAbstractItemModel *albums = index.model();
+                for (int row = albums->rowCount() - 1; row >= 0; --row) {
+                    const QString albumPath =
+                        albums->index(row, 0).data(Qt::UserRole).toString();
+                    if (!albumPath.isEmpty()) {
+                        albumPaths.append(albumPath);
+                    }
+                }
+                onAlbumSelected(albumPaths);
             });
 }
 
@@ -353,6 +448,11 @@ void GalleryWidget::setupPhotoGalleryView()
     QVBoxLayout *layout = new QVBoxLayout(m_photoGalleryWidget);
     layout->setContentsMargins(0, 0, 0, 0);
 
+    // Date of the topmost visible row, stays put while scrolling
+    m_dateHeaderLabel = new QLabel();
+    m_dateHeaderLabel->setStyleSheet("font-weight: bold; padding: 2px 7px;");
+    layout->addWidget(m_dateHeaderLabel);
+
     // Create list view for photos
     m_listView = new QListView();
     m_listView->setViewMode(QListView::IconMode);
@@ -363,20 +463,25 @@ void GalleryWidget::setupPhotoGalleryView()
     m_listView->setSpacing(10);
     m_listView->setSelectionMode(QAbstractItemView::ExtendedSelection);
     m_listView->setUniformItemSizes(true);
+    m_listView->setItemDelegate(new PhotoDelegate(QSize(120, 120), m_listView));
     m_listView->setContextMenuPolicy(Qt::CustomContextMenu);
 
     m_listView->setStyleSheet("QListView { "
                               "    border-top: 1px solid #c1c1c1ff; "
                               "    background-color: transparent; "
                               "    padding: 0px;"
-                              "} "
-                              "QListView::item { "
-                              "    width: 150px; "
-                              "    height: 150px; "
-                              "    margin: 2px; "
                               "}");
 
-    layout->addWidget(m_listView);
+    m_dateScrubber = new DateScrubber();
+    connect(m_dateScrubber, &DateScrubber::rowsRequested, this,
+            &GalleryWidget::scrollToRows);
+
+    QHBoxLayout *gridLayout = new QHBoxLayout();
+    gridLayout->setContentsMargins(0, 0, 0, 0);
+    gridLayout->setSpacing(0);
+    gridLayout->addWidget(m_listView);
+    gridLayout->addWidget(m_dateScrubber);
+    layout->addLayout(gridLayout);
 
     // Add the photo gallery widget to stacked widget
     m_stackedWidget->addWidget(m_photoGalleryWidget);
@@ -394,66 +499,313 @@ void GalleryWidget::setupPhotoGalleryView()
 
                 qDebug() << "Opening preview for" << filePath;
                 auto *previewDialog = new MediaPreviewDialog(
-                    m_device, m_device->afcClient, filePath, this);
+                    m_device, m_device->afcClient,
+                    m_model->getFilteredFilePaths(), index.row(), this);
                 previewDialog->setAttribute(Qt::WA_DeleteOnClose);
                 previewDialog->show();
             });
 
     connect(m_listView, &QListView::customContextMenuRequested, this,
             &GalleryWidget::onPhotoContextMenu);
+
+    // Coalesce scroll/resize updates, the model reprioritizes thumbnail
+    // loads for whatever is on screen once things settle a little
+    m_visibleRangeTimer = new QTimer(this);
+    m_visibleRangeTimer->setSingleShot(true);
+    m_visibleRangeTimer->setInterval(30);
+    connect(m_visibleRangeTimer, &QTimer::timeout, this,
+            &GalleryWidget::updateVisibleRange);
+
+    QScrollBar *scrollBar = m_listView->verticalScrollBar();
+    connect(scrollBar, &QScrollBar::valueChanged, m_visibleRangeTimer,
+            qOverload<>(&QTimer::start));
+    connect(scrollBar, &QScrollBar::rangeChanged, m_visibleRangeTimer,
+            qOverload<>(&QTimer::start));
 }
 
-void GalleryWidget::loadAlbumList()
+void GalleryWidget::updateVisibleRange()
 {
-    AFCFileTree dcimTree = ServiceManager::safeGetFileTree(m_device, "/DCIM");
+    if (!m_model || !m_listView->isVisible())
+        return;
+
+    const int rows = m_model->rowCount();
+    if (rows == 0) {
+        m_model->setVisibleRange(-1, -1);
+        m_dateHeaderLabel->clear();
+        m_dateScrubber->setCurrentRow(-1);
+        return;
+    }
 
-    if (!dcimTree.success) {
-        qDebug() << "Failed to read DCIM directory";
-        QMessageBox::warning(this, "Error",
-                             "Could not access DCIM directory on device.");
+    // Rows flow left to right, top to bottom, so visual position grows with
+    // the row and the visible range can be found with a binary search
+    auto firstRowWhere = [&](auto predicate) {
+        int lo = 0;
+        int hi = rows;
+        while (lo < hi) {
+            const int mid = lo + (hi - lo) / 2;
+            if (predicate(m_listView->visualRect(m_model->index(mid, 0))))
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        return lo;
+    };
+
+    const QRect viewportRect = m_listView->viewport()->rect();
+    const int first = firstRowWhere(
+        [&](const QRect &rect) { return rect.bottom() >= viewportRect.top(); });
+    const int last = firstRowWhere([&](const QRect &rect) {
+                         return rect.top() > viewportRect.bottom();
+                     }) -
+                     1;
+
+    m_model->setVisibleRange(first, last);
+    m_dateScrubber->setCurrentRow(first);
+
+    const int bucket = m_model->bucketForRow(first);
+    if (bucket < 0) {
+        m_dateHeaderLabel->clear();
         return;
     }
+    const int day = m_model->dateBuckets().at(bucket).day;
+    m_dateHeaderLabel->setText(
+        day == 0 ? QString("Unknown date")
+                 : QLocale().toString(
+                       QDate(day / 10000, day / 100 % 100, day % 100),
+                       QLocale::LongFormat));
+}
+
+void GalleryWidget::updateDateScrubber()
+{
+    m_dateScrubber->setBuckets(m_model->dateBuckets(), m_model->rowCount());
+    m_visibleRangeTimer->start();
+}
 
-    qDebug() << "DCIM directory read successfully, found"
-             << dcimTree.entries.size() << "entries";
+// Jumps from the scrubber land on the first row of the month, its rows are
+// queued right away so they load ahead of whatever was pending where the
+// view came from
+void GalleryWidget::scrollToRows(int firstRow, int lastRow)
+{
+    if (!m_model || firstRow < 0 || firstRow >= m_model->rowCount())
+        return;
+
+    m_listView->scrollTo(m_model->index(firstRow, 0),
+                         QAbstractItemView::PositionAtTop);
+    updateVisibleRange();
+    m_model->prefetchRows(firstRow, lastRow);
+}
 
+void GalleryWidget::loadAlbumList()
+{
     auto *albumModel = new QStandardItemModel(this);
+    m_albumListView->setModel(albumModel);
+
+    auto *watcher = new QFutureWatcher<DcimListing>(this);
+    connect(watcher, &QFutureWatcher<DcimListing>::finished, this,
+            [this, watcher, albumModel]() {
+                watcher->deleteLater();
+                m_albumListingDone = true;
+                const DcimListing listing = watcher->result();
+                if (!listing.success) {
+                    qDebug() << "Failed to read DCIM directory";
+                    QMessageBox::warning(
+                        this, "Error",
+                        "Could not access DCIM directory on device.");
+                    // Folders known to the library index are still shown
+                    addLibraryAlbums();
+                    return;
+                }
+
+                qDebug() << "DCIM directory read successfully, found"
+                         << listing.albums.size() << "albums";
+
+                QPersistentModelIndex allPhotos;
+                if (listing.albums.size() > 1) {
+                    auto *item = new QStandardItem("All Photos");
+                    item->setData(true, AllPhotosRole);
+                    item->setIcon(QIcon::fromTheme("folder"));
+                    albumModel->appendRow(item);
+                    allPhotos = item->index();
+                }
+
+                for (const DcimAlbum &album : listing.albums) {
+                    auto *item = new QStandardItem(album.name);
+                    item->setData(album.path, Qt::UserRole); // Store full path
+                    item->setIcon(QIcon::fromTheme("folder"));
+                    albumModel->appendRow(item);
+
+                    // "All Photos" shares the cover of the newest folder
+                    QList<QPersistentModelIndex> items = {item->index()};
+                    if (allPhotos.isValid() &&
+                        &album == &listing.albums.last()) {
+                        items.append(allPhotos);
+                    }
+                    loadAlbumCoverAsync(album.path, album.mtime, items);
+                }
+
+                // The library index may have finished first
+                addLibraryAlbums();
+            });
+
+    watcher->setFuture(QtConcurrent::run(
+        [device = m_device]() { return listDcimAlbums(device); }));
+}
+
+/*
+    Photos.sqlite gives us capture dates, dimensions and favorites for every
+    asset in one query, it is copied and indexed in the background while the
+    DCIM listing is already shown.
+*/
+void GalleryWidget::loadLibraryIndex()
+{
+    auto index = std::make_shared<PhotoLibraryIndex>(m_device);
+    auto *watcher = new QFutureWatcher<bool>(this);
+
+    connect(watcher, &QFutureWatcher<bool>::finished, this,
+            [this, watcher, index]() {
+                watcher->deleteLater();
+                if (!watcher->result()) {
+                    qDebug() << "Photos.sqlite index unavailable, falling "
+                                "back to per-file metadata";
+                    return;
+                }
+
+                m_libraryIndex = index;
+                if (m_model) {
+                    m_model->setLibraryIndex(m_libraryIndex);
+                }
+                addLibraryAlbums();
+            });
+
+    watcher->setFuture(QtConcurrent::run([index]() { return index->load(); }));
+}
+
+/*
+    Once both the DCIM listing and the library index are in, the folders get
+    their item counts, folders only the index knows about are added, and the
+    favorites and user albums from Photos.sqlite are appended after them.
+*/
+void GalleryWidget::addLibraryAlbums()
+{
+    auto *albumModel =
+        qobject_cast<QStandardItemModel *>(m_albumListView->model());
+    if (!albumModel || !m_libraryIndex || !m_albumListingDone ||
+        m_libraryAlbumsAdded) {
+        return;
+    }
+    m_libraryAlbumsAdded = true;
+
+    const QList<PhotoLibraryAlbum> albums = m_libraryIndex->albums();
+
+    QHash<QString, QStandardItem *> folderItems;
+    QStandardItem *allPhotos = nullptr;
+    for (int row = 0; row < albumModel->rowCount(); ++row) {
+        QStandardItem *item = albumModel->item(row);
+        if (item->data(AllPhotosRole).toBool()) {
+            allPhotos = item;
+        } else {
+            folderItems.insert(item->data(Qt::UserRole).toString(), item);
+        }
+    }
 
-    for (const MediaEntry &entry : dcimTree.entries) {
-        QString albumName = QString::fromStdString(entry.name);
-        qDebug() << "DCIM entry:" << albumName << "(isDir:" << entry.isDir
-                 << ")";
-
-        // Check if it's a directory and matches common iOS photo album patterns
-        if (entry.isDir &&
-            (albumName.contains("APPLE") ||
-             QRegularExpression("^\\d{3}APPLE$").match(albumName).hasMatch() ||
-             QRegularExpression("^\\d{4}\\d{2}\\d{2}$")
-                 .match(albumName)
-                 .hasMatch())) {
-            auto *item = new QStandardItem(albumName);
-            QString fullPath = QString("/DCIM/%1").arg(albumName);
-            item->setData(fullPath, Qt::UserRole); // Store full path
+    int total = 0;
+    for (const PhotoLibraryAlbum &album : albums) {
+        if (album.kind != PhotoLibraryAlbum::Folder) {
+            continue;
+        }
 
+        QStandardItem *item = folderItems.value(album.directory);
+        if (!item) {
+            // Folders are kept in name order after "All Photos"
+            int row = allPhotos ? 1 : 0;
+            while (row < albumModel->rowCount() &&
+                   albumModel->item(row)->data(Qt::UserRole).toString() <
+                       album.directory) {
+                ++row;
+            }
+            item = new QStandardItem();
+            item->setData(album.directory, Qt::UserRole);
             item->setIcon(QIcon::fromTheme("folder"));
-            albumModel->appendRow(item);
+            albumModel->insertRow(row, item);
+            loadAlbumCoverAsync(album.directory, 0, {item->index()});
+        }
+
+        const int count = album.assetPaths.size();
+        item->setText(QString("%1 (%2)").arg(album.title).arg(count));
+        item->setToolTip(QString("%1 items").arg(count));
+        total += count;
+    }
+
+    if (allPhotos && total > 0) {
+        allPhotos->setText(QString("All Photos (%1)").arg(total));
+        allPhotos->setToolTip(QString("%1 items").arg(total));
+    }
+
+    for (const PhotoLibraryAlbum &album : albums) {
+        if (album.kind == PhotoLibraryAlbum::Folder ||
+            album.assetPaths.isEmpty()) {
+            continue;
+        }
 
-            loadAlbumThumbnailAsync(fullPath, item);
+        const int count = album.assetPaths.size();
+        auto *item =
+            new QStandardItem(QString("%1 (%2)").arg(album.title).arg(count));
+        item->setData(album.assetPaths, AssetPathsRole);
+        item->setToolTip(QString("%1 items").arg(count));
+        const bool favorites = album.kind == PhotoLibraryAlbum::Favorites;
+        item->setIcon(
+            QIcon::fromTheme(favorites ? "emblem-favorite" : "folder"));
+        albumModel->appendRow(item);
+
+        // Newest photo of the album, the folders use the same rule
+        QString coverPath;
+        qint64 newest = -1;
+        for (const QString &filePath : album.assetPaths) {
+            const PhotoLibraryAsset *asset = m_libraryIndex->asset(filePath);
+            if (asset && !asset->isVideo && asset->captureTime > newest) {
+                newest = asset->captureTime;
+                coverPath = filePath;
+            }
+        }
+        if (!coverPath.isEmpty()) {
+            loadAlbumCoverAsync(album.title, 0, {item->index()}, coverPath);
         }
     }
+}
 
-    m_albumListView->setModel(albumModel);
+void GalleryWidget::onAlbumSelected(const QStringList &albumPaths)
+{
+    m_currentAlbumPaths = albumPaths;
+
+    showPhotoGallery();
+    m_model->setAlbumPaths(albumPaths);
 }
 
-void GalleryWidget::onAlbumSelected(const QString &albumPath)
+void GalleryWidget::onAssetAlbumSelected(const QStringList &filePaths)
 {
-    m_currentAlbumPath = albumPath;
+    m_currentAlbumPaths.clear();
 
+    showPhotoGallery();
+    m_model->setAssetPaths(filePaths);
+}
+
+void GalleryWidget::showPhotoGallery()
+{
     // Create model if not exists
     if (!m_model) {
         m_model = new PhotoModel(m_device, getCurrentFilterType(), this);
+        m_model->setLibraryIndex(m_libraryIndex);
         m_listView->setModel(m_model);
 
+        connect(m_model, &QAbstractItemModel::rowsInserted, m_visibleRangeTimer,
+                qOverload<>(&QTimer::start));
+        connect(m_model, &QAbstractItemModel::layoutChanged,
+                m_visibleRangeTimer, qOverload<>(&QTimer::start));
+        connect(m_model, &QAbstractItemModel::modelReset, m_visibleRangeTimer,
+                qOverload<>(&QTimer::start));
+        connect(m_model, &PhotoModel::dateBucketsChanged, this,
+                &GalleryWidget::updateDateScrubber);
+
         // Update export button states based on selection
         connect(m_listView->selectionModel(),
                 &QItemSelectionModel::selectionChanged, this, [this]() {
@@ -463,9 +815,6 @@ void GalleryWidget::onAlbumSelected(const QString &albumPath)
                 });
     }
 
-    // Set album path and load photos
-    m_model->setAlbumPath(albumPath);
-
     // Switch to photo gallery view
     m_stackedWidget->setCurrentWidget(m_photoGalleryWidget);
 
@@ -483,8 +832,8 @@ void GalleryWidget::onBackToAlbums()
     // Disable controls and hide back button
     setControlsEnabled(false);
     m_backButton->hide();
-    // Clear current album path
-    m_currentAlbumPath.clear();
+    // Clear current album paths
+    m_currentAlbumPaths.clear();
 }
 
 void GalleryWidget::setControlsEnabled(bool enabled)
@@ -497,93 +846,119 @@ void GalleryWidget::setControlsEnabled(bool enabled)
 }
 
 /*
-    FIXME: this needs to be refactored once we
-    figure out how to query Photos.sqlite
-    Check out:
-    https://github.com/ScottKjr3347/iOS_Local_PL_Photos.sqlite_Queries
+    Picks the newest photo of the album, from the library index when it is
+    loaded, otherwise by name from a plain listing (no per-file stat), and
+    decodes it at icon size. Runs on a worker thread.
 */
-QIcon GalleryWidget::loadAlbumThumbnail(const QString &albumPath)
+QImage GalleryWidget::loadAlbumCover(
+    iDescriptorDevice *device, const QString &albumPath,
+    const std::shared_ptr<PhotoLibraryIndex> &index)
 {
-    // Get album directory contents
-    AFCFileTree albumTree =
-        ServiceManager::safeGetFileTree(m_device, albumPath.toStdString());
-
-    if (!albumTree.success) {
-        qDebug() << "Failed to read album directory:" << albumPath;
-        return QIcon();
-    }
-
-    // Find the first image file
-    QString firstImagePath;
-    for (const MediaEntry &entry : albumTree.entries) {
-        QString fileName = QString::fromStdString(entry.name);
-
-        if (!entry.isDir && (fileName.endsWith(".JPG", Qt::CaseInsensitive) ||
-                             fileName.endsWith(".PNG", Qt::CaseInsensitive) ||
-                             fileName.endsWith(".HEIC", Qt::CaseInsensitive))) {
-            firstImagePath = albumPath + "/" + fileName;
-            break;
+    QString coverPath;
+    if (index && index->isLoaded()) {
+        qint64 newest = -1;
+        for (const PhotoLibraryAsset &asset :
+             index->assetsInDirectory(albumPath)) {
+            if (!asset.isVideo && asset.captureTime > newest) {
+                newest = asset.captureTime;
+                coverPath = asset.filePath;
+            }
         }
     }
 
-    if (firstImagePath.isEmpty()) {
-        qDebug() << "No images found in album:" << albumPath;
-        return QIcon();
-    }
-
-    // Load the thumbnail using ServiceManager
-    QByteArray imageData = ServiceManager::safeReadAfcFileToByteArray(
-        m_device, firstImagePath.toUtf8().constData());
-
-    if (imageData.isEmpty()) {
-        qDebug() << "Could not read image data for thumbnail:"
-                 << firstImagePath;
-        return QIcon();
-    }
+    if (coverPath.isEmpty()) {
+        char **files = nullptr;
+        if (ServiceManager::safeAfcReadDirectory(
+                device, albumPath.toUtf8().constData(), &files) !=
+            AFC_E_SUCCESS) {
+            qDebug() << "Failed to read album directory:" << albumPath;
+            return QImage();
+        }
 
-    QPixmap thumbnail;
-
-    if (firstImagePath.endsWith(".HEIC", Qt::CaseInsensitive)) {
-        qDebug() << "Loading HEIC thumbnail from:" << firstImagePath;
-        thumbnail = load_heic(imageData);
-    } else {
-        // Load regular image formats
-        if (!thumbnail.loadFromData(imageData)) {
-            qDebug() << "Could not decode image data for thumbnail:"
-                     << firstImagePath;
-            return QIcon();
+        // IMG_ numbers only go up, the largest name is the newest photo
+        QString newestName;
+        for (int i = 0; files && files[i]; i++) {
+            const QString fileName = QString::fromUtf8(files[i]);
+            if ((fileName.endsWith(".JPG", Qt::CaseInsensitive) ||
+                 fileName.endsWith(".PNG", Qt::CaseInsensitive) ||
+                 fileName.endsWith(".HEIC", Qt::CaseInsensitive)) &&
+                fileName > newestName) {
+                newestName = fileName;
+            }
+        }
+        if (files) {
+            afc_dictionary_free(files);
         }
-    }
 
-    if (thumbnail.isNull()) {
-        qDebug() << "Failed to load thumbnail from:" << firstImagePath;
-        return QIcon();
+        if (newestName.isEmpty()) {
+            qDebug() << "No images found in album:" << albumPath;
+            return QImage();
+        }
+        coverPath = albumPath + "/" + newestName;
     }
 
-    return QIcon(thumbnail);
+    // Decode straight to the album list icon size instead of the full
+    // original, this runs on a worker thread so don't ask the view
+    return PhotoModel::loadThumbnailFromDevice(device, coverPath,
+                                               QSize(120, 120));
 }
 
-void GalleryWidget::loadAlbumThumbnailAsync(const QString &albumPath,
-                                            QStandardItem *item)
+/*
+    Covers are kept in the ThumbnailCache disk tier under the album
+    directory's mtime, which changes whenever a file is added or removed, so
+    opening the gallery again doesn't touch the albums at all.
+*/
+void GalleryWidget::loadAlbumCoverAsync(
+    const QString &albumPath, quint64 mtime,
+    const QList<QPersistentModelIndex> &items, const QString &coverPath)
 {
-    // Create a future watcher to handle the async result
-    auto *watcher = new QFutureWatcher<QIcon>(this);
-
-    // Connect the finished signal to update the item icon
-    connect(watcher, &QFutureWatcher<QIcon>::finished, this, [watcher, item]() {
-        QIcon result = watcher->result();
-        if (!result.isNull()) {
-            item->setIcon(result);
-        }
-        // The item keeps the folder icon if thumbnail loading fails
-        watcher->deleteLater();
-    });
-
-    // Start the async operation
-    QFuture<QIcon> future = QtConcurrent::run(
-        [this, albumPath]() { return loadAlbumThumbnail(albumPath); });
+    auto *watcher = new QFutureWatcher<QImage>(this);
+
+    // The album list may have been rebuilt while the cover was loading, the
+    // persistent indexes are invalid then and the cover is dropped
+    connect(watcher, &QFutureWatcher<QImage>::finished, this,
+            [this, watcher, items]() {
+                watcher->deleteLater();
+                const QImage cover = watcher->result();
+                if (cover.isNull()) {
+                    // The item keeps the folder icon
+                    return;
+                }
+                const QIcon icon(QPixmap::fromImage(cover));
+                QAbstractItemModel *albumModel = m_albumListView->model();
+                for (const QPersistentModelIndex &item : items) {
+                    if (item.isValid() && item.model() == albumModel) {
+                        albumModel->setData(item, icon, Qt::DecorationRole);
+                    }
+                }
+            });
 
-    watcher->setFuture(future);
+    const QString cacheKey =
+        ThumbnailCache::key(m_device, albumPath + "#cover");
+    const QString version = QString::number(mtime);
+
+    // Only copies go to the worker, the widget may be gone before it is done
+    watcher->setFuture(QtConcurrent::run(
+        [device = m_device, albumPath, coverPath, cacheKey, version, mtime,
+         index = m_libraryIndex]() {
+            auto *cache = ThumbnailCache::sharedInstance();
+            if (mtime != 0) {
+                QImage cover = cache->loadFromDisk(cacheKey, version);
+                if (!cover.isNull()) {
+                    return cover;
+                }
+            }
+
+            // Albums from the library index pick their cover up front
+            QImage cover = coverPath.isEmpty()
+                               ? loadAlbumCover(device, albumPath, index)
+                               : PhotoModel::loadThumbnailFromDevice(
+                                     device, coverPath, QSize(120, 120));
+            if (!cover.isNull() && mtime != 0) {
+                cache->saveToDisk(cacheKey, version, cover);
+            }
+            return cover;
+        }));
 }
 
 void GalleryWidget::onPhotoContextMenu(const QPoint &pos)
@@ -616,8 +991,10 @@ void GalleryWidget::onPhotoContextMenu(const QPoint &pos)
             return;
 
         qDebug() << "Opening preview for" << filePath;
-        auto *previewDialog = new MediaPreviewDialog(
-            m_device, m_device->afcClient, filePath, this);
+        auto *previewDialog =
+            new MediaPreviewDialog(m_device, m_device->afcClient,
+                                   m_model->getFilteredFilePaths(),
+                                   index.row(), this);
         previewDialog->setAttribute(Qt::WA_DeleteOnClose);
         previewDialog->show();
     });
@@ -21,8 +21,11 @@
 #define GALLERYWIDGET_H
 
 #include "iDescriptor.h"
+#include "photolibraryindex.h"
 #include "photomodel.h"
+#include <QPersistentModelIndex>
 #include <QWidget>
+#include <memory>
 
 QT_BEGIN_NAMESPACE
 class QListView;
@@ -32,9 +35,10 @@ class QHBoxLayout;
 class QVBoxLayout;
 class QStackedWidget;
 class QLabel;
-class QStandardItem;
+class QTimer;
 QT_END_NAMESPACE
 
+class DateScrubber;
 class ExportManager;
 class ExportProgressDialog;
 
@@ -53,7 +57,8 @@ private slots:
     void onFilterChanged();
     void onExportSelected();
     void onExportAll();
-    void onAlbumSelected(const QString &albumPath);
+    void onAlbumSelected(const QStringList &albumPaths);
+    void onAssetAlbumSelected(const QStringList &filePaths);
     void onBackToAlbums();
 
 private:
@@ -62,16 +67,29 @@ private:
     void setupAlbumSelectionView();
     void setupPhotoGalleryView();
     void loadAlbumList();
+    void loadLibraryIndex();
+    void addLibraryAlbums();
+    void showPhotoGallery();
+    void updateVisibleRange();
+    void updateDateScrubber();
+    void scrollToRows(int firstRow, int lastRow);
     void setControlsEnabled(bool enabled);
     QString selectExportDirectory();
-    QIcon loadAlbumThumbnail(const QString &albumPath);
-    void loadAlbumThumbnailAsync(const QString &albumPath, QStandardItem *item);
+    static QImage
+    loadAlbumCover(iDescriptorDevice *device, const QString &albumPath,
+                   const std::shared_ptr<PhotoLibraryIndex> &index);
+    void loadAlbumCoverAsync(const QString &albumPath, quint64 mtime,
+                             const QList<QPersistentModelIndex> &items,
+                             const QString &coverPath = QString());
     void onPhotoContextMenu(const QPoint &pos);
     PhotoModel::FilterType getCurrentFilterType() const;
 
     iDescriptorDevice *m_device;
     bool m_loaded = false;
-    QString m_currentAlbumPath;
+    bool m_albumListingDone = false;
+    bool m_libraryAlbumsAdded = false;
+    QStringList m_currentAlbumPaths;
+    std::shared_ptr<PhotoLibraryIndex> m_libraryIndex;
 
     // UI components
     QVBoxLayout *m_mainLayout;
@@ -86,6 +104,9 @@ private:
     QWidget *m_photoGalleryWidget;
     QListView *m_listView;
     PhotoModel *m_model;
+    QTimer *m_visibleRangeTimer;
+    QLabel *m_dateHeaderLabel;
+    DateScrubber *m_dateScrubber;
 
     // Control widgets
     QComboBox *m_sortComboBox;
@@ -18,23 +18,41 @@
  */
 
 #include "httpserver.h"
+#include "httpworker.h"
 #include "iDescriptor.h"
 #include <QDateTime>
-#include <QFile>
+#include <QDebug>
 #include <QFileInfo>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
-#include <QMimeDatabase>
 #include <QNetworkInterface>
 #include <QRandomGenerator>
+#include <QThread>
 #include <QUrl>
 
+// Connections are spread over this many threads at most, a handful of
+// phones is the most an import sees
+constexpr int MAX_WORKERS = 4;
+
+// 128 random bits as hex, for URLs nobody else on the network can guess
+static QString randomToken()
+{
+    QByteArray token(16, Qt::Uninitialized);
+    QRandomGenerator::system()->fillRange(
+        reinterpret_cast<quint32 *>(token.data()), token.size() / 4);
+    return QString::fromLatin1(token.toHex());
+}
+
 HttpServer::HttpServer(QObject *parent)
-    : QObject(parent), server(new QTcpServer(this)), port(8080)
+    : QObject(parent),
+      server(new HttpListener(
+          [this](qintptr socketDescriptor) {
+              onNewConnection(socketDescriptor);
+          },
+          this)),
+      port(8080)
 {
-    connect(server, &QTcpServer::newConnection, this,
-            &HttpServer::onNewConnection);
 }
 
 HttpServer::~HttpServer() { stop(); }
@@ -43,15 +61,21 @@ void HttpServer::start(const QStringList &files)
 {
     fileList = files;
 
-    // Generate unique JSON filename
+    // Generate unique JSON filename. The manifest holds the upload URL,
+    // a timestamp alone would let any host on the network find it.
     QString timestamp =
         QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss");
-    jsonFileName = QString("%1-idescriptor-import.json").arg(timestamp);
+    jsonFileName = QString("%1-%2-idescriptor-import.json")
+                       .arg(timestamp, randomToken());
+    uploadToken = randomToken();
 
     // Try to bind to port 8080, if fails try other ports
     for (int tryPort = 8080; tryPort <= 8090; ++tryPort) {
         if (server->listen(QHostAddress::Any, tryPort)) {
             port = tryPort;
+            // The manifest has the port in its URLs
+            startWorkers(buildRoutes());
+            prepareVariants();
             emit serverStarted();
             return;
         }
@@ -65,147 +89,118 @@ void HttpServer::stop()
     if (server->isListening()) {
         server->close();
     }
+    stopWorkers();
 }
 
 int HttpServer::getPort() const { return port; }
 
-void HttpServer::onNewConnection()
+void HttpServer::setImageVariant(const ImageVariant &variant)
 {
-    QTcpSocket *socket = server->nextPendingConnection();
-    connect(socket, &QTcpSocket::readyRead, this, &HttpServer::onReadyRead);
-    connect(socket, &QTcpSocket::disconnected, this,
-            &HttpServer::onDisconnected);
-}
-
-void HttpServer::onReadyRead()
-{
-    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
-    if (!socket)
-        return;
-
-    QByteArray data = socket->readAll();
-    QString request = QString::fromUtf8(data);
-
-    // Parse HTTP request
-    QStringList lines = request.split("\r\n");
-    if (lines.isEmpty())
-        return;
-
-    QString requestLine = lines.first();
-    QStringList parts = requestLine.split(" ");
-    if (parts.size() < 2)
+    imageVariant = variant;
+    if (!server->isListening())
         return;
 
-    QString method = parts[0];
-    QString path = parts[1];
+    // The phone reads the manifest again on every run of the Shortcut
+    updateRoutes();
+    prepareVariants();
+}
 
-    if (method == "GET") {
-        handleRequest(socket, path);
-    } else {
-        sendResponse(socket, 405, "text/plain", "Method Not Allowed");
-    }
+void HttpServer::setUploadDirectory(const QString &directory)
+{
+    uploadDirectory = directory;
+    if (server->isListening())
+        updateRoutes();
 }
 
-void HttpServer::onDisconnected()
+void HttpServer::updateRoutes()
 {
-    QTcpSocket *socket = qobject_cast<QTcpSocket *>(sender());
-    if (socket) {
-        socket->deleteLater();
+    const std::shared_ptr<const HttpRoutes> routes = buildRoutes();
+    for (HttpWorker *worker : std::as_const(workers)) {
+        QMetaObject::invokeMethod(
+            worker, [worker, routes]() { worker->setRoutes(routes); },
+            Qt::QueuedConnection);
     }
 }
 
-void HttpServer::handleRequest(QTcpSocket *socket, const QString &path)
+// Encodes the variants ahead of the requests, the phone downloads one file
+// at a time and would otherwise wait for every encode in turn
+void HttpServer::prepareVariants()
 {
-    // Serve JSON manifest
-    if (path == QString("/%1").arg(jsonFileName)) {
-        sendJsonManifest(socket);
+    if (imageVariant.isNull())
         return;
-    }
-
-    // Serve files from /serve/ directory
-    if (path.startsWith("/serve/")) {
-        QString encodedFileName = path.mid(7); // Remove "/serve/"
-        QString fileName = QUrl::fromPercentEncoding(encodedFileName.toUtf8());
-
-        // Find the file in our list
-        QString targetFile;
-        for (const QString &file : fileList) {
-            QFileInfo info(file);
-            if (info.fileName() == fileName) {
-                targetFile = file;
-                break;
-            }
-        }
 
-        if (!targetFile.isEmpty()) {
-            sendFile(socket, targetFile);
-            return;
-        }
+    for (const QString &file : std::as_const(fileList)) {
+        if (ImportVariantCache::canTranscode(file))
+            ImportVariantCache::sharedInstance()->variant(file, imageVariant);
     }
-
-    sendResponse(socket, 404, "text/html",
-                 "<html><body><h1>404 Not Found</h1><p>The requested file was "
-                 "not found.</p></body></html>");
 }
 
-void HttpServer::sendResponse(QTcpSocket *socket, int statusCode,
-                              const QString &contentType,
-                              const QByteArray &data)
+void HttpServer::startWorkers(std::shared_ptr<const HttpRoutes> routes)
 {
-    QString statusText;
-    switch (statusCode) {
-    case 200:
-        statusText = "OK";
-        break;
-    case 404:
-        statusText = "Not Found";
-        break;
-    case 405:
-        statusText = "Method Not Allowed";
-        break;
-    case 500:
-        statusText = "Internal Server Error";
-        break;
-    default:
-        statusText = "Unknown";
-        break;
+    const int count = qBound(1, QThread::idealThreadCount(), MAX_WORKERS);
+    for (int i = 0; i < count; ++i) {
+        auto *thread = new QThread(this);
+        thread->setObjectName(QString("HttpWorker %1").arg(i));
+        auto *worker = new HttpWorker(routes);
+        worker->moveToThread(thread);
+        connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+        connect(worker, &HttpWorker::downloadProgress, this,
+                &HttpServer::downloadProgress);
+        connect(worker, &HttpWorker::uploadProgress, this,
+                &HttpServer::uploadProgress);
+        connect(worker, &HttpWorker::uploadFinished, this,
+                &HttpServer::uploadFinished);
+        thread->start();
+
+        workerThreads.append(thread);
+        workers.append(worker);
     }
-
-    QString response =
-        QString("HTTP/1.1 %1 %2\r\n").arg(statusCode).arg(statusText);
-    response += QString("Content-Type: %1\r\n").arg(contentType);
-    response += QString("Content-Length: %1\r\n").arg(data.size());
-    response += "Access-Control-Allow-Origin: *\r\n";
-    response += "Connection: close\r\n";
-    response += "\r\n";
-
-    socket->write(response.toUtf8());
-    socket->write(data);
-    socket->disconnectFromHost();
 }
 
-void HttpServer::sendFile(QTcpSocket *socket, const QString &filePath)
+// Workers and their connections are deleted on their own threads once the
+// loops exit
+void HttpServer::stopWorkers()
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        sendResponse(socket, 404, "text/plain", "File not found");
-        return;
+    for (QThread *thread : std::as_const(workerThreads)) {
+        thread->quit();
+        thread->wait();
+        delete thread;
     }
+    workerThreads.clear();
+    workers.clear();
+}
 
-    QByteArray data = file.readAll();
-    QString mimeType = getMimeType(filePath);
-
-    // Emit progress signal
-    QFileInfo info(filePath);
-    emit downloadProgress(info.fileName(), data.size(), data.size());
+void HttpServer::onNewConnection(qintptr socketDescriptor)
+{
+    if (workers.isEmpty())
+        return;
 
-    sendResponse(socket, 200, mimeType, data);
+    HttpWorker *worker = workers[nextWorker];
+    nextWorker = (nextWorker + 1) % workers.size();
+    QMetaObject::invokeMethod(
+        worker,
+        [worker, socketDescriptor]() {
+            worker->addConnection(socketDescriptor);
+        },
+        Qt::QueuedConnection);
 }
 
-void HttpServer::sendJsonManifest(QTcpSocket *socket)
+// The first file wins when names collide, the manifest lists names only
+std::shared_ptr<HttpRoutes> HttpServer::buildRoutes() const
 {
-    QString jsonContent = generateJsonManifest();
-    sendResponse(socket, 200, "application/json", jsonContent.toUtf8());
+    auto routes = std::make_shared<HttpRoutes>();
+    routes->manifestPath = "/" + jsonFileName;
+    routes->manifest = generateJsonManifest().toUtf8();
+    routes->uploadDir = uploadDirectory;
+    routes->uploadToken = uploadToken;
+    routes->variant = imageVariant;
+    routes->files.reserve(fileList.size());
+    for (const QString &file : fileList) {
+        const QString fileName = QFileInfo(file).fileName();
+        if (!routes->files.contains(fileName))
+            routes->files.insert(fileName, file);
+    }
+    return routes;
 }
 
 QString HttpServer::generateJsonManifest() const
@@ -218,15 +213,25 @@ QString HttpServer::generateJsonManifest() const
     for (const QString &file : fileList) {
         QFileInfo info(file);
         QJsonObject item;
-        item["path"] = QString("http://%1:%2/serve/%3")
+        QString path = QString("http://%1:%2/serve/%3")
                            .arg(serverIP)
                            .arg(port)
                            .arg(QString::fromUtf8(
                                QUrl::toPercentEncoding(info.fileName())));
+        if (!imageVariant.isNull() && ImportVariantCache::canTranscode(file))
+            path += '?' + imageVariant.toQuery();
+        item["path"] = path;
         items.append(item);
     }
 
     manifest["items"] = items;
+    // Where a companion Shortcut sends files back to
+    if (!uploadDirectory.isEmpty()) {
+        manifest["upload"] = QString("http://%1:%2/upload/%3/")
+                                 .arg(serverIP)
+                                 .arg(port)
+                                 .arg(uploadToken);
+    }
 
     QJsonDocument doc(manifest);
     return doc.toJson();
@@ -248,10 +253,3 @@ QString HttpServer::getLocalIP() const
     }
     return "127.0.0.1";
 }
-
-QString HttpServer::getMimeType(const QString &filePath) const
-{
-    QMimeDatabase db;
-    QMimeType type = db.mimeTypeForFile(filePath);
-    return type.name();
-}
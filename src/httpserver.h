@@ -20,13 +20,59 @@
 #ifndef HTTPSERVER_H
 #define HTTPSERVER_H
 
-#include <QMap>
+#include "importvariantcache.h"
+#include <QList>
 #include <QObject>
 #include <QStringList>
 #include <QTcpServer>
-#include <QTcpSocket>
-#include <QTimer>
+#include <functional>
+#include <memory>
 
+class HttpWorker;
+class QThread;
+struct HttpRoutes;
+
+// Hands accepted sockets on as descriptors, so they can be opened on
+// another thread
+class HttpListener : public QTcpServer
+{
+public:
+    using Handler = std::function<void(qintptr)>;
+
+    explicit HttpListener(Handler handler, QObject *parent = nullptr)
+        : QTcpServer(parent), m_handler(std::move(handler))
+    {
+    }
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override
+    {
+        m_handler(socketDescriptor);
+    }
+
+private:
+    Handler m_handler;
+};
+
+/**
+ * @brief Serves the files picked for a wireless import to the companion
+ * Shortcut on the phone
+ *
+ * Only accepting connections happens on the thread owning the server,
+ * each connection is handed to one of a few HttpWorker threads in turn,
+ * so several phones importing at once don't queue up behind each other or
+ * behind the GUI. Files are looked up by name in an index built once in
+ * start().
+ *
+ * With an image variant set, the manifest points the phone at smaller
+ * copies of the images, encoded in the background as soon as the variant
+ * is set.
+ *
+ * With an upload directory set, the phone can also send files back, see
+ * HttpWorker and HttpUpload. The upload URL holds a random token made
+ * for each start(), only a phone that read the manifest knows it. The
+ * manifest's own name is random too.
+ */
 class HttpServer : public QObject
 {
     Q_OBJECT
@@ -38,32 +84,45 @@ public:
     void start(const QStringList &files);
     void stop();
     int getPort() const;
+    // Null to serve the original files, may be changed while running
+    void setImageVariant(const ImageVariant &variant);
+    // Where files uploaded by the phone go, empty turns uploads off. May
+    // be changed while running.
+    void setUploadDirectory(const QString &directory);
     QString getJsonFileName() const { return jsonFileName; }
 signals:
     void serverStarted();
     void serverError(const QString &error);
-    void downloadProgress(const QString &fileName, int bytesDownloaded,
-                          int totalBytes);
-
-private slots:
-    void onNewConnection();
-    void onReadyRead();
-    void onDisconnected();
+    // Bytes of the response body actually handed to the network
+    void downloadProgress(const QString &fileName, qint64 bytesDownloaded,
+                          qint64 totalBytes);
+    // totalBytes is -1 when the phone didn't announce a size
+    void uploadProgress(const QString &fileName, qint64 bytesReceived,
+                        qint64 totalBytes);
+    void uploadFinished(const QString &fileName, const QString &filePath,
+                        const QString &sha256);
 
 private:
-    QTcpServer *server;
+    HttpListener *server;
     QStringList fileList;
     int port;
     QString jsonFileName;
-    QMap<QString, int> downloadTracker;
+    ImageVariant imageVariant;
+    QString uploadDirectory;
+    QString uploadToken;
+
+    // Worker pool, a thread per worker
+    QList<QThread *> workerThreads;
+    QList<HttpWorker *> workers;
+    int nextWorker = 0;
 
-    void handleRequest(QTcpSocket *socket, const QString &path);
-    void sendResponse(QTcpSocket *socket, int statusCode,
-                      const QString &contentType, const QByteArray &data);
-    void sendFile(QTcpSocket *socket, const QString &filePath);
-    void sendJsonManifest(QTcpSocket *socket);
+    void onNewConnection(qintptr socketDescriptor);
+    void startWorkers(std::shared_ptr<const HttpRoutes> routes);
+    void stopWorkers();
+    void prepareVariants();
+    void updateRoutes();
+    std::shared_ptr<HttpRoutes> buildRoutes() const;
     QString generateJsonManifest() const;
-    QString getMimeType(const QString &filePath) const;
     QString getLocalIP() const;
 };
 
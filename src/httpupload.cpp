@@ -0,0 +1,556 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "httpupload.h"
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QSet>
+#include <QStorageInfo>
+#include <QUrlQuery>
+#include <QUuid>
+
+namespace
+{
+// Limits for the few lines we buffer, the file data itself never is
+constexpr int MAX_CHUNK_LINE_SIZE = 1024;
+constexpr int MAX_PART_HEADER_SIZE = 16 * 1024;
+// Bigger than any video a phone records, anything larger is refused
+constexpr qint64 MAX_UPLOAD_SIZE = 64LL * 1024 * 1024 * 1024;
+// Uploads never leave less than this free on the upload folder's disk
+constexpr qint64 MIN_FREE_SPACE = 1024LL * 1024 * 1024;
+// Chunked bodies don't announce their size, the free space is checked
+// again every time this much more arrived
+constexpr qint64 SPACE_CHECK_INTERVAL = 64 * 1024 * 1024;
+
+// Part files being written, shared by every worker thread so two
+// connections never resume the same upload at once. Also serializes
+// picking a free name for finished files.
+QMutex &uploadMutex()
+{
+    static QMutex mutex;
+    return mutex;
+}
+
+QSet<QString> &activeParts()
+{
+    static QSet<QString> parts;
+    return parts;
+}
+
+QString resumablePartPath(const QString &dir, const QString &name,
+                          qint64 total)
+{
+    return dir + "/." + name + '.' + QString::number(total) + ".part";
+}
+
+// Whether bytes more still leave MIN_FREE_SPACE on the folder's disk
+bool hasSpaceFor(const QString &dir, qint64 bytes)
+{
+    QDir().mkpath(dir);
+    const QStorageInfo storage(dir);
+    // Unknown on some network file systems, the writes fail there instead
+    if (!storage.isValid() || storage.bytesAvailable() < 0)
+        return true;
+    return storage.bytesAvailable() - bytes >= MIN_FREE_SPACE;
+}
+} // namespace
+
+HttpUpload::HttpUpload(const QString &uploadDir, const QString &fileName,
+                       const QMap<QString, QString> &headers,
+                       const QUrlQuery &query)
+    : m_uploadDir(uploadDir), m_fileName(sanitizeFileName(fileName))
+{
+    m_chunked = headers.value("transfer-encoding")
+                    .contains("chunked", Qt::CaseInsensitive);
+    if (!m_chunked) {
+        bool ok = false;
+        m_remaining = headers.value("content-length").toLongLong(&ok);
+        if (!ok || m_remaining < 0) {
+            fail(411, "Length Required");
+            return;
+        }
+        m_total = m_remaining;
+    }
+    if (m_total > MAX_UPLOAD_SIZE) {
+        fail(413, "Upload too large");
+        return;
+    }
+    if (!hasSpaceFor(m_uploadDir, qMax<qint64>(0, m_total))) {
+        fail(507, "Not enough disk space");
+        return;
+    }
+
+    const QString contentType = headers.value("content-type");
+    if (contentType.startsWith("multipart/form-data", Qt::CaseInsensitive)) {
+        const qsizetype at =
+            contentType.indexOf("boundary=", 0, Qt::CaseInsensitive);
+        QString boundary =
+            at < 0 ? QString() : contentType.mid(at + 9).section(';', 0, 0);
+        boundary = boundary.trimmed();
+        if (boundary.size() > 1 && boundary.startsWith('"') &&
+            boundary.endsWith('"')) {
+            boundary = boundary.mid(1, boundary.size() - 2);
+        }
+        if (boundary.isEmpty()) {
+            fail(400, "Missing multipart boundary");
+            return;
+        }
+        m_multipart = true;
+        m_delimiter = "\r\n--" + boundary.toUtf8();
+        // The first boundary has no line break in front, with one added
+        // every boundary is found the same way
+        m_pending = "\r\n";
+        return;
+    }
+
+    if (m_fileName.isEmpty()) {
+        fail(400, "Missing file name");
+        return;
+    }
+    m_expectedHash = headers.value("x-content-sha256").toLatin1().toLower();
+
+    bool ok = false;
+    const qint64 size = query.queryItemValue("size").toLongLong(&ok);
+    const qint64 offset = query.queryItemValue("offset").toLongLong();
+    if (ok && size > MAX_UPLOAD_SIZE) {
+        fail(413, "Upload too large");
+        return;
+    }
+    openSink(m_fileName, ok && size >= 0 ? size : -1, qMax<qint64>(0, offset));
+}
+
+// A dropped connection keeps what arrived of a resumable upload
+HttpUpload::~HttpUpload() { abortSink(); }
+
+QString HttpUpload::sanitizeFileName(const QString &fileName)
+{
+    QString name = QFileInfo(QString(fileName).replace('\\', '/')).fileName();
+    name.remove(QRegularExpression("[\\x00-\\x1f<>:\"|?*]"));
+    name = name.trimmed();
+    // No hidden files, and nothing that could be mistaken for a part file
+    while (name.startsWith('.'))
+        name.remove(0, 1);
+    return name;
+}
+
+qint64 HttpUpload::resumeOffset(const QString &uploadDir,
+                                const QString &fileName, qint64 totalSize)
+{
+    const QString name = sanitizeFileName(fileName);
+    if (name.isEmpty() || totalSize < 0)
+        return 0;
+    const QFileInfo part(resumablePartPath(uploadDir, name, totalSize));
+    return part.exists() ? part.size() : 0;
+}
+
+QString HttpUpload::uniquePath(const QString &dir, const QString &name)
+{
+    QString path = dir + '/' + name;
+    const QFileInfo info(name);
+    const QString suffix =
+        info.suffix().isEmpty() ? QString() : '.' + info.suffix();
+    for (int i = 1; QFileInfo::exists(path); ++i) {
+        path = QString("%1/%2 (%3)%4")
+                   .arg(dir, info.completeBaseName())
+                   .arg(i)
+                   .arg(suffix);
+    }
+    return path;
+}
+
+void HttpUpload::fail(int status, const QString &message)
+{
+    if (m_state == Failed)
+        return;
+    qWarning() << "HttpUpload:" << m_fileName << message;
+    m_state = Failed;
+    m_errorStatus = status;
+    m_errorString = message;
+    abortSink();
+}
+
+bool HttpUpload::openSink(const QString &name, qint64 total, qint64 offset)
+{
+    auto sink = std::make_unique<Sink>();
+    sink->name = name;
+    sink->resumable = total >= 0;
+    sink->expected = total;
+    sink->partPath =
+        sink->resumable
+            ? resumablePartPath(m_uploadDir, name, total)
+            : m_uploadDir + "/." + name + '.' +
+                  QUuid::createUuid().toString(QUuid::Id128) + ".part";
+
+    {
+        QMutexLocker locker(&uploadMutex());
+        if (activeParts().contains(sink->partPath)) {
+            locker.unlock();
+            fail(409, "Upload of this file already in progress");
+            return false;
+        }
+        activeParts().insert(sink->partPath);
+    }
+    m_sink = std::move(sink);
+
+    QIODevice::OpenMode mode = QIODevice::ReadWrite;
+    if (!m_sink->resumable || offset == 0)
+        mode |= QIODevice::Truncate;
+    QDir().mkpath(m_uploadDir);
+    m_sink->file.setFileName(m_sink->partPath);
+    if (!m_sink->file.open(mode)) {
+        fail(500, "Could not create " + m_sink->partPath);
+        return false;
+    }
+
+    if (m_sink->resumable) {
+        m_offset = m_sink->file.size();
+        if (offset > m_offset || offset > total) {
+            fail(409, QString("Resume at offset %1").arg(m_offset));
+            return false;
+        }
+        // Anything after the offset is sent again, the bytes before it
+        // count towards the hash, see hashResumed()
+        m_sink->file.resize(offset);
+        m_sink->file.seek(offset);
+        m_sink->unhashed = offset > 0;
+        m_offset = offset;
+    }
+    return true;
+}
+
+bool HttpUpload::hashResumed()
+{
+    if (!needsHashing())
+        return m_state != Failed;
+
+    m_sink->file.seek(0);
+    if (!m_sink->hash.addData(&m_sink->file) ||
+        m_sink->file.pos() != m_offset) {
+        fail(500, "Could not read " + m_sink->partPath);
+        return false;
+    }
+    m_sink->unhashed = false;
+    return true;
+}
+
+bool HttpUpload::writeSink(const char *data, qint64 size)
+{
+    if (m_sink->file.write(data, size) != size) {
+        fail(500, "Could not write " + m_sink->partPath);
+        return false;
+    }
+    m_sink->hash.addData(QByteArrayView(data, size));
+    if (m_sink->resumable)
+        m_offset += size;
+    return true;
+}
+
+bool HttpUpload::finishSink()
+{
+    Sink &sink = *m_sink;
+    const qint64 size = sink.file.size();
+    if (sink.resumable && size > sink.expected) {
+        fail(400, "More data than the announced size");
+        return false;
+    }
+    sink.file.close();
+
+    if (sink.resumable && size < sink.expected) {
+        // Complete once a later request sends the rest
+        abortSink();
+        return true;
+    }
+
+    const QByteArray sha256 = sink.hash.result().toHex();
+    if (!m_expectedHash.isEmpty() && sha256 != m_expectedHash) {
+        QFile::remove(sink.partPath);
+        fail(422, "SHA-256 mismatch");
+        return false;
+    }
+
+    QMutexLocker locker(&uploadMutex());
+    const QString path = uniquePath(m_uploadDir, sink.name);
+    if (!QFile::rename(sink.partPath, path)) {
+        locker.unlock();
+        fail(500, "Could not move the upload to " + path);
+        return false;
+    }
+    activeParts().remove(sink.partPath);
+    locker.unlock();
+
+    m_files.append({QFileInfo(path).fileName(), path, size, sha256});
+    m_sink.reset();
+    return true;
+}
+
+// Resumable part files are kept, others removed
+void HttpUpload::abortSink()
+{
+    if (!m_sink)
+        return;
+
+    m_sink->file.close();
+    if (!m_sink->resumable)
+        QFile::remove(m_sink->partPath);
+
+    QMutexLocker locker(&uploadMutex());
+    activeParts().remove(m_sink->partPath);
+    locker.unlock();
+    m_sink.reset();
+}
+
+HttpUpload::State HttpUpload::consume(QByteArray &buffer)
+{
+    if (m_state != Receiving)
+        return m_state;
+    if (needsHashing() && !hashResumed())
+        return m_state;
+
+    if (m_chunked) {
+        decodeChunked(buffer);
+        return m_state;
+    }
+
+    const qint64 size = qMin<qint64>(m_remaining, buffer.size());
+    if (size > 0 && consumeContent(buffer.constData(), size)) {
+        buffer.remove(0, size);
+        m_remaining -= size;
+    }
+    if (m_state == Receiving && m_remaining == 0)
+        bodyComplete();
+    return m_state;
+}
+
+/*
+ * Chunked transfer encoding: "<hex size>[;extensions]\r\n<data>\r\n"
+ * repeated, a zero size chunk and optional trailers end the body.
+ */
+bool HttpUpload::decodeChunked(QByteArray &buffer)
+{
+    qsizetype pos = 0;
+    bool more = true;
+    while (more && m_state == Receiving) {
+        switch (m_chunkState) {
+        case ChunkSize: {
+            const qsizetype lineEnd = buffer.indexOf("\r\n", pos);
+            if (lineEnd < 0) {
+                if (buffer.size() - pos > MAX_CHUNK_LINE_SIZE)
+                    fail(400, "Malformed chunk size");
+                more = false;
+                break;
+            }
+            bool ok = false;
+            const qint64 size = buffer.mid(pos, lineEnd - pos)
+                                    .split(';')
+                                    .first()
+                                    .trimmed()
+                                    .toLongLong(&ok, 16);
+            if (!ok || size < 0) {
+                fail(400, "Malformed chunk size");
+                break;
+            }
+            pos = lineEnd + 2;
+            m_remaining = size;
+            m_chunkState = size == 0 ? Trailers : ChunkData;
+            break;
+        }
+        case ChunkData: {
+            const qint64 size = qMin<qint64>(m_remaining, buffer.size() - pos);
+            if (size == 0) {
+                more = false;
+                break;
+            }
+            if (!consumeContent(buffer.constData() + pos, size))
+                break;
+            pos += size;
+            m_remaining -= size;
+            if (m_remaining == 0)
+                m_chunkState = ChunkDataEnd;
+            break;
+        }
+        case ChunkDataEnd:
+            if (buffer.size() - pos < 2) {
+                more = false;
+                break;
+            }
+            if (buffer.mid(pos, 2) != "\r\n") {
+                fail(400, "Malformed chunk");
+                break;
+            }
+            pos += 2;
+            m_chunkState = ChunkSize;
+            break;
+        case Trailers: {
+            const qsizetype lineEnd = buffer.indexOf("\r\n", pos);
+            if (lineEnd < 0) {
+                more = false;
+                break;
+            }
+            const bool lastLine = lineEnd == pos;
+            pos = lineEnd + 2;
+            if (lastLine) {
+                bodyComplete();
+                more = false;
+            }
+            break;
+        }
+        }
+    }
+    buffer.remove(0, pos);
+    return m_state != Failed;
+}
+
+bool HttpUpload::consumeContent(const char *data, qint64 size)
+{
+    m_received += size;
+    if (m_received > MAX_UPLOAD_SIZE) {
+        fail(413, "Upload too large");
+        return false;
+    }
+    if (m_chunked &&
+        m_received / SPACE_CHECK_INTERVAL !=
+            (m_received - size) / SPACE_CHECK_INTERVAL &&
+        !hasSpaceFor(m_uploadDir, SPACE_CHECK_INTERVAL)) {
+        fail(507, "Not enough disk space");
+        return false;
+    }
+    if (!m_multipart)
+        return writeSink(data, size);
+
+    m_pending.append(data, size);
+    return parseMultipart();
+}
+
+/*
+ * Parts are "--<boundary>\r\n<headers>\r\n\r\n<data>" and the body ends
+ * with "--<boundary>--". Part data is written as it arrives, only the last
+ * few bytes that could be the start of a boundary are held back.
+ */
+bool HttpUpload::parseMultipart()
+{
+    while (m_state == Receiving) {
+        switch (m_partState) {
+        case Preamble:
+        case PartBody: {
+            const qsizetype boundary = m_pending.indexOf(m_delimiter);
+            const qsizetype size =
+                boundary >= 0 ? boundary
+                              : m_pending.size() - (m_delimiter.size() - 1);
+            if (size > 0) {
+                if (m_partState == PartBody && m_sink &&
+                    !writeSink(m_pending.constData(), size)) {
+                    return false;
+                }
+                m_pending.remove(0, size);
+            }
+            if (boundary < 0)
+                return true;
+
+            m_pending.remove(0, m_delimiter.size());
+            if (m_partState == PartBody && m_sink && !finishSink())
+                return false;
+            m_partState = AfterBoundary;
+            break;
+        }
+        case AfterBoundary:
+            if (m_pending.size() < 2)
+                return true;
+            if (m_pending.startsWith("--")) {
+                m_partState = End;
+                break;
+            }
+            if (!m_pending.startsWith("\r\n")) {
+                fail(400, "Malformed multipart body");
+                return false;
+            }
+            m_pending.remove(0, 2);
+            m_partState = PartHeaders;
+            break;
+        case PartHeaders: {
+            const qsizetype headerEnd = m_pending.indexOf("\r\n\r\n");
+            if (headerEnd < 0) {
+                if (m_pending.size() > MAX_PART_HEADER_SIZE) {
+                    fail(400, "Multipart headers too large");
+                    return false;
+                }
+                return true;
+            }
+            const QString headers =
+                QString::fromUtf8(m_pending.left(headerEnd));
+            m_pending.remove(0, headerEnd + 4);
+
+            // Form fields without a file name are skipped
+            static const QRegularExpression fileNamePattern(
+                "filename=(?:\"([^\"]*)\"|([^;\\r\\n]*))",
+                QRegularExpression::CaseInsensitiveOption);
+            const QRegularExpressionMatch match =
+                fileNamePattern.match(headers);
+            const QString name = sanitizeFileName(
+                match.captured(1).isEmpty() ? match.captured(2)
+                                            : match.captured(1));
+            if (!name.isEmpty() && !openSink(name, -1, 0))
+                return false;
+            m_partState = PartBody;
+            break;
+        }
+        case End:
+            // The epilogue, if any, is ignored
+            m_pending.clear();
+            return true;
+        }
+    }
+    return false;
+}
+
+void HttpUpload::bodyComplete()
+{
+    if (m_multipart) {
+        if (m_partState != End) {
+            fail(400, "Truncated multipart body");
+            return;
+        }
+    } else if (!finishSink()) {
+        return;
+    }
+    m_state = Finished;
+}
+
+QByteArray HttpUpload::result() const
+{
+    QJsonObject reply;
+    QJsonArray files;
+    for (const File &file : m_files) {
+        QJsonObject item;
+        item["name"] = file.name;
+        item["size"] = file.size;
+        item["sha256"] = QString::fromLatin1(file.sha256);
+        files.append(item);
+    }
+    reply["files"] = files;
+    // Raw uploads that aren't complete yet say where to go on
+    reply["complete"] = m_multipart || !m_files.isEmpty();
+    reply["offset"] = m_offset;
+    return QJsonDocument(reply).toJson(QJsonDocument::Compact);
+}
@@ -0,0 +1,160 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HTTPUPLOAD_H
+#define HTTPUPLOAD_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <memory>
+
+QT_BEGIN_NAMESPACE
+class QUrlQuery;
+QT_END_NAMESPACE
+
+/**
+ * @brief Receives the body of an upload request straight to disk
+ *
+ * Fed by HttpWorker with whatever arrived on the connection, the body may
+ * be framed by Content-Length or chunked transfer encoding and hold either
+ * the raw file or multipart/form-data parts with one file each. Files are
+ * written to a hidden .part file while their SHA-256 is computed and
+ * renamed once complete, an existing file is never overwritten. Bodies
+ * and announced sizes over 64 GB are refused, as is anything that would
+ * leave less than 1 GB free on the upload folder's disk.
+ *
+ * Raw uploads that give the total size (?size=N) can be resumed: the part
+ * file is kept when the connection drops, GET /upload/<token>/<name>?size=N
+ * tells how much arrived and the next request continues with
+ * ?offset=<that>.
+ */
+class HttpUpload
+{
+public:
+    enum State { Receiving, Finished, Failed };
+
+    struct File {
+        QString name;
+        QString path;
+        qint64 size = 0;
+        QByteArray sha256; // hex
+    };
+
+    /**
+     * @param headers Request headers, lower case names
+     * @param query ?size=<total bytes>&offset=<first byte of this body>
+     * for resumable raw uploads
+     */
+    HttpUpload(const QString &uploadDir, const QString &fileName,
+               const QMap<QString, QString> &headers, const QUrlQuery &query);
+    ~HttpUpload();
+    Q_DISABLE_COPY(HttpUpload)
+
+    /**
+     * @brief Consume body bytes from the start of buffer
+     *
+     * Bytes after the end of the body are left in buffer, they belong to
+     * the next request.
+     */
+    State consume(QByteArray &buffer);
+
+    State state() const { return m_state; }
+
+    // A resumed upload still has to hash the bytes already on disk before
+    // it takes the body. That reads the whole part file, hashResumed() can
+    // run on any thread while nothing else uses the upload.
+    bool needsHashing() const { return m_sink && m_sink->unhashed; }
+    bool hashResumed();
+    // HTTP status and message when Failed
+    int errorStatus() const { return m_errorStatus; }
+    QString errorString() const { return m_errorString; }
+
+    QString fileName() const { return m_fileName; }
+    // Body bytes received so far, and the expected total, -1 if unknown
+    qint64 received() const { return m_received; }
+    qint64 total() const { return m_total; }
+    // Bytes of a resumable upload on disk, also when it isn't complete
+    qint64 offset() const { return m_offset; }
+    const QList<File> &files() const { return m_files; }
+    // JSON reply once Finished, the files or the offset to resume at
+    QByteArray result() const;
+
+    // Bytes a resumable upload of the file already has on disk
+    static qint64 resumeOffset(const QString &uploadDir,
+                               const QString &fileName, qint64 totalSize);
+    // File name without path components or anything else we don't want
+    // in a local file name, empty if nothing is left
+    static QString sanitizeFileName(const QString &fileName);
+
+private:
+    // The file being written, one per multipart part
+    struct Sink {
+        QString name;
+        QString partPath;
+        QFile file;
+        QCryptographicHash hash{QCryptographicHash::Sha256};
+        qint64 expected = -1; // resumable uploads only
+        bool resumable = false;
+        bool unhashed = false; // resumed bytes not in the hash yet
+    };
+
+    enum ChunkState { ChunkSize, ChunkData, ChunkDataEnd, Trailers };
+    enum PartState { Preamble, AfterBoundary, PartHeaders, PartBody, End };
+
+    void fail(int status, const QString &message);
+    bool openSink(const QString &name, qint64 total, qint64 offset);
+    bool writeSink(const char *data, qint64 size);
+    bool finishSink();
+    void abortSink();
+    bool decodeChunked(QByteArray &buffer);
+    bool consumeContent(const char *data, qint64 size);
+    bool parseMultipart();
+    void bodyComplete();
+    static QString uniquePath(const QString &dir, const QString &name);
+
+    QString m_uploadDir;
+    QString m_fileName;
+    State m_state = Receiving;
+    int m_errorStatus = 0;
+    QString m_errorString;
+
+    // Framing
+    bool m_chunked = false;
+    qint64 m_remaining = 0; // Content-Length left, or of the current chunk
+    ChunkState m_chunkState = ChunkSize;
+    qint64 m_received = 0;
+    qint64 m_total = -1;
+
+    // Content
+    bool m_multipart = false;
+    QByteArray m_delimiter; // "\r\n--<boundary>"
+    PartState m_partState = Preamble;
+    QByteArray m_pending; // multipart bytes not parsed yet
+    QByteArray m_expectedHash;
+    qint64 m_offset = 0;
+
+    std::unique_ptr<Sink> m_sink;
+    QList<File> m_files;
+};
+
+#endif // HTTPUPLOAD_H
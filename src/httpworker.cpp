@@ -0,0 +1,685 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "httpworker.h"
+#include "httpupload.h"
+#include "importvariantcache.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QMimeDatabase>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QtConcurrent/QtConcurrent>
+
+// Requests are small, anything bigger than this without a blank line is
+// not a request we want to handle
+constexpr int MAX_REQUEST_HEADER_SIZE = 16 * 1024;
+// Body bytes queued on a socket before we wait for the network, keeps
+// memory per connection bounded whatever the file size
+constexpr qint64 MAX_PENDING_BYTES = 2 * 1024 * 1024;
+constexpr qint64 CHUNK_SIZE = 256 * 1024;
+// Window of the file mapped at a time, mappings of whole multi-GB files
+// could fail on 32 bit address spaces
+constexpr qint64 MAP_WINDOW_SIZE = 16 * 1024 * 1024;
+constexpr int PROGRESS_INTERVAL_MS = 200;
+// Idle keep-alive connections are closed after this long
+constexpr int KEEP_ALIVE_TIMEOUT_MS = 15000;
+
+HttpWorker::HttpWorker(std::shared_ptr<const HttpRoutes> routes,
+                       QObject *parent)
+    : QObject(parent), m_routes(std::move(routes)),
+      m_idleTimer(new QTimer(this))
+{
+    m_idleTimer->setInterval(KEEP_ALIVE_TIMEOUT_MS / 2);
+    connect(m_idleTimer, &QTimer::timeout, this,
+            &HttpWorker::closeIdleConnections);
+}
+
+HttpWorker::~HttpWorker()
+{
+    const QList<QTcpSocket *> sockets = m_connections.keys();
+    for (QTcpSocket *socket : sockets) {
+        socket->abort();
+        delete socket;
+    }
+}
+
+void HttpWorker::addConnection(qintptr socketDescriptor)
+{
+    auto *socket = new QTcpSocket(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        qWarning() << "HttpWorker: Failed to set socket descriptor";
+        delete socket;
+        return;
+    }
+
+    m_connections[socket].idle.start();
+    if (!m_idleTimer->isActive())
+        m_idleTimer->start();
+
+    connect(socket, &QTcpSocket::readyRead, this,
+            [this, socket]() { onReadyRead(socket); });
+    connect(socket, &QTcpSocket::bytesWritten, this,
+            [this, socket]() { onBytesWritten(socket); });
+    connect(socket, &QTcpSocket::disconnected, this,
+            [this, socket]() { closeConnection(socket); });
+}
+
+void HttpWorker::setRoutes(std::shared_ptr<const HttpRoutes> routes)
+{
+    m_routes = std::move(routes);
+}
+
+void HttpWorker::onReadyRead(QTcpSocket *socket)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end() || it->hashing)
+        return;
+
+    it->buffer += socket->readAll();
+    it->idle.restart();
+    processRequests(socket);
+}
+
+/*
+ * Requests can arrive in pieces or several at once (pipelining), the buffer
+ * is parsed one complete header block at a time. While a file is being
+ * sent further requests wait in the buffer, while one is being received
+ * the buffer is its body.
+ */
+void HttpWorker::processRequests(QTcpSocket *socket)
+{
+    while (true) {
+        auto it = m_connections.find(socket);
+        if (it == m_connections.end() || it->sending ||
+            socket->state() != QAbstractSocket::ConnectedState) {
+            return;
+        }
+
+        if (it->upload) {
+            // Goes on from finishResponse() once the upload is done
+            receiveUpload(socket);
+            return;
+        }
+
+        const qsizetype headerEnd = it->buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            if (it->buffer.size() > MAX_REQUEST_HEADER_SIZE) {
+                it->keepAlive = false;
+                sendResponse(socket, 431, "text/plain",
+                             "Request Header Fields Too Large");
+            }
+            return;
+        }
+
+        const QByteArray header = it->buffer.left(headerEnd);
+        it->buffer.remove(0, headerEnd + 4);
+        handleRequest(socket, parseRequest(header));
+    }
+}
+
+HttpWorker::HttpRequest HttpWorker::parseRequest(const QByteArray &header)
+{
+    HttpRequest request;
+    const QStringList lines = QString::fromUtf8(header).split("\r\n");
+
+    // "GET /path HTTP/1.1"
+    const QStringList requestLine = lines.value(0).split(' ');
+    if (requestLine.size() >= 3) {
+        request.method = requestLine[0];
+        request.path = requestLine[1];
+        request.httpVersion = requestLine[2];
+    }
+
+    for (qsizetype i = 1; i < lines.size(); ++i) {
+        const qsizetype colon = lines[i].indexOf(':');
+        if (colon > 0) {
+            request.headers.insert(lines[i].left(colon).trimmed().toLower(),
+                                   lines[i].mid(colon + 1).trimmed());
+        }
+    }
+    return request;
+}
+
+void HttpWorker::handleRequest(QTcpSocket *socket, const HttpRequest &request)
+{
+    Connection &connection = m_connections[socket];
+
+    // HTTP/1.1 keeps the connection open unless told otherwise, 1.0 only
+    // when asked to
+    const QString connectionHeader =
+        request.headers.value("connection").toLower();
+    if (request.httpVersion == "HTTP/1.1") {
+        connection.keepAlive = connectionHeader != "close";
+    } else {
+        connection.keepAlive = connectionHeader == "keep-alive";
+    }
+
+    const bool headOnly = request.method == "HEAD";
+    const QString path = request.path.section('?', 0, 0);
+    if ((path == "/upload" || path.startsWith("/upload/")) &&
+        !m_routes->uploadDir.isEmpty()) {
+        const QString uploadPath = "/upload/" + m_routes->uploadToken + '/';
+        if (m_routes->uploadToken.isEmpty() ||
+            !path.startsWith(uploadPath)) {
+            // A body we don't read would be parsed as the next request
+            connection.keepAlive = false;
+            sendResponse(socket, 403, "text/plain", "Forbidden", headOnly);
+            return;
+        }
+        const QString fileName = QUrl::fromPercentEncoding(
+            path.mid(uploadPath.size()).toUtf8());
+        if (request.method == "POST" || request.method == "PUT") {
+            startUpload(socket, request, fileName);
+            return;
+        }
+        if (request.method == "GET" || headOnly) {
+            bool ok = false;
+            const qint64 size =
+                QUrlQuery(request.path.section('?', 1))
+                    .queryItemValue("size")
+                    .toLongLong(&ok);
+            const qint64 offset =
+                ok ? HttpUpload::resumeOffset(m_routes->uploadDir, fileName,
+                                              size)
+                   : 0;
+            sendResponse(socket, 200, "application/json",
+                         QString("{\"offset\":%1}").arg(offset).toUtf8(),
+                         headOnly);
+            return;
+        }
+    }
+
+    if (request.method != "GET" && !headOnly) {
+        // A body we don't read would be parsed as the next request
+        connection.keepAlive = false;
+        sendResponse(socket, 405, "text/plain", "Method Not Allowed");
+        return;
+    }
+
+    if (path == m_routes->manifestPath) {
+        sendResponse(socket, 200, "application/json", m_routes->manifest,
+                     headOnly);
+        return;
+    }
+
+    // Files are served under /serve/<percent encoded file name>
+    if (path.startsWith("/serve/")) {
+        const QString fileName =
+            QUrl::fromPercentEncoding(path.mid(7).toUtf8());
+        const auto file = m_routes->files.constFind(fileName);
+        if (file != m_routes->files.cend()) {
+            sendVariant(socket, *file, request);
+            return;
+        }
+    }
+
+    sendResponse(socket, 404, "text/html",
+                 "<html><body><h1>404 Not Found</h1><p>The requested file was "
+                 "not found.</p></body></html>",
+                 headOnly);
+}
+
+void HttpWorker::sendResponse(QTcpSocket *socket, int statusCode,
+                              const QString &contentType,
+                              const QByteArray &data, bool headOnly)
+{
+    QString statusText;
+    switch (statusCode) {
+    case 200:
+        statusText = "OK";
+        break;
+    case 201:
+        statusText = "Created";
+        break;
+    case 400:
+        statusText = "Bad Request";
+        break;
+    case 403:
+        statusText = "Forbidden";
+        break;
+    case 404:
+        statusText = "Not Found";
+        break;
+    case 405:
+        statusText = "Method Not Allowed";
+        break;
+    case 409:
+        statusText = "Conflict";
+        break;
+    case 411:
+        statusText = "Length Required";
+        break;
+    case 413:
+        statusText = "Content Too Large";
+        break;
+    case 422:
+        statusText = "Unprocessable Content";
+        break;
+    case 431:
+        statusText = "Request Header Fields Too Large";
+        break;
+    case 500:
+        statusText = "Internal Server Error";
+        break;
+    case 507:
+        statusText = "Insufficient Storage";
+        break;
+    default:
+        statusText = "Unknown";
+        break;
+    }
+
+    const bool keepAlive = m_connections.value(socket).keepAlive;
+    QString response =
+        QString("HTTP/1.1 %1 %2\r\n").arg(statusCode).arg(statusText);
+    response += QString("Content-Type: %1\r\n").arg(contentType);
+    response += QString("Content-Length: %1\r\n").arg(data.size());
+    response += "Access-Control-Allow-Origin: *\r\n";
+    response += keepAlive ? "Connection: keep-alive\r\n"
+                          : "Connection: close\r\n";
+    response += "\r\n";
+
+    socket->write(response.toUtf8());
+    if (!headOnly)
+        socket->write(data);
+    finishResponse(socket);
+}
+
+void HttpWorker::startUpload(QTcpSocket *socket, const HttpRequest &request,
+                             const QString &fileName)
+{
+    Connection &connection = m_connections[socket];
+    auto upload = std::make_shared<HttpUpload>(
+        m_routes->uploadDir, fileName, request.headers,
+        QUrlQuery(request.path.section('?', 1)));
+    if (upload->state() == HttpUpload::Failed) {
+        // The body is still on its way, the connection can't be reused
+        connection.keepAlive = false;
+        sendResponse(socket, upload->errorStatus(), "text/plain",
+                     upload->errorString().toUtf8());
+        return;
+    }
+
+    const bool expectContinue =
+        request.headers.value("expect").compare(
+            "100-continue", Qt::CaseInsensitive) == 0;
+    if (!upload->needsHashing()) {
+        acceptUpload(socket, upload, expectContinue);
+        return;
+    }
+
+    // Hashing what a resumed upload has on disk reads the whole part file,
+    // the worker's other connections go on meanwhile. The body waits in
+    // the socket, a small read buffer lets TCP hold the phone back.
+    connection.sending = true;
+    connection.hashing = true;
+    socket->setReadBufferSize(CHUNK_SIZE);
+    auto *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this,
+            [this, socket, watcher, upload, expectContinue]() {
+                watcher->deleteLater();
+                auto it = m_connections.find(socket);
+                if (it == m_connections.end())
+                    return;
+                it->sending = false;
+                it->hashing = false;
+                socket->setReadBufferSize(0);
+                if (!watcher->result()) {
+                    it->keepAlive = false;
+                    sendResponse(socket, upload->errorStatus(), "text/plain",
+                                 upload->errorString().toUtf8());
+                    return;
+                }
+                acceptUpload(socket, upload, expectContinue);
+                onReadyRead(socket);
+            });
+    watcher->setFuture(
+        QtConcurrent::run([upload]() { return upload->hashResumed(); }));
+}
+
+void HttpWorker::acceptUpload(QTcpSocket *socket,
+                              const std::shared_ptr<HttpUpload> &upload,
+                              bool expectContinue)
+{
+    if (expectContinue)
+        socket->write("HTTP/1.1 100 Continue\r\n\r\n");
+    Connection &connection = m_connections[socket];
+    connection.upload = upload;
+    connection.lastUploadProgress.start();
+}
+
+// Writes what arrived of the body to disk, every connection's upload goes
+// straight to its own file on its worker's thread
+void HttpWorker::receiveUpload(QTcpSocket *socket)
+{
+    Connection &connection = m_connections[socket];
+    const std::shared_ptr<HttpUpload> upload = connection.upload;
+    const HttpUpload::State state = upload->consume(connection.buffer);
+
+    if (state == HttpUpload::Receiving) {
+        if (connection.lastUploadProgress.hasExpired(PROGRESS_INTERVAL_MS)) {
+            connection.lastUploadProgress.restart();
+            emit uploadProgress(upload->fileName(), upload->received(),
+                                upload->total());
+        }
+        return;
+    }
+
+    connection.upload.reset();
+    if (state == HttpUpload::Failed) {
+        connection.keepAlive = false;
+        sendResponse(socket, upload->errorStatus(), "text/plain",
+                     upload->errorString().toUtf8());
+        return;
+    }
+
+    emit uploadProgress(upload->fileName(), upload->received(),
+                        upload->received());
+    for (const HttpUpload::File &file : upload->files()) {
+        qDebug() << "HttpWorker: Received" << file.path << file.size
+                 << "bytes";
+        emit uploadFinished(file.name, file.path,
+                            QString::fromLatin1(file.sha256));
+    }
+    sendResponse(socket, upload->files().isEmpty() ? 200 : 201,
+                 "application/json", upload->result());
+}
+
+// Waits for the variant asked for in the query without blocking the
+// worker's other connections, plain requests are sent right away. Only the
+// advertised variant is encoded, every other one would be cached for good.
+void HttpWorker::sendVariant(QTcpSocket *socket, const QString &filePath,
+                             const HttpRequest &request)
+{
+    const QString fileName = QFileInfo(filePath).fileName();
+    const ImageVariant variant =
+        ImageVariant::fromQuery(QUrlQuery(request.path.section('?', 1)));
+    if (variant.isNull() || variant != m_routes->variant ||
+        !ImportVariantCache::canTranscode(filePath)) {
+        sendFile(socket, filePath, request, fileName);
+        return;
+    }
+
+    // Holds back pipelined requests like a transfer does
+    m_connections[socket].sending = true;
+
+    auto *watcher = new QFutureWatcher<QString>(this);
+    connect(watcher, &QFutureWatcher<QString>::finished, this,
+            [this, socket, watcher, request, fileName]() {
+                watcher->deleteLater();
+                auto it = m_connections.find(socket);
+                if (it == m_connections.end())
+                    return;
+                it->sending = false;
+                sendFile(socket, watcher->result(), request, fileName);
+            });
+    watcher->setFuture(
+        ImportVariantCache::sharedInstance()->variant(filePath, variant));
+}
+
+void HttpWorker::sendFile(QTcpSocket *socket, const QString &filePath,
+                          const HttpRequest &request, const QString &fileName)
+{
+    auto file = std::make_shared<QFile>(filePath);
+    if (!file->open(QIODevice::ReadOnly)) {
+        sendResponse(socket, 404, "text/plain", "File not found");
+        return;
+    }
+
+    Connection &connection = m_connections[socket];
+    const QString connectionHeader = connection.keepAlive
+                                         ? "Connection: keep-alive\r\n"
+                                         : "Connection: close\r\n";
+
+    const qint64 fileSize = file->size();
+    qint64 start = 0;
+    qint64 end = fileSize;
+    const QString rangeHeader = request.headers.value("range");
+    const bool hasRange = !rangeHeader.isEmpty();
+    if (hasRange && !parseRange(rangeHeader, fileSize, start, end)) {
+        QString response = "HTTP/1.1 416 Range Not Satisfiable\r\n";
+        response += QString("Content-Range: bytes */%1\r\n").arg(fileSize);
+        response += "Content-Length: 0\r\n";
+        response += "Access-Control-Allow-Origin: *\r\n";
+        response += connectionHeader;
+        response += "\r\n";
+        socket->write(response.toUtf8());
+        finishResponse(socket);
+        return;
+    }
+
+    QString response = hasRange ? "HTTP/1.1 206 Partial Content\r\n"
+                                : "HTTP/1.1 200 OK\r\n";
+    if (hasRange) {
+        response += QString("Content-Range: bytes %1-%2/%3\r\n")
+                        .arg(start)
+                        .arg(end - 1)
+                        .arg(fileSize);
+    }
+    response += QString("Content-Type: %1\r\n").arg(getMimeType(filePath));
+    response += QString("Content-Length: %1\r\n").arg(end - start);
+    response += "Accept-Ranges: bytes\r\n";
+    response += "Access-Control-Allow-Origin: *\r\n";
+    response += connectionHeader;
+    response += "\r\n";
+    socket->write(response.toUtf8());
+
+    if (request.method == "HEAD") {
+        finishResponse(socket);
+        return;
+    }
+
+    Transfer &transfer = connection.transfer;
+    transfer = Transfer();
+    transfer.file = file;
+    transfer.fileName = fileName;
+    transfer.offset = start;
+    transfer.end = end;
+    transfer.bodySize = end - start;
+    transfer.lastProgress.start();
+    connection.sending = true;
+
+    reportProgress(socket, true);
+    continueTransfer(socket);
+}
+
+// "bytes=first-last", "bytes=first-" or "bytes=-suffix", end is exclusive.
+// Multiple ranges aren't supported, nobody resumes a download that way.
+bool HttpWorker::parseRange(const QString &rangeHeader, qint64 fileSize,
+                            qint64 &start, qint64 &end)
+{
+    if (!rangeHeader.startsWith("bytes=") || rangeHeader.contains(','))
+        return false;
+
+    const QString spec = rangeHeader.mid(6).trimmed();
+    const int dash = spec.indexOf('-');
+    if (dash < 0)
+        return false;
+
+    bool ok = true;
+    const QString first = spec.left(dash).trimmed();
+    const QString last = spec.mid(dash + 1).trimmed();
+    if (first.isEmpty()) {
+        const qint64 suffix = last.toLongLong(&ok);
+        if (!ok || suffix <= 0)
+            return false;
+        start = qMax<qint64>(0, fileSize - suffix);
+        end = fileSize;
+    } else {
+        start = first.toLongLong(&ok);
+        if (!ok)
+            return false;
+        end = fileSize;
+        if (!last.isEmpty()) {
+            end = qMin(last.toLongLong(&ok) + 1, fileSize);
+            if (!ok)
+                return false;
+        }
+    }
+    return start >= 0 && start < end;
+}
+
+// Queues the next chunks until MAX_PENDING_BYTES are waiting to be sent,
+// bytesWritten brings us back once the network took some of it
+void HttpWorker::continueTransfer(QTcpSocket *socket)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end() || !it->sending)
+        return;
+    Transfer &transfer = it->transfer;
+
+    while (transfer.offset < transfer.end &&
+           socket->bytesToWrite() < MAX_PENDING_BYTES) {
+        if (!transfer.mapFailed &&
+            (!transfer.map ||
+             transfer.offset >= transfer.mapOffset + transfer.mapSize)) {
+            if (transfer.map)
+                transfer.file->unmap(transfer.map);
+            transfer.mapOffset = transfer.offset;
+            transfer.mapSize =
+                qMin(MAP_WINDOW_SIZE, transfer.end - transfer.offset);
+            transfer.map =
+                transfer.file->map(transfer.mapOffset, transfer.mapSize);
+            // Not every file system can be mapped, read() works anywhere
+            transfer.mapFailed = !transfer.map;
+        }
+
+        qint64 length = qMin(CHUNK_SIZE, transfer.end - transfer.offset);
+        qint64 written = -1;
+        if (transfer.map) {
+            length = qMin(length, transfer.mapOffset + transfer.mapSize -
+                                      transfer.offset);
+            const char *data = reinterpret_cast<const char *>(
+                transfer.map + (transfer.offset - transfer.mapOffset));
+            written = socket->write(data, length);
+        } else if (transfer.file->seek(transfer.offset)) {
+            const QByteArray data = transfer.file->read(length);
+            written = data.isEmpty() ? -1 : socket->write(data);
+        }
+
+        if (written < 0) {
+            qWarning() << "HttpWorker: Failed to send" << transfer.fileName;
+            closeConnection(socket);
+            return;
+        }
+        transfer.offset += written;
+        transfer.queued += written;
+    }
+}
+
+void HttpWorker::onBytesWritten(QTcpSocket *socket)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end())
+        return;
+    it->idle.restart();
+    if (!it->sending)
+        return;
+
+    const Transfer &transfer = it->transfer;
+    if (transfer.offset < transfer.end) {
+        reportProgress(socket, false);
+        if (socket->bytesToWrite() < MAX_PENDING_BYTES / 2)
+            continueTransfer(socket);
+        return;
+    }
+
+    if (socket->bytesToWrite() == 0) {
+        reportProgress(socket, true);
+        finishResponse(socket);
+    }
+}
+
+// Body bytes still in the socket's buffer haven't been sent, the headers
+// go out first so they are never counted
+void HttpWorker::reportProgress(QTcpSocket *socket, bool force)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end() || !it->sending)
+        return;
+
+    Transfer &transfer = it->transfer;
+    if (!force && !transfer.lastProgress.hasExpired(PROGRESS_INTERVAL_MS))
+        return;
+
+    transfer.lastProgress.restart();
+    const qint64 sent =
+        transfer.queued - qMin(transfer.queued, socket->bytesToWrite());
+    emit downloadProgress(transfer.fileName, sent, transfer.bodySize);
+}
+
+// Ends the current response, keep-alive connections go on with the next
+// request, others are closed once the last bytes are out
+void HttpWorker::finishResponse(QTcpSocket *socket)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end())
+        return;
+
+    // Closing the file drops its mapping
+    it->transfer = Transfer();
+    it->sending = false;
+    it->idle.restart();
+
+    if (!it->keepAlive) {
+        socket->disconnectFromHost();
+        return;
+    }
+
+    if (!it->buffer.isEmpty()) {
+        QMetaObject::invokeMethod(
+            this, [this, socket]() { processRequests(socket); },
+            Qt::QueuedConnection);
+    }
+}
+
+void HttpWorker::closeConnection(QTcpSocket *socket)
+{
+    if (!m_connections.remove(socket))
+        return;
+
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+}
+
+void HttpWorker::closeIdleConnections()
+{
+    QList<QTcpSocket *> sockets;
+    for (auto it = m_connections.cbegin(); it != m_connections.cend(); ++it) {
+        if (!it->sending && it->idle.hasExpired(KEEP_ALIVE_TIMEOUT_MS))
+            sockets.append(it.key());
+    }
+    for (QTcpSocket *socket : std::as_const(sockets)) {
+        closeConnection(socket);
+    }
+    if (m_connections.isEmpty())
+        m_idleTimer->stop();
+}
+
+QString HttpWorker::getMimeType(const QString &filePath)
+{
+    QMimeDatabase db;
+    QMimeType type = db.mimeTypeForFile(filePath);
+    return type.name();
+}
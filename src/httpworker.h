@@ -0,0 +1,164 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef HTTPWORKER_H
+#define HTTPWORKER_H
+
+#include "importvariantcache.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <memory>
+
+class HttpUpload;
+
+QT_BEGIN_NAMESPACE
+class QTcpSocket;
+class QTimer;
+QT_END_NAMESPACE
+
+// What an import server serves, built once when it starts and shared
+// read-only by its workers
+struct HttpRoutes {
+    QString manifestPath; // "/<json file name>"
+    QByteArray manifest;
+    QHash<QString, QString> files; // file name -> local path
+    // The variant the manifest points at, requests for others get the
+    // original file
+    ImageVariant variant;
+    QString uploadDir; // empty when uploads are off
+    // Uploads go to /upload/<token>/, others are refused
+    QString uploadToken;
+};
+
+/**
+ * @brief Serves the connections HttpServer hands to it on its own thread
+ *
+ * Requests are parsed incrementally, they may arrive in pieces or several
+ * at once, and connections are kept alive between requests. Files are
+ * streamed in chunks straight out of a memory mapping, with at most a few
+ * MB queued per connection, Range requests let a dropped download resume.
+ * Images requested with the variant the manifest advertises (see
+ * ImageVariant) are served from ImportVariantCache once encoded.
+ *
+ * With an upload directory set, POST or PUT /upload/<token>/<file name>
+ * receives files from the phone, see HttpUpload for the body formats,
+ * limits and resuming. GET /upload/<token>/<file name>?size=N answers
+ * {"offset": <bytes on disk>}. Upload requests without the token are
+ * refused.
+ */
+class HttpWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit HttpWorker(std::shared_ptr<const HttpRoutes> routes,
+                        QObject *parent = nullptr);
+    ~HttpWorker();
+
+    // Takes over an accepted connection, must run on the worker's thread
+    void addConnection(qintptr socketDescriptor);
+    // Must run on the worker's thread
+    void setRoutes(std::shared_ptr<const HttpRoutes> routes);
+
+signals:
+    // Bytes of the response body actually handed to the network
+    void downloadProgress(const QString &fileName, qint64 bytesDownloaded,
+                          qint64 totalBytes);
+    // Body bytes received, totalBytes is -1 for chunked uploads
+    void uploadProgress(const QString &fileName, qint64 bytesReceived,
+                        qint64 totalBytes);
+    void uploadFinished(const QString &fileName, const QString &filePath,
+                        const QString &sha256);
+
+private:
+    struct HttpRequest {
+        QString method;
+        QString path;
+        QString httpVersion;
+        QMap<QString, QString> headers; // lower case names
+    };
+
+    // A file being sent
+    struct Transfer {
+        std::shared_ptr<QFile> file;
+        QString fileName;
+        qint64 offset = 0; // next byte to queue
+        qint64 end = 0;    // one past the last byte to send
+        qint64 bodySize = 0;
+        qint64 queued = 0; // body bytes written to the socket
+        // Mapped window of the file, null when mapping isn't supported
+        uchar *map = nullptr;
+        qint64 mapOffset = 0;
+        qint64 mapSize = 0;
+        bool mapFailed = false;
+        QElapsedTimer lastProgress;
+    };
+
+    struct Connection {
+        QByteArray buffer; // received bytes not parsed yet
+        bool keepAlive = false;
+        // A transfer is in flight or its variant is being encoded
+        bool sending = false;
+        Transfer transfer;
+        // Request body being received, takes the buffer before parsing
+        std::shared_ptr<HttpUpload> upload;
+        // A resumed upload is hashing its part file, the body is left in
+        // the socket
+        bool hashing = false;
+        QElapsedTimer lastUploadProgress;
+        QElapsedTimer idle;
+    };
+
+    void onReadyRead(QTcpSocket *socket);
+    void processRequests(QTcpSocket *socket);
+    static HttpRequest parseRequest(const QByteArray &header);
+    void handleRequest(QTcpSocket *socket, const HttpRequest &request);
+    void sendResponse(QTcpSocket *socket, int statusCode,
+                      const QString &contentType, const QByteArray &data,
+                      bool headOnly = false);
+    void sendFile(QTcpSocket *socket, const QString &filePath,
+                  const HttpRequest &request, const QString &fileName);
+    void sendVariant(QTcpSocket *socket, const QString &filePath,
+                     const HttpRequest &request);
+    void startUpload(QTcpSocket *socket, const HttpRequest &request,
+                     const QString &fileName);
+    void acceptUpload(QTcpSocket *socket,
+                      const std::shared_ptr<HttpUpload> &upload,
+                      bool expectContinue);
+    void receiveUpload(QTcpSocket *socket);
+    void continueTransfer(QTcpSocket *socket);
+    void onBytesWritten(QTcpSocket *socket);
+    void reportProgress(QTcpSocket *socket, bool force);
+    void finishResponse(QTcpSocket *socket);
+    void closeConnection(QTcpSocket *socket);
+    void closeIdleConnections();
+    static bool parseRange(const QString &rangeHeader, qint64 fileSize,
+                           qint64 &start, qint64 &end);
+    static QString getMimeType(const QString &filePath);
+
+    std::shared_ptr<const HttpRoutes> m_routes;
+    QHash<QTcpSocket *, Connection> m_connections;
+    QTimer *m_idleTimer;
+};
+
+#endif // HTTPWORKER_H
@@ -438,6 +438,14 @@ struct NetworkDevice {
 };
 
 QPixmap load_heic(const QByteArray &data);
+// Decodes off the GUI thread, when maxSize is valid the result fits into it
+// and is decoded from the embedded HEIF thumbnail if that is large enough
+QImage load_heic_image(const QByteArray &data, const QSize &maxSize = QSize());
+
+// Area-average downscale, a faster replacement for
+// QImage::scaled(..., Qt::SmoothTransformation) when shrinking large images
+QImage downscale_image(const QImage &image, const QSize &size,
+                       Qt::AspectRatioMode mode = Qt::KeepAspectRatio);
 
 QByteArray read_afc_file_to_byte_array(afc_client_t afcClient,
                                        const char *path);
@@ -0,0 +1,70 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "imagepyramid.h"
+#include "iDescriptor.h"
+
+// Levels stop once the longest side fits into this many tiles
+constexpr int MIN_LEVEL_TILES = 2;
+
+ImagePyramid::ImagePyramid(const QImage &image)
+{
+    if (image.isNull())
+        return;
+
+    // Formats QPixmap::fromImage() can take without converting every tile
+    QImage level = image.convertToFormat(
+        image.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied
+                                : QImage::Format_RGB32);
+    m_levels.append(level);
+
+    const int minSide = TileSize * MIN_LEVEL_TILES;
+    while (qMax(level.width(), level.height()) > minSide) {
+        const QSize half(qMax(1, level.width() / 2),
+                         qMax(1, level.height() / 2));
+        level = downscale_image(level, half, Qt::IgnoreAspectRatio);
+        if (level.isNull())
+            break;
+        m_levels.append(level);
+    }
+}
+
+QSize ImagePyramid::size() const
+{
+    return isNull() ? QSize() : m_levels.first().size();
+}
+
+int ImagePyramid::levelForScale(qreal scale) const
+{
+    const qreal fullWidth = size().width();
+    int index = 0;
+    while (index + 1 < m_levels.size() &&
+           m_levels.at(index + 1).width() >= scale * fullWidth) {
+        ++index;
+    }
+    return index;
+}
+
+qint64 ImagePyramid::sizeInBytes() const
+{
+    qint64 bytes = 0;
+    for (const QImage &level : m_levels)
+        bytes += level.sizeInBytes();
+    return bytes;
+}
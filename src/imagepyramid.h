@@ -0,0 +1,56 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <QImage>
+#include <QList>
+#include <QSize>
+
+/**
+ * @brief Multi-resolution copy of a decoded photo for deep zoom
+ *
+ * Level 0 is the full image, every further level halves both sides until
+ * the image fits into a few tiles. Painting a 48 MP photo zoomed out then
+ * reads a level close to the screen resolution instead of resampling all
+ * of the original. Building it is CPU heavy, construct it on a worker
+ * thread, it is immutable afterwards.
+ */
+class ImagePyramid
+{
+public:
+    static constexpr int TileSize = 256;
+
+    explicit ImagePyramid(const QImage &image);
+
+    bool isNull() const { return m_levels.isEmpty(); }
+    QSize size() const;
+    int levelCount() const { return m_levels.size(); }
+    const QImage &level(int index) const { return m_levels.at(index); }
+
+    // Smallest level that still has at least scale * size() pixels
+    int levelForScale(qreal scale) const;
+    qint64 sizeInBytes() const;
+
+private:
+    QList<QImage> m_levels;
+};
+
+#endif // IMAGEPYRAMID_H
@@ -0,0 +1,472 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "importvariantcache.h"
+#include "iDescriptor.h"
+#include "isobmff.h"
+#include "settingsmanager.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QBuffer>
+#include <QImageWriter>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QSaveFile>
+#include <QUrlQuery>
+#include <QtConcurrent/QtConcurrent>
+
+namespace
+{
+using IsoBmff::readU16;
+using IsoBmff::readU32;
+
+// Oldest variants are removed beyond this when the cache is opened
+constexpr qint64 VARIANT_CACHE_LIMIT = 1024 * 1024 * 1024;
+// Finished futures kept before they are dropped, a request for a dropped
+// one stats the cache again
+constexpr int MAX_MEMOIZED_VARIANTS = 4096;
+// The metadata is before the image data, a JPEG has a handful of segments
+// before its scan
+constexpr int MAX_JPEG_SEGMENTS = 32;
+// An APP1 segment's length field counts itself
+constexpr qint64 MAX_APP1_PAYLOAD = 0xFFFF - 2;
+// Non-JPEG, non-PNG sources are only searched this far for metadata
+constexpr qint64 METADATA_SCAN_SIZE = 256 * 1024;
+constexpr quint16 EXIF_ORIENTATION = 0x0112;
+
+const QByteArray EXIF_HEADER("Exif\0\0", 6);
+const QByteArray XMP_HEADER("http://ns.adobe.com/xap/1.0/\0", 29);
+const QByteArray PNG_SIGNATURE("\x89PNG\r\n\x1a\n", 8);
+
+/*
+ * The variant's pixels are rotated upright while decoding, a copied
+ * Orientation would rotate them a second time. Only IFD0 holds it.
+ */
+void resetExifOrientation(QByteArray &exif)
+{
+    const qint64 tiff = EXIF_HEADER.size();
+    const qint64 size = exif.size();
+    auto *data = reinterpret_cast<uchar *>(exif.data());
+    if (size < tiff + 8)
+        return;
+
+    const bool littleEndian = data[tiff] == 'I' && data[tiff + 1] == 'I';
+    if (!littleEndian && !(data[tiff] == 'M' && data[tiff + 1] == 'M'))
+        return;
+    auto u16 = [&](qint64 offset) {
+        const uchar *p = data + offset;
+        return littleEndian ? quint16(p[0] | (p[1] << 8)) : readU16(p);
+    };
+    auto u32 = [&](qint64 offset) {
+        const uchar *p = data + offset;
+        return littleEndian ? quint32(p[0]) | (quint32(p[1]) << 8) |
+                                  (quint32(p[2]) << 16) |
+                                  (quint32(p[3]) << 24)
+                            : readU32(p);
+    };
+
+    const qint64 ifd = tiff + u32(tiff + 4);
+    if (ifd + 2 > size)
+        return;
+    const quint16 count = u16(ifd);
+    for (quint16 i = 0; i < count; ++i) {
+        const qint64 entry = ifd + 2 + i * 12;
+        if (entry + 12 > size)
+            return;
+        // SHORT, stored in the first two bytes of the value
+        if (u16(entry) == EXIF_ORIENTATION && u16(entry + 2) == 3) {
+            data[entry + 8] = littleEndian ? 1 : 0;
+            data[entry + 9] = littleEndian ? 0 : 1;
+            return;
+        }
+    }
+}
+
+// tiff:Orientation="6" or <tiff:Orientation>6</tiff:Orientation>, the
+// value keeps its length so the segment does too
+void resetXmpOrientation(QByteArray &xmp)
+{
+    static const QByteArray property("tiff:Orientation");
+    qsizetype pos = 0;
+    while ((pos = xmp.indexOf(property, pos)) >= 0) {
+        pos += property.size();
+        qsizetype digit = -1;
+        if (xmp.mid(pos, 2) == "=\"" || xmp.mid(pos, 2) == "='")
+            digit = pos + 2;
+        else if (xmp.mid(pos, 1) == ">")
+            digit = pos + 1;
+        if (digit >= 0 && digit < xmp.size() && xmp.at(digit) >= '1' &&
+            xmp.at(digit) <= '8') {
+            xmp[digit] = '1';
+        }
+    }
+}
+
+// APP1 segment with the orientation reset, empty when it doesn't fit
+QByteArray app1Segment(QByteArray payload)
+{
+    if (payload.size() > MAX_APP1_PAYLOAD)
+        return QByteArray();
+    if (payload.startsWith(EXIF_HEADER))
+        resetExifOrientation(payload);
+    else
+        resetXmpOrientation(payload);
+
+    const qint64 length = payload.size() + 2;
+    QByteArray segment("\xFF\xE1", 2);
+    segment += char(length >> 8);
+    segment += char(length & 0xFF);
+    return segment + payload;
+}
+
+// The EXIF and XMP APP1 segments of a JPEG
+bool readJpegMetadata(QFile &file, QByteArray &segments)
+{
+    if (file.read(2) != QByteArray("\xFF\xD8", 2))
+        return false;
+
+    for (int i = 0; i < MAX_JPEG_SEGMENTS; ++i) {
+        const QByteArray marker = file.read(4);
+        if (marker.size() < 4 || uchar(marker.at(0)) != 0xFF)
+            break;
+        const uchar type = uchar(marker.at(1));
+        // Start of scan or end of image, the metadata is always before
+        if (type == 0xDA || type == 0xD9)
+            break;
+        const qint64 length = (uchar(marker.at(2)) << 8) | uchar(marker.at(3));
+        if (length < 2)
+            break;
+
+        if (type != 0xE1) {
+            if (!file.seek(file.pos() + length - 2))
+                break;
+            continue;
+        }
+        const QByteArray payload = file.read(length - 2);
+        if (payload.size() != length - 2)
+            break;
+        if (payload.startsWith(EXIF_HEADER) || payload.startsWith(XMP_HEADER))
+            segments += app1Segment(payload);
+    }
+    return true;
+}
+
+/*
+ * A PNG keeps EXIF in an eXIf chunk, without the JPEG header, and XMP in
+ * an iTXt chunk named "XML:com.adobe.xmp". Fails for metadata that can't
+ * go into an APP1 segment, compressed or too large.
+ */
+bool readPngMetadata(QFile &file, QByteArray &segments)
+{
+    if (file.read(PNG_SIGNATURE.size()) != PNG_SIGNATURE)
+        return false;
+
+    static const QByteArray xmpKeyword("XML:com.adobe.xmp\0", 18);
+    while (true) {
+        const QByteArray header = file.read(8);
+        if (header.size() < 8)
+            return true;
+        const auto *p = reinterpret_cast<const uchar *>(header.constData());
+        const qint64 length = readU32(p);
+        const QByteArray type = header.mid(4);
+        if (type == "IEND")
+            return true;
+
+        if (type != "eXIf" && type != "iTXt") {
+            // Chunk data and CRC
+            if (!file.seek(file.pos() + length + 4))
+                return true;
+            continue;
+        }
+        if (length > MAX_APP1_PAYLOAD)
+            return false;
+        const QByteArray data = file.read(length);
+        file.read(4);
+        if (data.size() != length)
+            return true;
+
+        if (type == "eXIf") {
+            segments += app1Segment(EXIF_HEADER + data);
+        } else if (data.startsWith(xmpKeyword)) {
+            // Compression flag and method, language and translated keyword
+            qsizetype text = xmpKeyword.size();
+            if (text + 2 > data.size() || data.at(text) != 0)
+                return false;
+            text = data.indexOf('\0', text + 2);
+            text = text < 0 ? -1 : data.indexOf('\0', text + 1);
+            if (text < 0)
+                return false;
+            const QByteArray segment =
+                app1Segment(XMP_HEADER + data.mid(text + 1));
+            if (segment.isEmpty())
+                return false;
+            segments += segment;
+        }
+    }
+}
+
+/*
+ * Metadata of the source as APP1 segments for a JPEG variant, EXIF (capture
+ * date, location) and XMP. False when the source has metadata a variant
+ * would lose, only JPEG and PNG are read, other formats are searched for
+ * the usual markers.
+ */
+bool readMetadata(const QString &filePath, const QByteArray &format,
+                  QByteArray &segments)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    if (format == "jpeg")
+        return readJpegMetadata(file, segments);
+    if (format == "png")
+        return readPngMetadata(file, segments);
+    // TIFF stores its EXIF as tags of its own IFDs
+    if (format == "tiff")
+        return false;
+
+    const QByteArray head = file.read(METADATA_SCAN_SIZE);
+    return !head.contains(EXIF_HEADER) && !head.contains("EXIF") &&
+           !head.contains("eXIf") && !head.contains("x:xmpmeta");
+}
+
+// Segments go after SOI and the JFIF APP0 the JPEG writer starts with
+QByteArray insertJpegMetadata(const QByteArray &jpeg,
+                              const QByteArray &segments)
+{
+    qsizetype pos = 2;
+    if (jpeg.size() > 6 && uchar(jpeg.at(2)) == 0xFF &&
+        uchar(jpeg.at(3)) == 0xE0) {
+        pos += 2 + ((uchar(jpeg.at(4)) << 8) | uchar(jpeg.at(5)));
+    }
+    if (jpeg.size() < pos)
+        return jpeg;
+    return jpeg.left(pos) + segments + jpeg.mid(pos);
+}
+} // namespace
+
+ImageVariant ImageVariant::fromQuery(const QUrlQuery &query)
+{
+    ImageVariant variant;
+    bool ok = false;
+    const int maxEdge = query.queryItemValue("maxEdge").toInt(&ok);
+    if (ok && maxEdge > 0)
+        variant.maxEdge = maxEdge;
+    const int quality = query.queryItemValue("quality").toInt(&ok);
+    if (ok)
+        variant.quality = qBound(1, quality, 100);
+    variant.toJpeg =
+        query.queryItemValue("format").compare("jpeg", Qt::CaseInsensitive) ==
+        0;
+    return variant;
+}
+
+QString ImageVariant::toQuery() const
+{
+    QUrlQuery query;
+    if (maxEdge > 0)
+        query.addQueryItem("maxEdge", QString::number(maxEdge));
+    if (quality >= 0)
+        query.addQueryItem("quality", QString::number(quality));
+    if (toJpeg)
+        query.addQueryItem("format", "jpeg");
+    return query.toString();
+}
+
+ImportVariantCache *ImportVariantCache::sharedInstance()
+{
+    static ImportVariantCache instance;
+    return &instance;
+}
+
+ImportVariantCache::ImportVariantCache()
+{
+    m_dir = SettingsManager::cachePath() + "/import-variants";
+    QDir().mkpath(m_dir);
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+    evict();
+}
+
+// Newest first, a cache hit touches its file
+void ImportVariantCache::evict()
+{
+    const QFileInfoList files =
+        QDir(m_dir).entryInfoList(QDir::Files, QDir::Time);
+    m_bytes = 0;
+    for (const QFileInfo &info : files) {
+        if (m_bytes + info.size() > VARIANT_CACHE_LIMIT &&
+            QFile::remove(info.filePath())) {
+            m_variants.remove(info.filePath());
+            continue;
+        }
+        m_bytes += info.size();
+    }
+}
+
+bool ImportVariantCache::store(const QString &targetPath,
+                               const QByteArray &data)
+{
+    QSaveFile file(targetPath);
+    if (!file.open(QIODevice::WriteOnly) ||
+        file.write(data) != data.size() || !file.commit()) {
+        qWarning() << "ImportVariantCache: could not write" << targetPath
+                   << file.errorString();
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_bytes += data.size();
+    if (m_bytes > VARIANT_CACHE_LIMIT)
+        evict();
+    return true;
+}
+
+bool ImportVariantCache::canTranscode(const QString &filePath)
+{
+    const QByteArray format = QImageReader::imageFormat(filePath);
+    return !format.isEmpty() &&
+           QImageWriter::supportedImageFormats().contains(format);
+}
+
+QFuture<QString> ImportVariantCache::variant(const QString &filePath,
+                                             const ImageVariant &variant)
+{
+    // A changed source gets a new variant, the old one ages out
+    const QFileInfo info(filePath);
+    const qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+    const QString key = filePath + ':' + QString::number(info.size()) + ':' +
+                        QString::number(mtime) + ':' + variant.toQuery();
+    const QString baseName = QString::fromLatin1(
+        QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1)
+            .toHex());
+
+    QByteArray format = QImageReader::imageFormat(filePath);
+    if (variant.toJpeg)
+        format = "jpeg";
+    const QString targetPath =
+        m_dir + '/' + baseName + '.' + QString::fromLatin1(format);
+
+    QMutexLocker locker(&m_mutex);
+    auto it = m_variants.constFind(targetPath);
+    if (it != m_variants.cend())
+        return *it;
+    if (m_variants.size() >= MAX_MEMOIZED_VARIANTS) {
+        m_variants.removeIf(
+            [](QHash<QString, QFuture<QString>>::iterator entry) {
+                return entry->isFinished();
+            });
+    }
+
+    QFuture<QString> future;
+    const QFileInfo target(targetPath);
+    if (target.exists()) {
+        // Keeps it from being evicted first
+        QFile touched(targetPath);
+        if (touched.open(QIODevice::Append)) {
+            touched.setFileTime(QDateTime::currentDateTime(),
+                                QFileDevice::FileModificationTime);
+        }
+        future = QtFuture::makeReadyFuture(target.size() > 0 ? targetPath
+                                                             : filePath);
+    } else {
+        future = QtConcurrent::run(
+            &m_pool, [this, filePath, variant, targetPath]() {
+                return transcode(filePath, variant, targetPath);
+            });
+    }
+    m_variants.insert(targetPath, future);
+    return future;
+}
+
+QString ImportVariantCache::transcode(const QString &filePath,
+                                      const ImageVariant &variant,
+                                      const QString &targetPath)
+{
+    QImageReader reader(filePath);
+    reader.setAutoTransform(true);
+    const QByteArray sourceFormat = reader.format();
+    const QByteArray format = variant.toJpeg ? "jpeg" : sourceFormat;
+
+    // The phone would import the variant without its capture date and
+    // location otherwise
+    QByteArray metadata;
+    if (!readMetadata(filePath, sourceFormat, metadata) ||
+        (format != "jpeg" && !metadata.isEmpty())) {
+        store(targetPath, QByteArray());
+        return filePath;
+    }
+
+    // For JPEG this scales in the DCT domain while decoding, a 40 MP photo
+    // is never decoded at full size
+    const QSize originalSize = reader.size();
+    const QSize bound(variant.maxEdge, variant.maxEdge);
+    if (variant.maxEdge > 0 && originalSize.isValid() &&
+        qMax(originalSize.width(), originalSize.height()) > variant.maxEdge) {
+        reader.setScaledSize(originalSize.scaled(bound, Qt::KeepAspectRatio));
+    }
+
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qWarning() << "ImportVariantCache: could not decode" << filePath
+                   << reader.errorString();
+        return filePath;
+    }
+    // Formats without scaled decoding
+    if (variant.maxEdge > 0 &&
+        qMax(image.width(), image.height()) > variant.maxEdge) {
+        image = downscale_image(image, bound);
+    }
+
+    if (format == "jpeg" && image.hasAlphaChannel()) {
+        // JPEG has no alpha, transparent screenshot corners become white
+        QImage flattened(image.size(), QImage::Format_RGB32);
+        flattened.fill(Qt::white);
+        QPainter painter(&flattened);
+        painter.drawImage(0, 0, image);
+        painter.end();
+        image = flattened;
+    }
+
+    // The variant is encoded in memory, the metadata goes in before the
+    // image data
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter writer(&buffer, format);
+    if (format == "jpeg")
+        writer.setQuality(variant.quality);
+    if (!writer.write(image)) {
+        qWarning() << "ImportVariantCache: could not encode" << filePath
+                   << writer.errorString();
+        return filePath;
+    }
+    QByteArray encoded = buffer.data();
+    if (format == "jpeg")
+        encoded = insertJpegMetadata(encoded, metadata);
+
+    // Re-encoding an already small JPEG can make it bigger
+    if (encoded.size() >= QFileInfo(filePath).size()) {
+        store(targetPath, QByteArray());
+        return filePath;
+    }
+    return store(targetPath, encoded) ? targetPath : filePath;
+}
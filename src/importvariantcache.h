@@ -0,0 +1,96 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IMPORTVARIANTCACHE_H
+#define IMPORTVARIANTCACHE_H
+
+#include <QFuture>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QThreadPool>
+
+QT_BEGIN_NAMESPACE
+class QUrlQuery;
+QT_END_NAMESPACE
+
+// Smaller copy of an image for a wireless import, e.g. a 40 MP JPEG cut
+// down to what a phone shows or a PNG screenshot as a JPEG
+struct ImageVariant {
+    int maxEdge = 0;     // longest side in pixels, 0 keeps the size
+    int quality = -1;    // JPEG quality 1-100, -1 for the encoder default
+    bool toJpeg = false; // re-encode other formats as JPEG
+
+    bool isNull() const { return maxEdge <= 0 && quality < 0 && !toJpeg; }
+    bool operator==(const ImageVariant &other) const = default;
+
+    // "maxEdge=2048&quality=85&format=jpeg", every key is optional
+    static ImageVariant fromQuery(const QUrlQuery &query);
+    QString toQuery() const;
+};
+
+/**
+ * @brief Produces and caches image variants for HttpServer
+ *
+ * Variants are encoded on a pool of their own, one thread per core, and
+ * kept on disk keyed by the source file's path, size and modification
+ * time, so serving the same import twice only encodes once. Requests for
+ * a variant that is already being encoded share its future. Variants that
+ * wouldn't be smaller are recorded as empty files, the least recently
+ * used ones are removed whenever the cache grows past its limit.
+ *
+ * JPEG variants keep the source's EXIF and XMP, other sources carrying
+ * metadata we can't copy are served as they are.
+ */
+class ImportVariantCache
+{
+public:
+    static ImportVariantCache *sharedInstance();
+
+    // Whether the file is an image we can decode and re-encode
+    static bool canTranscode(const QString &filePath);
+
+    /**
+     * @brief Get the file to serve for a variant of an image
+     * @return Future of the cached variant's path, or of the source path
+     * when encoding failed or the variant wouldn't be smaller
+     */
+    QFuture<QString> variant(const QString &filePath,
+                             const ImageVariant &variant);
+
+private:
+    ImportVariantCache();
+    // Called with m_mutex held, or before the cache is shared
+    void evict();
+    QString transcode(const QString &filePath, const ImageVariant &variant,
+                      const QString &targetPath);
+    // Empty data records that the source is served as it is
+    bool store(const QString &targetPath, const QByteArray &data);
+
+    QString m_dir;
+    qint64 m_bytes = 0; // on disk, kept up to date by store()
+    QThreadPool m_pool;
+    // Futures by target path, also the finished ones so a second request
+    // doesn't stat the cache again. Finished ones are dropped once there
+    // are too many.
+    QHash<QString, QFuture<QString>> m_variants;
+    QMutex m_mutex;
+};
+
+#endif // IMPORTVARIANTCACHE_H
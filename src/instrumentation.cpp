@@ -0,0 +1,69 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "instrumentation.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QMutexLocker>
+
+// Never destroyed, providers are removed from the destructors of other
+// singletons which may run after a function local static would be gone
+Instrumentation *Instrumentation::sharedInstance()
+{
+    static Instrumentation *self = new Instrumentation();
+    return self;
+}
+
+int Instrumentation::addProvider(const QString &name, Provider provider)
+{
+    QMutexLocker locker(&m_mutex);
+    const int id = m_nextId++;
+    m_sections.insert(id, Section{name, std::move(provider)});
+    return id;
+}
+
+void Instrumentation::removeProvider(int id)
+{
+    QMutexLocker locker(&m_mutex);
+    m_sections.remove(id);
+}
+
+QString Instrumentation::dump()
+{
+    QMutexLocker locker(&m_mutex);
+    QString report =
+        QString("iDescriptor instrumentation, %1\n")
+            .arg(QDateTime::currentDateTime().toString(Qt::ISODate));
+    for (const Section &section : std::as_const(m_sections)) {
+        report += QString("\n[%1]\n").arg(section.name);
+        const QString text = section.provider();
+        report += text.isEmpty() ? QString("(nothing recorded)\n") : text;
+        if (!report.endsWith('\n'))
+            report += '\n';
+    }
+    return report;
+}
+
+void Instrumentation::dumpToLog()
+{
+    const QStringList lines = dump().split('\n');
+    for (const QString &line : lines) {
+        qDebug().noquote() << line;
+    }
+}
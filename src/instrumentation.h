@@ -0,0 +1,67 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <QMap>
+#include <QMutex>
+#include <QString>
+#include <functional>
+
+/**
+ * @brief Registry of diagnostic sections for the instrumentation dump
+ *
+ * Components that keep runtime statistics (stream metrics, cache hit
+ * rates, ...) add a provider that formats them. dump() collects every
+ * section into one report, e.g. to attach to a bug report.
+ *
+ * Providers may be called from any thread and must lock their own data.
+ * removeProvider() waits for a dump in progress, so a provider can be
+ * removed right before the data it reads goes away.
+ */
+class Instrumentation
+{
+public:
+    using Provider = std::function<QString()>;
+
+    static Instrumentation *sharedInstance();
+
+    // Returns an id for removeProvider()
+    int addProvider(const QString &name, Provider provider);
+    void removeProvider(int id);
+
+    QString dump();
+    // Writes dump() to the debug log
+    void dumpToLog();
+
+private:
+    Instrumentation() = default;
+
+    struct Section {
+        QString name;
+        Provider provider;
+    };
+
+    QMap<int, Section> m_sections; // in order of registration
+    int m_nextId = 0;
+    QMutex m_mutex;
+};
+
+#endif // INSTRUMENTATION_H
@@ -0,0 +1,127 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "isobmff.h"
+#include "devicefile.h"
+#include <QByteArray>
+
+namespace IsoBmff
+{
+bool parseBox(const uchar *data, qint64 offset, qint64 end, Box &box)
+{
+    if (end - offset < 8)
+        return false;
+
+    qint64 size = readU32(data + offset);
+    box.type = readU32(data + offset + 4);
+    box.headerSize = 8;
+    if (size == 1) {
+        if (end - offset < 16)
+            return false;
+        size = qint64(readU64(data + offset + 8));
+        box.headerSize = 16;
+    } else if (size == 0) {
+        size = end - offset;
+    }
+
+    if (size < box.headerSize || size > end - offset)
+        return false;
+
+    box.offset = offset;
+    box.size = size;
+    return true;
+}
+
+bool findChild(const uchar *data, const Box &parent, quint32 type, Box &child)
+{
+    qint64 pos = parent.bodyOffset();
+    while (pos < parent.end()) {
+        Box box;
+        if (!parseBox(data, pos, parent.end(), box))
+            return false;
+        if (box.type == type) {
+            child = box;
+            return true;
+        }
+        pos = box.end();
+    }
+    return false;
+}
+
+namespace
+{
+bool readBoxHeader(DeviceFile &file, qint64 fileSize, qint64 pos, Box &box)
+{
+    const QByteArray header = file.read(pos, qMin<qint64>(16, fileSize - pos));
+    const uchar *p = reinterpret_cast<const uchar *>(header.constData());
+    if (header.size() < 8)
+        return false;
+
+    qint64 boxSize = readU32(p);
+    box.type = readU32(p + 4);
+    box.headerSize = 8;
+    if (boxSize == 1) {
+        if (header.size() < 16)
+            return false;
+        boxSize = qint64(readU64(p + 8));
+        box.headerSize = 16;
+    } else if (boxSize == 0) {
+        boxSize = fileSize - pos;
+    }
+    if (boxSize < box.headerSize || boxSize > fileSize - pos)
+        return false;
+
+    box.offset = pos;
+    box.size = boxSize;
+    return true;
+}
+} // namespace
+
+bool locateTopLevelBox(DeviceFile &file, qint64 fileSize, quint32 type,
+                       qint64 &offset, qint64 &size)
+{
+    qint64 pos = 0;
+    while (pos + 8 <= fileSize) {
+        Box box;
+        if (!readBoxHeader(file, fileSize, pos, box))
+            return false;
+
+        if (box.type == type) {
+            offset = pos;
+            size = box.size;
+            return true;
+        }
+        pos = box.end();
+    }
+    return false;
+}
+
+bool readTopLevelBoxes(DeviceFile &file, qint64 fileSize, QList<Box> &boxes)
+{
+    qint64 pos = 0;
+    while (pos + 8 <= fileSize) {
+        Box box;
+        if (!readBoxHeader(file, fileSize, pos, box))
+            return false;
+        boxes.append(box);
+        pos = box.end();
+    }
+    return true;
+}
+} // namespace IsoBmff
@@ -0,0 +1,80 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ISOBMFF_H
+#define ISOBMFF_H
+
+#include <QList>
+#include <QtGlobal>
+
+class DeviceFile;
+
+/*
+    ISO BMFF / QuickTime box parsing shared by the MOV/MP4/HEIC parsers,
+    just enough to walk box trees that have been read into memory and to
+    find top-level boxes on the device without reading the media data.
+    All values are big endian.
+*/
+namespace IsoBmff
+{
+constexpr quint32 fourcc(const char (&s)[5])
+{
+    return (quint32(uchar(s[0])) << 24) | (quint32(uchar(s[1])) << 16) |
+           (quint32(uchar(s[2])) << 8) | quint32(uchar(s[3]));
+}
+
+inline quint16 readU16(const uchar *p) { return quint16((p[0] << 8) | p[1]); }
+
+inline quint32 readU32(const uchar *p)
+{
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) |
+           (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+inline quint64 readU64(const uchar *p)
+{
+    return (quint64(readU32(p)) << 32) | readU32(p + 4);
+}
+
+struct Box {
+    quint32 type = 0;
+    qint64 offset = 0;
+    qint64 size = 0;
+    qint64 headerSize = 0;
+
+    qint64 bodyOffset() const { return offset + headerSize; }
+    qint64 bodySize() const { return size - headerSize; }
+    qint64 end() const { return offset + size; }
+};
+
+// Parses the box at offset, which has to end before end
+bool parseBox(const uchar *data, qint64 offset, qint64 end, Box &box);
+
+bool findChild(const uchar *data, const Box &parent, quint32 type, Box &child);
+
+// Walks the top-level box headers of a file on the device, one small read
+// per box, until a box of the given type is found
+bool locateTopLevelBox(DeviceFile &file, qint64 fileSize, quint32 type,
+                       qint64 &offset, qint64 &size);
+
+// Same walk over the whole file, false if a header is broken
+bool readTopLevelBoxes(DeviceFile &file, qint64 fileSize, QList<Box> &boxes);
+} // namespace IsoBmff
+
+#endif // ISOBMFF_H
@@ -231,10 +231,8 @@ void LiveScreenWidget::updateScreenshot()
         TakeScreenshotResult result = take_screenshot(m_shotrClient);
 
         if (result.success && !result.img.isNull()) {
-            QPixmap pixmap = QPixmap::fromImage(result.img);
-            m_imageLabel->setPixmap(pixmap.scaled(m_imageLabel->size(),
-                                                  Qt::KeepAspectRatio,
-                                                  Qt::SmoothTransformation));
+            m_imageLabel->setPixmap(QPixmap::fromImage(
+                downscale_image(result.img, m_imageLabel->size())));
         } else {
             qWarning() << "Failed to capture screenshot";
         }
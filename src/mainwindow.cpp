@@ -41,12 +41,14 @@
 #include <unistd.h>
 
 #include "appcontext.h"
+#include "instrumentation.h"
 #include "settingsmanager.h"
 #include <QApplication>
 #include <QDesktopServices>
 #include <QMenu>
 #include <QMenuBar>
 #include <QMessageBox>
+#include <QShortcut>
 
 #ifdef WIN32
 #include "platform/windows/check_deps.h"
@@ -346,6 +348,14 @@ MainWindow::MainWindow(QWidget *parent)
 
 void MainWindow::createMenus()
 {
+    // Not in a menu, meant for bug reports
+    auto *dumpShortcut =
+        new QShortcut(QKeySequence("Ctrl+Shift+Alt+I"), this);
+    dumpShortcut->setContext(Qt::ApplicationShortcut);
+    connect(dumpShortcut, &QShortcut::activated, this, []() {
+        Instrumentation::sharedInstance()->dumpToLog();
+    });
+
 #ifdef Q_OS_MAC
     QMenu *actionsMenu = menuBar()->addMenu("&Actions");
 
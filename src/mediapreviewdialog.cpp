@@ -20,6 +20,9 @@
 #include "mediapreviewdialog.h"
 #include "mediastreamermanager.h"
 #include "photomodel.h"
+#include "previewimageloader.h"
+#include "thumbnailcache.h"
+#include "tiledimageitem.h"
 #include <QApplication>
 #include <QAudioOutput>
 #include <QCoreApplication>
@@ -36,6 +39,7 @@
 #include <QPushButton>
 #include <QResizeEvent>
 #include <QScreen>
+#include <QShortcut>
 #include <QSlider>
 #include <QTimer>
 #include <QVBoxLayout>
@@ -46,24 +50,54 @@
 #include "appcontext.h"
 #include "iDescriptor-ui.h"
 
-
+// Everything the image preview keeps in memory: the tile pixmaps of the
+// photo on screen and the decoded pyramids of it and its neighbours. The
+// rest after the tiles holds a 48 MP photo (about 256 MB with its pyramid)
+// or five 12 MP ones.
+constexpr qint64 PREVIEW_MEMORY_BUDGET = 384LL * 1024 * 1024;
+// Only one tiled item exists at a time, about two 4K screens of tiles
+constexpr qint64 PREVIEW_TILE_CACHE = 64LL * 1024 * 1024;
 
 MediaPreviewDialog::MediaPreviewDialog(iDescriptorDevice *device,
                                        afc_client_t afcClient,
                                        const QString &filePath, QWidget *parent)
-    : QDialog(parent), m_device(device), m_filePath(filePath),
-      m_isVideo(isVideoFile(filePath)), m_mainLayout(nullptr),
-      m_controlsLayout(nullptr), m_imageView(nullptr), m_imageScene(nullptr),
-      m_pixmapItem(nullptr), m_videoWidget(nullptr), m_mediaPlayer(nullptr),
+    : MediaPreviewDialog(device, afcClient, QStringList{filePath}, 0, parent)
+{
+}
+
+MediaPreviewDialog::MediaPreviewDialog(iDescriptorDevice *device,
+                                       afc_client_t afcClient,
+                                       const QStringList &filePaths,
+                                       int currentIndex, QWidget *parent)
+    : QDialog(parent), m_device(device),
+      m_filePath(filePaths.value(currentIndex)),
+      m_isVideo(isVideoFile(m_filePath)), m_currentIndex(0), m_lastStep(1),
+      m_mainLayout(nullptr), m_controlsLayout(nullptr), m_imageView(nullptr),
+      m_imageScene(nullptr), m_pixmapItem(nullptr), m_tiledItem(nullptr),
+      m_imageLoader(nullptr),
+      m_videoWidget(nullptr), m_mediaPlayer(nullptr),
       m_videoControlsLayout(nullptr), m_playPauseBtn(nullptr),
       m_stopBtn(nullptr), m_repeatBtn(nullptr), m_timelineSlider(nullptr),
       m_timeLabel(nullptr), m_volumeSlider(nullptr), m_volumeLabel(nullptr),
-      m_progressTimer(nullptr), m_loadingLabel(nullptr), m_statusLabel(nullptr),
+      m_progressTimer(nullptr), m_debugOverlay(nullptr),
+      m_debugOverlayTimer(nullptr), m_loadingLabel(nullptr),
+      m_statusLabel(nullptr),
       m_zoomInBtn(nullptr), m_zoomOutBtn(nullptr), m_zoomResetBtn(nullptr),
-      m_fitToWindowBtn(nullptr), m_zoomFactor(1.0), m_isRepeatEnabled(true),
+      m_fitToWindowBtn(nullptr), m_previousBtn(nullptr), m_nextBtn(nullptr),
+      m_zoomFactor(1.0), m_isFullResolution(false), m_isRepeatEnabled(true),
       m_isDraggingTimeline(false), m_videoDuration(0), m_afcClient(afcClient)
 {
-    setWindowTitle(QFileInfo(filePath).fileName() + " - iDescriptor");
+    setWindowTitle(QFileInfo(m_filePath).fileName() + " - iDescriptor");
+
+    // Videos are streamed, not decoded, so stepping only goes through the
+    // images around the one that was opened
+    if (!m_isVideo) {
+        for (const QString &path : filePaths) {
+            if (!isVideoFile(path))
+                m_filePaths.append(path);
+        }
+        m_currentIndex = m_filePaths.indexOf(m_filePath);
+    }
 
     // Make dialog fullscreen
     setWindowState(Qt::WindowMaximized);
@@ -85,9 +119,9 @@ MediaPreviewDialog::MediaPreviewDialog(iDescriptorDevice *device,
 
 MediaPreviewDialog::~MediaPreviewDialog()
 {
-    // Release the streamer if it was used for video
-    if (m_isVideo) {
-        MediaStreamerManager::sharedInstance()->releaseStreamer(m_filePath);
+    // Release the stream if it was used for video
+    if (!m_streamUrl.isEmpty()) {
+        MediaStreamerManager::sharedInstance()->releaseStreamer(m_streamUrl);
     }
 }
 
@@ -139,12 +173,18 @@ void MediaPreviewDialog::setupImageView()
     m_zoomOutBtn = new QPushButton("Zoom Out", this);
     m_zoomResetBtn = new QPushButton("100%", this);
     m_fitToWindowBtn = new QPushButton("Fit to Window", this);
+    m_previousBtn = new QPushButton("Previous", this);
+    m_previousBtn->setToolTip("Previous (Left)");
+    m_nextBtn = new QPushButton("Next", this);
+    m_nextBtn->setToolTip("Next (Right)");
 
     m_controlsLayout->addWidget(m_zoomInBtn);
     m_controlsLayout->addWidget(m_zoomOutBtn);
     m_controlsLayout->addWidget(m_zoomResetBtn);
     m_controlsLayout->addWidget(m_fitToWindowBtn);
     m_controlsLayout->addStretch();
+    m_controlsLayout->addWidget(m_previousBtn);
+    m_controlsLayout->addWidget(m_nextBtn);
 
     m_mainLayout->addLayout(m_controlsLayout);
 
@@ -157,6 +197,30 @@ void MediaPreviewDialog::setupImageView()
             &MediaPreviewDialog::zoomReset);
     connect(m_fitToWindowBtn, &QPushButton::clicked, this,
             &MediaPreviewDialog::fitToWindow);
+    connect(m_previousBtn, &QPushButton::clicked, this,
+            &MediaPreviewDialog::showPrevious);
+    connect(m_nextBtn, &QPushButton::clicked, this,
+            &MediaPreviewDialog::showNext);
+
+    // Shortcuts rather than keyPressEvent(), the graphics view would eat
+    // the arrow keys for scrolling
+    auto *previousShortcut = new QShortcut(QKeySequence(Qt::Key_Left), this);
+    connect(previousShortcut, &QShortcut::activated, this,
+            &MediaPreviewDialog::showPrevious);
+    auto *nextShortcut = new QShortcut(QKeySequence(Qt::Key_Right), this);
+    connect(nextShortcut, &QShortcut::activated, this,
+            &MediaPreviewDialog::showNext);
+
+    iDescriptorDevice *device = m_device;
+    m_imageLoader = new PreviewImageLoader(
+        [device](const QString &filePath) {
+            return PhotoModel::loadImage(device, filePath);
+        },
+        PREVIEW_MEMORY_BUDGET - PREVIEW_TILE_CACHE, this);
+    connect(m_imageLoader, &PreviewImageLoader::imageLoaded, this,
+            &MediaPreviewDialog::onImageLoaded);
+    connect(m_imageLoader, &PreviewImageLoader::imageFailed, this,
+            &MediaPreviewDialog::onImageLoadFailed);
 }
 
 void MediaPreviewDialog::setupVideoView()
@@ -199,6 +263,64 @@ void MediaPreviewDialog::setupVideoView()
     m_progressTimer = new QTimer(this);
     connect(m_progressTimer, &QTimer::timeout, this,
             &MediaPreviewDialog::updateVideoProgress);
+
+    m_debugOverlay = new QLabel(this);
+    m_debugOverlay->setStyleSheet(
+        "QLabel { background-color: rgba(0, 0, 0, 180); color: white; "
+        "font-family: monospace; padding: 6px; }");
+    m_debugOverlay->setAttribute(Qt::WA_TransparentForMouseEvents);
+    m_debugOverlay->hide();
+    m_debugOverlayTimer = new QTimer(this);
+    m_debugOverlayTimer->setInterval(500);
+    connect(m_debugOverlayTimer, &QTimer::timeout, this,
+            &MediaPreviewDialog::updateDebugOverlay);
+    auto *overlayShortcut =
+        new QShortcut(QKeySequence("Ctrl+Shift+D"), this);
+    connect(overlayShortcut, &QShortcut::activated, this,
+            &MediaPreviewDialog::toggleDebugOverlay);
+}
+
+void MediaPreviewDialog::toggleDebugOverlay()
+{
+    if (m_debugOverlay->isVisible()) {
+        m_debugOverlayTimer->stop();
+        m_debugOverlay->hide();
+        return;
+    }
+    updateDebugOverlay();
+    m_debugOverlay->show();
+    m_debugOverlay->raise();
+    m_debugOverlayTimer->start();
+}
+
+// Tells USB/AFC (time to first byte, underruns) apart from the player
+// (its own buffer) when playback stutters
+void MediaPreviewDialog::updateDebugOverlay()
+{
+    const MediaStreamer::StreamStats stats =
+        MediaStreamerManager::sharedInstance()->streamStats(m_streamUrl);
+    auto average = [](qint64 total, int count) {
+        return count > 0 ? QString::number(total / count) : QString("-");
+    };
+
+    QStringList lines;
+    lines << QString("Requests: %1").arg(stats.requests)
+          << QString("Served: %1 MB at %2 MB/s")
+                 .arg(stats.bytesServed / (1024.0 * 1024.0), 0, 'f', 1)
+                 .arg(stats.throughput() / (1024.0 * 1024.0), 0, 'f', 1)
+          << QString("Time to first byte: %1 ms (avg %2)")
+                 .arg(stats.lastTimeToFirstByteMs)
+                 .arg(average(stats.totalTimeToFirstByteMs, stats.requests))
+          << QString("Seek latency: %1 ms (avg %2, %3 seeks)")
+                 .arg(stats.lastSeekLatencyMs)
+                 .arg(average(stats.totalSeekLatencyMs, stats.seeks))
+                 .arg(stats.seeks)
+          << QString("Underruns: %1").arg(stats.underruns)
+          << QString("Player buffer: %1%")
+                 .arg(qRound(m_mediaPlayer->bufferProgress() * 100));
+    m_debugOverlay->setText(lines.join('\n'));
+    m_debugOverlay->adjustSize();
+    m_debugOverlay->move(10, 10);
 }
 
 void MediaPreviewDialog::loadMedia()
@@ -209,71 +331,163 @@ void MediaPreviewDialog::loadMedia()
     loadImage();
 }
 
+/*
+ * Shows whatever is at hand right away: the prefetched full decode if the
+ * user stepped onto a neighbour, otherwise the gallery thumbnail scaled up
+ * until the full resolution pyramid replaces it.
+ */
 void MediaPreviewDialog::loadImage()
 {
-    auto future = QtConcurrent::run(
-        [this]() { return PhotoModel::loadImage(m_device, m_filePath); });
-
-    auto *watcher = new QFutureWatcher<QPixmap>(this);
-    connect(watcher, &QFutureWatcher<QPixmap>::finished, this,
-            [this, watcher]() {
-                QPixmap pixmap = watcher->result();
-                if (!pixmap.isNull()) {
-                    m_originalPixmap = pixmap;
-                    onImageLoaded();
-                } else {
-                    onImageLoadFailed();
-                }
-                watcher->deleteLater();
-            });
-    watcher->setFuture(future);
+    setWindowTitle(QFileInfo(m_filePath).fileName() + " - iDescriptor");
+    updateNavigationButtons();
+
+    const std::shared_ptr<const ImagePyramid> image =
+        m_imageLoader->image(m_filePath);
+    QPixmap thumbnail;
+    if (image) {
+        showFullImage(image);
+    } else if (ThumbnailCache::sharedInstance()->find(
+                   ThumbnailCache::key(m_device, m_filePath), &thumbnail)) {
+        showThumbnail(thumbnail);
+    } else {
+        m_isFullResolution = false;
+        m_imageSize = QSize();
+        m_imageView->setVisible(false);
+        m_loadingLabel->setText("Loading...");
+        m_loadingLabel->show();
+        m_statusLabel->clear();
+    }
+
+    prefetchNeighbours();
+}
+
+// The next image in the direction the user is stepping is decoded first
+void MediaPreviewDialog::prefetchNeighbours()
+{
+    QStringList wanted{m_filePath};
+    for (int step : {m_lastStep, -m_lastStep}) {
+        const int index = m_currentIndex + step;
+        if (index >= 0 && index < m_filePaths.size())
+            wanted.append(m_filePaths.at(index));
+    }
+    m_imageLoader->setWanted(wanted);
+}
+
+void MediaPreviewDialog::showPrevious() { showStep(-1); }
+
+void MediaPreviewDialog::showNext() { showStep(1); }
+
+void MediaPreviewDialog::showStep(int step)
+{
+    const int index = m_currentIndex + step;
+    if (m_isVideo || index < 0 || index >= m_filePaths.size())
+        return;
+
+    m_currentIndex = index;
+    m_lastStep = step;
+    m_filePath = m_filePaths.at(index);
+    loadImage();
+}
+
+void MediaPreviewDialog::updateNavigationButtons()
+{
+    m_previousBtn->setVisible(m_filePaths.size() > 1);
+    m_nextBtn->setVisible(m_filePaths.size() > 1);
+    m_previousBtn->setEnabled(m_currentIndex > 0);
+    m_nextBtn->setEnabled(m_currentIndex + 1 < m_filePaths.size());
 }
 
 void MediaPreviewDialog::loadVideo()
 {
     m_videoWidget->setVisible(true);
 
+    // iPhone videos keep their moov box at the end, fast start serves it
+    // first so playback doesn't wait for a read of the file's tail
+    const QString suffix = QFileInfo(m_filePath).suffix().toLower();
+    const bool fastStart =
+        suffix == "mov" || suffix == "mp4" || suffix == "m4v";
+
     // Get streamer URL from the singleton manager
-    QUrl streamUrl = MediaStreamerManager::sharedInstance()->getStreamUrl(
-        m_device, m_afcClient, m_filePath);
-    qDebug() << "Streaming video from URL:" << streamUrl;
-    if (streamUrl.isEmpty()) {
+    m_streamUrl = MediaStreamerManager::sharedInstance()->getStreamUrl(
+        m_device, m_afcClient, m_filePath, fastStart);
+    qDebug() << "Streaming video from URL:" << m_streamUrl;
+    if (m_streamUrl.isEmpty()) {
         m_statusLabel->setText("Failed to start video stream");
         return;
     }
 
-    m_mediaPlayer->setSource(streamUrl);
+    m_mediaPlayer->setSource(m_streamUrl);
     m_mediaPlayer->play();
     m_loadingLabel->hide();
     m_statusLabel->setText(
         QString("Playing: %1").arg(QFileInfo(m_filePath).fileName()));
 }
 
-void MediaPreviewDialog::onImageLoaded()
+void MediaPreviewDialog::onImageLoaded(
+    const QString &filePath, std::shared_ptr<const ImagePyramid> image)
 {
-    m_loadingLabel->hide();
-    m_imageView->setVisible(true);
-
-    // Add pixmap to scene
-    m_pixmapItem = m_imageScene->addPixmap(m_originalPixmap);
-    m_imageScene->setSceneRect(m_originalPixmap.rect());
-
-    // Fit to window initially
-    fitToWindow();
+    // Neighbours are only cached until the user steps onto them
+    if (filePath != m_filePath || m_isFullResolution)
+        return;
 
-    // Update status
-    m_statusLabel->setText(QString("Image: %1 (%2x%3)")
-                               .arg(QFileInfo(m_filePath).fileName())
-                               .arg(m_originalPixmap.width())
-                               .arg(m_originalPixmap.height()));
+    showFullImage(image);
 }
 
-void MediaPreviewDialog::onImageLoadFailed()
+void MediaPreviewDialog::onImageLoadFailed(const QString &filePath)
 {
+    if (filePath != m_filePath)
+        return;
+
     m_loadingLabel->setText("Failed to load image");
     m_statusLabel->setText("Error loading image");
 }
 
+void MediaPreviewDialog::showThumbnail(const QPixmap &thumbnail)
+{
+    delete m_tiledItem;
+    m_tiledItem = nullptr;
+
+    if (m_pixmapItem) {
+        m_pixmapItem->setPixmap(thumbnail);
+        m_pixmapItem->show();
+    } else {
+        m_pixmapItem = m_imageScene->addPixmap(thumbnail);
+    }
+    m_isFullResolution = false;
+    showScene(thumbnail.size());
+}
+
+/*
+ * The full image is never turned into one big pixmap, the tiled item only
+ * paints the visible tiles of the pyramid level matching the zoom.
+ */
+void MediaPreviewDialog::showFullImage(
+    const std::shared_ptr<const ImagePyramid> &image)
+{
+    if (m_pixmapItem) {
+        m_pixmapItem->hide();
+        m_pixmapItem->setPixmap(QPixmap());
+    }
+    delete m_tiledItem;
+    m_tiledItem = new TiledImageItem(image, PREVIEW_TILE_CACHE);
+    m_imageScene->addItem(m_tiledItem);
+
+    m_isFullResolution = true;
+    showScene(image->size());
+}
+
+void MediaPreviewDialog::showScene(const QSize &imageSize)
+{
+    m_loadingLabel->hide();
+    m_imageView->setVisible(true);
+
+    m_imageSize = imageSize;
+    m_imageScene->setSceneRect(QRectF(QPointF(0, 0), imageSize));
+
+    // Fit to window initially, also updates the status
+    fitToWindow();
+}
+
 void MediaPreviewDialog::wheelEvent(QWheelEvent *event)
 {
     if (!m_isVideo && m_imageView && m_imageView->isVisible()) {
@@ -368,9 +582,9 @@ void MediaPreviewDialog::resizeEvent(QResizeEvent *event)
 
     // Auto-fit when window is resized if we're close to fit-to-window size
     if (!m_isVideo && m_imageView && m_imageView->isVisible() &&
-        !m_originalPixmap.isNull()) {
+        !m_imageSize.isEmpty()) {
         const QSize viewSize = m_imageView->viewport()->size();
-        const QSize pixmapSize = m_originalPixmap.size();
+        const QSize pixmapSize = m_imageSize;
         const double fitScale =
             qMin(static_cast<double>(viewSize.width()) / pixmapSize.width(),
                  static_cast<double>(viewSize.height()) / pixmapSize.height());
@@ -388,7 +602,7 @@ void MediaPreviewDialog::zoomOut() { zoom(1.0 / 1.25); }
 
 void MediaPreviewDialog::zoomReset()
 {
-    if (m_imageView && m_originalPixmap.isNull() == false) {
+    if (m_imageView && !m_imageSize.isEmpty()) {
         m_imageView->resetTransform();
         m_zoomFactor = 1.0;
         updateZoomStatus();
@@ -397,11 +611,11 @@ void MediaPreviewDialog::zoomReset()
 
 void MediaPreviewDialog::fitToWindow()
 {
-    if (!m_imageView || m_originalPixmap.isNull())
+    if (!m_imageView || m_imageSize.isEmpty())
         return;
 
     const QSize viewSize = m_imageView->viewport()->size();
-    const QSize pixmapSize = m_originalPixmap.size();
+    const QSize pixmapSize = m_imageSize;
 
     const double scaleX =
         static_cast<double>(viewSize.width()) / pixmapSize.width();
@@ -438,11 +652,17 @@ void MediaPreviewDialog::zoom(double factor)
 
 void MediaPreviewDialog::updateZoomStatus()
 {
-    if (!m_isVideo && !m_originalPixmap.isNull()) {
+    if (!m_isVideo && !m_isFullResolution) {
+        m_statusLabel->setText(QString("Image: %1 - Loading full resolution...")
+                                   .arg(QFileInfo(m_filePath).fileName()));
+        return;
+    }
+
+    if (!m_isVideo && !m_imageSize.isEmpty()) {
         m_statusLabel->setText(QString("Image: %1 (%2x%3) - Zoom: %4%")
                                    .arg(QFileInfo(m_filePath).fileName())
-                                   .arg(m_originalPixmap.width())
-                                   .arg(m_originalPixmap.height())
+                                   .arg(m_imageSize.width())
+                                   .arg(m_imageSize.height())
                                    .arg(qRound(m_zoomFactor * 100)));
     }
 }
@@ -33,18 +33,27 @@
 #include <QPushButton>
 #include <QSlider>
 #include <QTimer>
+#include <QUrl>
 #include <QVBoxLayout>
 #include <QVideoWidget>
 #include <QtGlobal>
 #include <libimobiledevice/afc.h>
+#include <memory>
+
+class ImagePyramid;
+class PreviewImageLoader;
+class TiledImageItem;
 
 /**
  * @brief A dialog for previewing images and videos from iOS devices
  *
  * Features:
- * - Image viewing with zoom and pan using QGraphicsView
+ * - Image viewing with zoom and pan using QGraphicsView, large photos are
+ *   painted tile by tile from a multi-resolution pyramid
  * - Video streaming with timeline scrubbing support
  * - Asynchronous loading from device
+ * - Stepping through the images of an album, the cached thumbnail shows
+ *   up right away and the neighbours are decoded ahead of time
  * - Proper memory management
  */
 class MediaPreviewDialog : public QDialog
@@ -55,6 +64,11 @@ public:
     explicit MediaPreviewDialog(iDescriptorDevice *device,
                                 afc_client_t afcClient, const QString &filePath,
                                 QWidget *parent = nullptr);
+    // Opens filePaths[currentIndex], Left/Right step through the images of
+    // the list
+    MediaPreviewDialog(iDescriptorDevice *device, afc_client_t afcClient,
+                       const QStringList &filePaths, int currentIndex,
+                       QWidget *parent = nullptr);
     ~MediaPreviewDialog();
 
 protected:
@@ -64,8 +78,11 @@ protected:
     bool event(QEvent *event) override; // handle ShortcutOverride
 
 private slots:
-    void onImageLoaded();
-    void onImageLoadFailed();
+    void onImageLoaded(const QString &filePath,
+                       std::shared_ptr<const ImagePyramid> image);
+    void onImageLoadFailed(const QString &filePath);
+    void showPrevious();
+    void showNext();
     void zoomIn();
     void zoomOut();
     void zoomReset();
@@ -92,9 +109,17 @@ private:
     void loadMedia();
     void loadImage();
     void loadVideo();
+    void showThumbnail(const QPixmap &thumbnail);
+    void showFullImage(const std::shared_ptr<const ImagePyramid> &image);
+    void showScene(const QSize &imageSize);
+    void showStep(int step);
+    void prefetchNeighbours();
+    void updateNavigationButtons();
     void zoom(double factor);
     void updateZoomStatus();
     void updateVideoTimeDisplay();
+    void toggleDebugOverlay();
+    void updateDebugOverlay();
     void formatTime(qint64 milliseconds, QString &timeString);
     bool isVideoFile(const QString &filePath) const;
 
@@ -102,6 +127,10 @@ private:
     iDescriptorDevice *m_device;
     QString m_filePath;
     bool m_isVideo;
+    // Images the user can step through, m_filePath is the current one
+    QStringList m_filePaths;
+    int m_currentIndex;
+    int m_lastStep;
 
     // UI components
     QVBoxLayout *m_mainLayout;
@@ -110,11 +139,15 @@ private:
     // Image viewing components
     QGraphicsView *m_imageView;
     QGraphicsScene *m_imageScene;
+    // Thumbnail stand-in until the full image's tiled item replaces it
     QGraphicsPixmapItem *m_pixmapItem;
+    TiledImageItem *m_tiledItem;
+    PreviewImageLoader *m_imageLoader;
 
     // Video viewing components
     QVideoWidget *m_videoWidget;
     QMediaPlayer *m_mediaPlayer;
+    QUrl m_streamUrl;
 
     // Video control components
     QHBoxLayout *m_videoControlsLayout;
@@ -126,6 +159,9 @@ private:
     QSlider *m_volumeSlider;
     QLabel *m_volumeLabel;
     QTimer *m_progressTimer;
+    // Stream metrics on top of the video, toggled with Ctrl+Shift+D
+    QLabel *m_debugOverlay;
+    QTimer *m_debugOverlayTimer;
 
     // Common components
     QLabel *m_loadingLabel;
@@ -136,10 +172,14 @@ private:
     QPushButton *m_zoomOutBtn;
     QPushButton *m_zoomResetBtn;
     QPushButton *m_fitToWindowBtn;
+    QPushButton *m_previousBtn;
+    QPushButton *m_nextBtn;
 
     // State
     double m_zoomFactor;
-    QPixmap m_originalPixmap;
+    // Size of what is shown, the thumbnail's until the full image is in
+    QSize m_imageSize;
+    bool m_isFullResolution;
 
     // Video state
     bool m_isRepeatEnabled;
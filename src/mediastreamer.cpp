@@ -20,56 +20,193 @@
 #include "mediastreamer.h"
 #include <QtGlobal>
 
+#include "devicefile.h"
 #include "iDescriptor.h"
+#include "instrumentation.h"
 #include "servicemanager.h"
+#include "streamdiskcache.h"
 #include <QDebug>
 #include <QFileInfo>
+#include <QFutureWatcher>
 #include <QHostAddress>
 #include <QMutexLocker>
 #include <QTcpSocket>
 #include <QTimer>
+#include <QUuid>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
 #include <libimobiledevice/afc.h>
 #include <memory>
 
-MediaStreamer::MediaStreamer(iDescriptorDevice *device, afc_client_t afcClient,
-                             const QString &filePath, QObject *parent)
-    : QTcpServer(parent), m_device(device), m_afcClient(afcClient),
-      m_filePath(filePath), m_cachedFileSize(-1), m_fileSizeCached(false)
+// Requests are small, anything bigger than this without a blank line is
+// not a request we want to handle
+constexpr int MAX_REQUEST_HEADER_SIZE = 16 * 1024;
+// Socket send buffer high water mark while streaming a body
+constexpr qint64 MAX_PENDING_BYTES = 256 * 1024;
+constexpr int CHUNK_SIZE = 64 * 1024;
+// Bytes read ahead of the player per connection, several seconds of 4K
+constexpr qsizetype READ_AHEAD_SIZE = 8 * 1024 * 1024;
+// Blocks of a file kept for the ranges overlapping each other
+constexpr qint64 BLOCK_CACHE_SIZE = 64 * 1024 * 1024;
+// Ranges of one file streamed at the same time, the oldest one is cancelled
+// when a player opens more
+constexpr int MAX_CONCURRENT_RANGES = 4;
+// A range whose player took nothing for this long is considered abandoned
+// once a newer range of the same file comes in
+constexpr int SUPERSEDED_STALL_MS = 2000;
+// Idle keep-alive connections are closed after this long
+constexpr int KEEP_ALIVE_TIMEOUT_MS = 30000;
+
+MediaStreamer::MediaStreamer(QObject *parent)
+    : QTcpServer(parent), m_chunk(CHUNK_SIZE, Qt::Uninitialized)
+{
+}
+
+MediaStreamer::~MediaStreamer()
+{
+    if (m_instrumentationId >= 0) {
+        Instrumentation::sharedInstance()->removeProvider(
+            m_instrumentationId);
+    }
+
+    // abort() emits disconnected() right away, closeConnection() would
+    // clean up the same context again
+    const QList<QTcpSocket *> sockets = m_connections.keys();
+    for (QTcpSocket *socket : sockets) {
+        socket->disconnect(this);
+        cleanupStreamingContext(m_connections.take(socket).stream);
+        socket->abort();
+        delete socket;
+    }
+}
+
+bool MediaStreamer::start()
 {
     // Listen on localhost with automatic port assignment
     if (!listen(QHostAddress::LocalHost, 0)) {
         qWarning() << "MediaStreamer failed to start:" << errorString();
-    } else {
-        qDebug() << "MediaStreamer listening on" << getUrl().toString();
+        return false;
     }
+    m_port = serverPort();
+
+    m_idleTimer = new QTimer(this);
+    m_idleTimer->setInterval(KEEP_ALIVE_TIMEOUT_MS / 2);
+    connect(m_idleTimer, &QTimer::timeout, this,
+            &MediaStreamer::closeIdleConnections);
+    m_idleTimer->start();
+
+    m_instrumentationId = Instrumentation::sharedInstance()->addProvider(
+        "MediaStreamer", [this]() { return dumpStats(); });
+
+    qDebug() << "MediaStreamer listening on port" << m_port;
+    return true;
 }
 
-MediaStreamer::~MediaStreamer()
+bool MediaStreamer::isListening() const { return m_port != 0; }
+
+QUrl MediaStreamer::addSource(iDescriptorDevice *device,
+                              afc_client_t afcClient, const QString &filePath,
+                              bool fastStart)
 {
-    // Close all active connections
-    QMutexLocker locker(&m_connectionsMutex);
-    for (QTcpSocket *socket : m_activeConnections) {
-        socket->disconnectFromHost();
-        if (socket->state() != QAbstractSocket::UnconnectedState) {
-            socket->waitForDisconnected(1000);
-        }
-        socket->deleteLater();
+    if (!isListening()) {
+        return QUrl();
     }
-    m_activeConnections.clear();
+
+    auto source = std::make_shared<Source>();
+    source->token = QUuid::createUuid().toString(QUuid::Id128);
+    source->device = device;
+    source->afcClient = afcClient;
+    source->filePath = filePath;
+    source->fastStart = fastStart;
+
+    {
+        QMutexLocker locker(&m_sourcesMutex);
+        m_sources.insert(source->token, source);
+    }
+
+    // The file name is only there for players that sniff the extension
+    QUrl url;
+    url.setScheme("http");
+    url.setHost("127.0.0.1");
+    url.setPort(m_port);
+    url.setPath("/" + source->token + "/" + QFileInfo(filePath).fileName());
+    return url;
 }
 
-QUrl MediaStreamer::getUrl() const
+void MediaStreamer::removeSource(const QUrl &url)
 {
-    if (!isListening()) {
-        return QUrl();
+    const QString token = tokenFromPath(url.path());
+    {
+        QMutexLocker locker(&m_sourcesMutex);
+        if (!m_sources.remove(token))
+            return;
     }
-    // todo pass folder/filename
-    return QUrl(QString("http://127.0.0.1:%1/%2")
-                    .arg(serverPort())
-                    .arg(QFileInfo(m_filePath).fileName()));
+
+    // Connections belong to the server thread
+    QMetaObject::invokeMethod(
+        this, [this, token]() { closeConnectionsFor(token); },
+        Qt::QueuedConnection);
 }
 
-bool MediaStreamer::isListening() const { return QTcpServer::isListening(); }
+MediaStreamer::StreamStats MediaStreamer::stats(const QUrl &url) const
+{
+    std::shared_ptr<Source> source;
+    {
+        QMutexLocker locker(&m_sourcesMutex);
+        source = m_sources.value(tokenFromPath(url.path()));
+    }
+    if (!source)
+        return StreamStats();
+
+    QMutexLocker locker(&m_statsMutex);
+    return source->stats;
+}
+
+QString MediaStreamer::dumpStats() const
+{
+    QList<std::shared_ptr<Source>> sources;
+    {
+        QMutexLocker locker(&m_sourcesMutex);
+        sources = m_sources.values();
+    }
+
+    QString text;
+    QMutexLocker locker(&m_statsMutex);
+    for (const std::shared_ptr<Source> &source : std::as_const(sources)) {
+        text += QString("%1: %2\n")
+                    .arg(source->filePath, source->stats.toString());
+    }
+    return text;
+}
+
+qint64 MediaStreamer::StreamStats::throughput() const
+{
+    return streamingMs > 0 ? bytesServed * 1000 / streamingMs : 0;
+}
+
+QString MediaStreamer::StreamStats::toString() const
+{
+    auto average = [](qint64 total, int count) {
+        return count > 0 ? QString::number(total / count) : QString("-");
+    };
+    return QString("%1 requests, %2 MB served at %3 MB/s, TTFB %4 ms "
+                   "(avg %5), %6 underruns, %7 seeks at %8 ms (avg %9)")
+        .arg(requests)
+        .arg(bytesServed / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(throughput() / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(lastTimeToFirstByteMs)
+        .arg(average(totalTimeToFirstByteMs, requests))
+        .arg(underruns)
+        .arg(seeks)
+        .arg(lastSeekLatencyMs)
+        .arg(average(totalSeekLatencyMs, seeks));
+}
+
+// "/<token>/<file name>" -> "<token>"
+QString MediaStreamer::tokenFromPath(const QString &path)
+{
+    return path.section('/', 1, 1);
+}
 
 void MediaStreamer::incomingConnection(qintptr socketDescriptor)
 {
@@ -80,45 +217,75 @@ void MediaStreamer::incomingConnection(qintptr socketDescriptor)
         return;
     }
 
-    // Add to active connections
-    {
-        QMutexLocker locker(&m_connectionsMutex);
-        m_activeConnections.append(socket);
-    }
+    Connection &connection = m_connections[socket];
+    connection.idle.start();
 
-    connect(socket, &QTcpSocket::readyRead, this, [this, socket]() {
-        QByteArray requestData = socket->readAll();
-        HttpRequest request = parseHttpRequest(requestData);
-        handleRequest(socket, request);
+    connect(socket, &QTcpSocket::readyRead, this,
+            [this, socket]() { onReadyRead(socket); });
+    connect(socket, &QTcpSocket::bytesWritten, this, [this, socket]() {
+        auto it = m_connections.find(socket);
+        if (it == m_connections.end())
+            return;
+        it->idle.restart();
+        // Continue streaming when socket buffer has space
+        if (it->stream && socket->bytesToWrite() < MAX_PENDING_BYTES / 2)
+            streamNextChunk(socket);
     });
-
     connect(socket, &QTcpSocket::disconnected, this,
-            &MediaStreamer::handleClientDisconnected);
+            [this, socket]() { closeConnection(socket); });
     connect(socket,
             QOverload<QAbstractSocket::SocketError>::of(
                 &QAbstractSocket::errorOccurred),
-            this, [this, socket](QAbstractSocket::SocketError error) {
-                qWarning() << "Socket error:" << error << socket->errorString();
-                socket->deleteLater();
+            this, [socket](QAbstractSocket::SocketError error) {
+                if (error != QAbstractSocket::RemoteHostClosedError) {
+                    qWarning()
+                        << "Socket error:" << error << socket->errorString();
+                }
             });
 
     qDebug() << "MediaStreamer: Client connected from"
              << socket->peerAddress().toString();
 }
 
-void MediaStreamer::handleClientDisconnected()
+void MediaStreamer::onReadyRead(QTcpSocket *socket)
 {
-    auto *socket = qobject_cast<QTcpSocket *>(sender());
-    if (!socket)
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end())
         return;
 
-    {
-        QMutexLocker locker(&m_connectionsMutex);
-        m_activeConnections.removeAll(socket);
-    }
+    it->buffer += socket->readAll();
+    it->idle.restart();
+    processRequests(socket);
+}
 
-    qDebug() << "MediaStreamer: Client disconnected";
-    socket->deleteLater();
+/*
+ * Requests can arrive in pieces or several at once (pipelining), the buffer
+ * is parsed one complete header block at a time. While a body is being
+ * streamed further requests wait in the buffer.
+ */
+void MediaStreamer::processRequests(QTcpSocket *socket)
+{
+    while (true) {
+        auto it = m_connections.find(socket);
+        if (it == m_connections.end() || it->stream || it->waiting ||
+            socket->state() != QAbstractSocket::ConnectedState) {
+            return;
+        }
+
+        const qsizetype headerEnd = it->buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0) {
+            if (it->buffer.size() > MAX_REQUEST_HEADER_SIZE) {
+                it->keepAlive = false;
+                sendErrorResponse(socket, 431,
+                                  "Request Header Fields Too Large");
+            }
+            return;
+        }
+
+        const QByteArray requestData = it->buffer.left(headerEnd + 4);
+        it->buffer.remove(0, headerEnd + 4);
+        handleRequest(socket, parseHttpRequest(requestData));
+    }
 }
 
 MediaStreamer::HttpRequest
@@ -155,68 +322,115 @@ MediaStreamer::parseHttpRequest(const QByteArray &requestData)
         }
     }
 
-    // Parse Range header if present
-    if (request.headers.contains("range")) {
-        const QString rangeHeader = request.headers["range"];
-        if (rangeHeader.startsWith("bytes=")) {
-            const QString rangeValue = rangeHeader.mid(6); // Remove "bytes="
-            const QStringList rangeParts = rangeValue.split('-');
-
-            if (rangeParts.size() == 2) {
-                request.hasRange = true;
-                bool ok;
-                request.rangeStart = rangeParts[0].toLongLong(&ok);
-                if (!ok)
-                    request.rangeStart = 0;
-
-                if (!rangeParts[1].isEmpty()) {
-                    request.rangeEnd = rangeParts[1].toLongLong(&ok);
-                    if (!ok)
-                        request.rangeEnd = -1;
-                }
-            }
+    return request;
+}
+
+/*
+    "bytes=a-b", "bytes=a-" and the suffix form "bytes=-n", which players
+    use to read the tail of a file looking for a trailing moov. Multiple
+    ranges aren't supported and are treated as unsatisfiable.
+*/
+bool MediaStreamer::parseRange(const QString &rangeHeader, qint64 fileSize,
+                               qint64 &start, qint64 &end)
+{
+    if (!rangeHeader.startsWith("bytes=") || rangeHeader.contains(','))
+        return false;
+
+    const QString spec = rangeHeader.mid(6).trimmed();
+    const int dash = spec.indexOf('-');
+    if (dash < 0)
+        return false;
+
+    bool ok = true;
+    const QString first = spec.left(dash).trimmed();
+    const QString last = spec.mid(dash + 1).trimmed();
+    if (first.isEmpty()) {
+        // The last n bytes
+        const qint64 suffix = last.toLongLong(&ok);
+        if (!ok || suffix <= 0)
+            return false;
+        start = qMax<qint64>(0, fileSize - suffix);
+        end = fileSize - 1;
+    } else {
+        start = first.toLongLong(&ok);
+        if (!ok)
+            return false;
+        end = fileSize - 1;
+        if (!last.isEmpty()) {
+            end = qMin(last.toLongLong(&ok), fileSize - 1);
+            if (!ok)
+                return false;
         }
     }
-
-    return request;
+    return start >= 0 && start <= end;
 }
 
 void MediaStreamer::handleRequest(QTcpSocket *socket,
                                   const HttpRequest &request)
 {
+    QElapsedTimer requestTimer;
+    requestTimer.start();
+    Connection &connection = m_connections[socket];
+
+    // HTTP/1.1 keeps the connection open unless told otherwise, 1.0 only
+    // when asked to
+    const QString connectionHeader =
+        request.headers.value("connection").toLower();
+    if (request.httpVersion == "HTTP/1.1") {
+        connection.keepAlive = connectionHeader != "close";
+    } else {
+        connection.keepAlive = connectionHeader == "keep-alive";
+    }
+
     if (request.method != "GET" && request.method != "HEAD") {
+        connection.keepAlive = false;
         sendErrorResponse(socket, 405, "Method Not Allowed");
         return;
     }
 
-    const qint64 fileSize = getFileSize();
-    if (fileSize <= 0) {
-        sendErrorResponse(socket, 404, "File Not Found");
+    std::shared_ptr<Source> source;
+    connection.token = tokenFromPath(request.path);
+    {
+        QMutexLocker locker(&m_sourcesMutex);
+        source = m_sources.value(connection.token);
+    }
+    if (!source) {
+        sendErrorResponse(socket, 404, "Not Found");
         return;
     }
 
+    if (source->fileSize <= 0) {
+        prepareSource(socket, request, source, requestTimer);
+        return;
+    }
+    respond(socket, request, source, requestTimer);
+}
+
+void MediaStreamer::respond(QTcpSocket *socket, const HttpRequest &request,
+                            const std::shared_ptr<Source> &source,
+                            const QElapsedTimer &requestTimer)
+{
+    const Connection &connection = m_connections[socket];
+    const qint64 fileSize = source->servedSize();
+
     qint64 rangeStart = 0;
     qint64 rangeEnd = fileSize - 1;
 
-    if (request.hasRange) {
-        rangeStart = request.rangeStart;
-        if (request.rangeEnd >= 0 && request.rangeEnd < fileSize) {
-            rangeEnd = request.rangeEnd;
-        }
-
-        // Validate range
-        if (rangeStart < 0 || rangeStart >= fileSize || rangeStart > rangeEnd) {
-            sendErrorResponse(socket, 416, "Range Not Satisfiable");
-            return;
-        }
+    const bool hasRange = request.headers.contains("range");
+    if (hasRange && !parseRange(request.headers.value("range"), fileSize,
+                                rangeStart, rangeEnd)) {
+        sendErrorResponse(socket, 416, "Range Not Satisfiable",
+                          QString("Content-Range: bytes */%1\r\n")
+                              .arg(fileSize));
+        return;
     }
 
     const qint64 contentLength = rangeEnd - rangeStart + 1;
-    const QString mimeType = getMimeType();
+    const QString mimeType = getMimeType(source->filePath);
 
     // Send response headers
     QByteArray response;
-    if (request.hasRange) {
+    if (hasRange) {
         response += "HTTP/1.1 206 Partial Content\r\n";
         response += QString("Content-Range: bytes %1-%2/%3\r\n")
                         .arg(rangeStart)
@@ -230,161 +444,194 @@ void MediaStreamer::handleRequest(QTcpSocket *socket,
     response += "Accept-Ranges: bytes\r\n";
     response += QString("Content-Length: %1\r\n").arg(contentLength).toUtf8();
     response += QString("Content-Type: %1\r\n").arg(mimeType).toUtf8();
-    response += "Connection: close\r\n";
+    response += connection.keepAlive ? "Connection: keep-alive\r\n"
+                                     : "Connection: close\r\n";
     response += "Cache-Control: no-cache\r\n";
     response += "\r\n";
 
     socket->write(response);
-    // Remove blocking call - let Qt handle when bytes are actually written
 
     // For HEAD requests, don't send body
     if (request.method == "HEAD") {
-        socket->disconnectFromHost();
+        finishResponse(socket);
         return;
     }
 
     // Stream file content
-    streamFileRange(socket, rangeStart, rangeEnd);
+    streamFileRange(socket, source, rangeStart, rangeEnd, requestTimer);
 }
 
 void MediaStreamer::sendErrorResponse(QTcpSocket *socket, int statusCode,
-                                      const QString &statusText)
+                                      const QString &statusText,
+                                      const QString &extraHeaders)
 {
-    const QByteArray response = QString("HTTP/1.1 %1 %2\r\n"
-                                        "Content-Length: 0\r\n"
-                                        "Connection: close\r\n"
-                                        "\r\n")
-                                    .arg(statusCode)
-                                    .arg(statusText)
-                                    .toUtf8();
+    const bool keepAlive = m_connections.value(socket).keepAlive;
+    const QByteArray response =
+        QString("HTTP/1.1 %1 %2\r\n"
+                "%3"
+                "Content-Length: 0\r\n"
+                "Connection: %4\r\n"
+                "\r\n")
+            .arg(statusCode)
+            .arg(statusText, extraHeaders,
+                 QString(keepAlive ? "keep-alive" : "close"))
+            .toUtf8();
 
     socket->write(response);
-    // Remove blocking call
-    socket->disconnectFromHost();
+    finishResponse(socket);
 }
 
-void MediaStreamer::streamFileRange(QTcpSocket *socket, qint64 startByte,
-                                    qint64 endByte)
+void MediaStreamer::streamFileRange(QTcpSocket *socket,
+                                    const std::shared_ptr<Source> &source,
+                                    qint64 startByte, qint64 endByte,
+                                    const QElapsedTimer &requestTimer)
 {
     // Create a new streaming context for this request
-    StreamingContext *context = new StreamingContext();
-    context->socket = socket;
-    context->device = m_device;
-    context->filePath = m_filePath;
+    auto *context = new StreamingContext();
+    context->source = source;
     context->startByte = startByte;
     context->endByte = endByte;
     context->bytesRemaining = endByte - startByte + 1;
-    context->afcHandle = 0;
-
-    qDebug() << "m_filepath" << m_filePath;
-    // Open file on device using ServiceManager
-    const QByteArray pathBytes = m_filePath.toUtf8();
-    afc_error_t openResult = ServiceManager::safeAfcFileOpen(
-        m_device, pathBytes.constData(), AFC_FOPEN_RDONLY, &context->afcHandle,
-        m_afcClient);
-
-    if (openResult != AFC_E_SUCCESS || context->afcHandle == 0) {
-        qWarning() << "Failed to open file on device:" << m_filePath;
-        delete context;
-        socket->disconnectFromHost();
-        return;
+    context->serial = m_nextSerial++;
+    context->position = startByte;
+    context->timer = requestTimer;
+    context->isSeek = startByte > 0;
+
+    {
+        QMutexLocker locker(&m_statsMutex);
+        source->stats.requests++;
     }
 
-    // Seek to start position if needed
-    if (startByte > 0) {
-        afc_error_t seekResult = ServiceManager::safeAfcFileSeek(
-            m_device, context->afcHandle, startByte, SEEK_SET, m_afcClient);
-        if (seekResult != AFC_E_SUCCESS) {
-            qWarning() << "Failed to seek in file:" << m_filePath;
-            ServiceManager::safeAfcFileClose(m_device, context->afcHandle,
-                                             m_afcClient);
-            delete context;
-            socket->disconnectFromHost();
-            return;
-        }
+    cancelSupersededRanges(socket, source->token);
+
+    Connection &connection = m_connections[socket];
+    if (!connection.reader || connection.readerToken != source->token) {
+        // Wakes us up from the producer thread once data arrives
+        auto notify = [this, socket]() {
+            QMetaObject::invokeMethod(
+                this, [this, socket]() { streamNextChunk(socket); },
+                Qt::QueuedConnection);
+        };
+        connection.reader = std::make_shared<ReadAheadBuffer>(
+            source->device, source->afcClient, source->filePath,
+            source->fileSize, source->cache, READ_AHEAD_SIZE, notify);
+        connection.readerToken = source->token;
     }
 
-    qDebug() << "Starting non-blocking stream for range" << startByte << "-"
-             << endByte << "(" << context->bytesRemaining << "bytes)";
+    qDebug() << "Starting stream for range" << startByte << "-" << endByte
+             << "(" << context->bytesRemaining << "bytes)";
 
-    // Store context as socket property for cleanup
-    socket->setProperty("streamingContext",
-                        QVariant::fromValue(static_cast<void *>(context)));
+    connection.stream = context;
+    streamNextChunk(socket);
+}
 
-    // Connect to socket signals for async streaming
-    connect(socket, &QTcpSocket::bytesWritten, this,
-            [this, context](qint64 bytes) {
-                Q_UNUSED(bytes)
-                // Check if context is still valid
-                QTcpSocket *senderSocket = qobject_cast<QTcpSocket *>(sender());
-                if (!senderSocket ||
-                    senderSocket->property("streamingContext").isNull()) {
-                    return; // Context already cleaned up
-                }
-                // Continue streaming when socket buffer has space
-                if (context->socket->bytesToWrite() <
-                    32768) { // Keep buffer below 32KB
-                    streamNextChunk(context);
+/*
+    The first request for a file stats it and, in fast start mode, reads its
+    moov box to build the remuxed layout. That can be several MB over AFC
+    for a long 4K clip, so it runs on a pool thread and the request (and
+    anything pipelined behind it) waits while every other stream goes on.
+    Requests for the same file arriving meanwhile share the same run.
+*/
+void MediaStreamer::prepareSource(QTcpSocket *socket,
+                                  const HttpRequest &request,
+                                  const std::shared_ptr<Source> &source,
+                                  const QElapsedTimer &requestTimer)
+{
+    if (!source->preparing.isValid() || source->preparing.isFinished()) {
+        source->preparing = QtConcurrent::run(
+            readSourceInfo, source->device, source->afcClient,
+            source->filePath, source->fastStart);
+    }
+
+    m_connections[socket].waiting = true;
+
+    auto *watcher = new QFutureWatcher<SourceInfo>(this);
+    connect(watcher, &QFutureWatcher<SourceInfo>::finished, this,
+            [this, socket, watcher, request, source, requestTimer]() {
+                watcher->deleteLater();
+                // The first request to get here applies it for all of them
+                if (source->fileSize <= 0) {
+                    applySourceInfo(*source, watcher->result());
                 }
-            });
 
-    connect(socket, &QTcpSocket::disconnected, this, [this, context]() {
-        // Check if context is still valid before cleanup
-        QTcpSocket *senderSocket = qobject_cast<QTcpSocket *>(sender());
-        if (!senderSocket ||
-            senderSocket->property("streamingContext").isNull()) {
-            return; // Already cleaned up
-        }
-        cleanupStreamingContext(context);
-    });
+                auto it = m_connections.find(socket);
+                if (it == m_connections.end())
+                    return;
+                it->waiting = false;
 
-    // Start streaming the first chunk
-    streamNextChunk(context);
+                if (source->fileSize <= 0) {
+                    sendErrorResponse(socket, 404, "File Not Found");
+                } else {
+                    respond(socket, request, source, requestTimer);
+                }
+                processRequests(socket);
+            });
+    watcher->setFuture(source->preparing);
 }
 
-qint64 MediaStreamer::getFileSize()
+// Runs on a pool thread, only uses what it was given
+MediaStreamer::SourceInfo
+MediaStreamer::readSourceInfo(iDescriptorDevice *device,
+                              afc_client_t afcClient, const QString &filePath,
+                              bool fastStart)
 {
-    QMutexLocker locker(&m_fileSizeMutex);
-
-    if (m_fileSizeCached) {
-        return m_cachedFileSize;
-    }
+    SourceInfo result;
 
     // Get file info from device using ServiceManager
     char **info = nullptr;
-    const QByteArray pathBytes = m_filePath.toUtf8();
-    afc_error_t result = ServiceManager::safeAfcGetFileInfo(
-        m_device, pathBytes.constData(), &info, m_afcClient);
+    const QByteArray pathBytes = filePath.toUtf8();
+    afc_error_t error = ServiceManager::safeAfcGetFileInfo(
+        device, pathBytes.constData(), &info, afcClient);
 
-    if (result != AFC_E_SUCCESS || !info) {
-        qWarning() << "Failed to get file info for:" << m_filePath;
-        return -1;
+    if (error != AFC_E_SUCCESS || !info) {
+        qWarning() << "Failed to get file info for:" << filePath;
+        return result;
     }
 
-    qint64 fileSize = -1;
     for (int i = 0; info[i]; i += 2) {
         if (strcmp(info[i], "st_size") == 0) {
             bool ok;
-            fileSize = QString(info[i + 1]).toLongLong(&ok);
+            result.fileSize = QString(info[i + 1]).toLongLong(&ok);
             if (!ok)
-                fileSize = -1;
-            break;
+                result.fileSize = -1;
+        } else if (strcmp(info[i], "st_mtime") == 0) {
+            result.mtime = QString(info[i + 1]).toULongLong();
         }
     }
 
     afc_dictionary_free(info);
 
-    if (fileSize > 0) {
-        m_cachedFileSize = fileSize;
-        m_fileSizeCached = true;
+    // Costs a few box header reads and reading the moov box once, the
+    // player would otherwise fetch the tail over its own round trips
+    if (result.fileSize > 0 && fastStart) {
+        DeviceFile file(device, filePath);
+        result.layout = FastStartLayout::build(file, result.fileSize);
+        if (result.layout) {
+            qDebug() << "MediaStreamer: Serving" << filePath
+                     << "with the moov box moved to the front";
+        }
     }
+    return result;
+}
 
-    return fileSize;
+void MediaStreamer::applySourceInfo(Source &source, const SourceInfo &info)
+{
+    source.fileSize = info.fileSize;
+    source.layout = info.layout;
+    if (info.fileSize > 0 && !source.cache) {
+        // Blocks are also kept on disk per file version, see
+        // StreamDiskCache
+        const QString key = StreamDiskCache::key(source.device->udid,
+                                                 source.filePath, info.mtime);
+        source.cache = std::make_shared<StreamBlockCache>(
+            BLOCK_CACHE_SIZE,
+            StreamDiskCache::sharedInstance()->open(key, info.fileSize));
+    }
 }
 
-QString MediaStreamer::getMimeType() const
+QString MediaStreamer::getMimeType(const QString &filePath)
 {
-    const QString lower = m_filePath.toLower();
+    const QString lower = filePath.toLower();
 
     if (lower.endsWith(".mp4") || lower.endsWith(".m4v")) {
         return "video/mp4";
@@ -399,111 +646,235 @@ QString MediaStreamer::getMimeType() const
     return "application/octet-stream";
 }
 
-void MediaStreamer::streamNextChunk(StreamingContext *context)
+// Fills the socket buffer up to MAX_PENDING_BYTES from what the reader has
+// buffered. bytesWritten brings us back here once the player has read some
+// of it, the reader's notify callback when it had nothing left.
+void MediaStreamer::streamNextChunk(QTcpSocket *socket)
 {
-    if (!context || !context->socket) {
-        return; // Invalid context, don't cleanup here
-    }
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end() || !it->stream)
+        return;
+
+    StreamingContext *context = it->stream;
+    ReadAheadBuffer *reader = it->reader.get();
+    const FastStartLayout *layout = context->source->layout.get();
+    const qint64 headerSize = layout ? layout->header().size() : 0;
+
+    while (context->bytesRemaining > 0 &&
+           socket->bytesToWrite() < MAX_PENDING_BYTES) {
+        if (socket->state() != QAbstractSocket::ConnectedState) {
+            closeConnection(socket);
+            return;
+        }
+
+        const char *data = m_chunk.constData();
+        qint64 bytesRead = 0;
+        if (context->position < headerSize) {
+            // The relocated moov box is served from memory
+            data = layout->header().constData() + context->position;
+            bytesRead = qMin(headerSize - context->position,
+                             context->bytesRemaining);
+        } else {
+            if (context->position >= context->readerEnd &&
+                !seekReader(reader, context)) {
+                bytesRead = -1;
+            } else {
+                bytesRead = reader->read(
+                    m_chunk.data(),
+                    std::min({qint64(CHUNK_SIZE), context->bytesRemaining,
+                              context->readerEnd - context->position}));
+            }
+        }
+        if (bytesRead == 0) {
+            // Nothing buffered yet, the reader calls us back. With the
+            // socket drained too the player is waiting on USB.
+            updateStats(context, 0, socket->bytesToWrite() == 0);
+            return;
+        }
+
+        if (bytesRead < 0) {
+            qWarning() << "AFC read error or EOF during streaming";
+            // The promised Content-Length can't be met anymore
+            it->keepAlive = false;
+            finishResponse(socket);
+            return;
+        }
 
-    // Check if context has been marked for cleanup
-    if (context->socket->property("streamingContext").isNull()) {
-        return; // Already cleaned up
+        const qint64 bytesWritten = socket->write(data, bytesRead);
+        if (bytesWritten == -1) {
+            qWarning() << "Socket write error";
+            closeConnection(socket);
+            return;
+        }
+
+        context->bytesRemaining -= bytesWritten;
+        context->position += bytesWritten;
+        updateStats(context, bytesWritten, false);
     }
 
     if (context->bytesRemaining <= 0) {
         qDebug() << "Streaming completed for"
-                 << QFileInfo(context->filePath).fileName();
-        cleanupStreamingContext(context);
-        return;
+                 << QFileInfo(context->source->filePath).fileName();
+        finishResponse(socket);
     }
+}
 
-    // Check if socket is still valid
-    if (context->socket->state() != QAbstractSocket::ConnectedState) {
-        cleanupStreamingContext(context);
+void MediaStreamer::updateStats(StreamingContext *context,
+                                qint64 bytesWritten, bool underrun)
+{
+    const qint64 elapsed = context->timer.elapsed();
+    const bool firstByte = bytesWritten > 0 && !context->firstByteSent;
+    const bool newUnderrun = underrun && !context->starved;
+    if (bytesWritten > 0) {
+        context->firstByteSent = true;
+        context->starved = false;
+    } else if (underrun) {
+        context->starved = true;
+    }
+
+    // Only the first byte and new underruns are worth a lock per chunk
+    if (!firstByte && !newUnderrun && elapsed - context->accountedMs < 100 &&
+        context->bytesRemaining > 0) {
+        context->unaccountedBytes += bytesWritten;
         return;
     }
 
-    const int CHUNK_SIZE = 64 * 1024; // 64KB chunks
-    const uint32_t bytesToRead = static_cast<uint32_t>(
-        qMin(static_cast<qint64>(CHUNK_SIZE), context->bytesRemaining));
-
-    auto buffer = std::make_unique<char[]>(bytesToRead);
-    uint32_t bytesRead = 0;
-
-    afc_error_t readResult = ServiceManager::safeAfcFileRead(
-        m_device, context->afcHandle, buffer.get(), bytesToRead, &bytesRead,
-        m_afcClient);
-
-    if (readResult != AFC_E_SUCCESS || bytesRead == 0) {
-        qWarning() << "AFC read error or EOF during streaming";
-        cleanupStreamingContext(context);
-        return;
+    QMutexLocker locker(&m_statsMutex);
+    StreamStats &stats = context->source->stats;
+    stats.bytesServed += context->unaccountedBytes + bytesWritten;
+    stats.streamingMs += elapsed - context->accountedMs;
+    context->unaccountedBytes = 0;
+    context->accountedMs = elapsed;
+
+    if (firstByte) {
+        stats.lastTimeToFirstByteMs = elapsed;
+        stats.totalTimeToFirstByteMs += elapsed;
+        if (context->isSeek) {
+            stats.seeks++;
+            stats.lastSeekLatencyMs = elapsed;
+            stats.totalSeekLatencyMs += elapsed;
+        }
     }
+    if (newUnderrun && context->firstByteSent)
+        stats.underruns++;
+}
 
-    const qint64 bytesWritten = context->socket->write(buffer.get(), bytesRead);
-    if (bytesWritten == -1) {
-        qWarning() << "Socket write error";
-        cleanupStreamingContext(context);
+// Points the reader at the original bytes behind the context's position,
+// up to the end of the range or of the run they belong to
+bool MediaStreamer::seekReader(ReadAheadBuffer *reader,
+                               StreamingContext *context)
+{
+    qint64 sourceOffset = context->position;
+    qint64 length = context->bytesRemaining;
+    if (const FastStartLayout *layout = context->source->layout.get()) {
+        qint64 runLength = 0;
+        if (!layout->mapOffset(context->position, sourceOffset, runLength))
+            return false;
+        length = qMin(length, runLength);
+    }
+
+    reader->seek(sourceOffset, sourceOffset + length);
+    context->readerEnd = context->position + length;
+    return true;
+}
+
+// Ends the current response, keep-alive connections go on with the next
+// request, others are closed once the last bytes are out
+void MediaStreamer::finishResponse(QTcpSocket *socket)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end())
         return;
-    }
 
-    context->bytesRemaining -= bytesWritten;
+    cleanupStreamingContext(it->stream);
+    it->stream = nullptr;
+    it->idle.restart();
 
-    // If we're done, clean up
-    if (context->bytesRemaining <= 0) {
-        qDebug() << "Streaming completed for"
-                 << QFileInfo(context->filePath).fileName();
-        cleanupStreamingContext(context);
+    if (!it->keepAlive) {
+        socket->disconnectFromHost();
         return;
     }
 
-    // If socket buffer is getting full, let bytesWritten signal handle the next
-    // chunk Otherwise, continue immediately for better performance
-    if (context->socket->bytesToWrite() >= 32768) {
-        // Wait for bytesWritten signal
-        return;
-    } else {
-        // Continue immediately with safety check
-        QTimer::singleShot(0, this, [this, context]() {
-            // Double-check context is still valid when timer fires
-            if (context && context->socket &&
-                !context->socket->property("streamingContext").isNull()) {
-                streamNextChunk(context);
-            }
-        });
+    if (!it->buffer.isEmpty()) {
+        QMetaObject::invokeMethod(
+            this, [this, socket]() { processRequests(socket); },
+            Qt::QueuedConnection);
     }
 }
 
 void MediaStreamer::cleanupStreamingContext(StreamingContext *context)
 {
-    if (!context)
+    delete context;
+}
+
+void MediaStreamer::closeConnection(QTcpSocket *socket)
+{
+    auto it = m_connections.find(socket);
+    if (it == m_connections.end())
         return;
 
-    // Mark as cleaned up immediately to prevent double cleanup
-    if (context->socket) {
-        // Check if already cleaned up
-        if (context->socket->property("streamingContext").isNull()) {
-            return; // Already cleaned up
-        }
-        context->socket->setProperty("streamingContext", QVariant());
+    StreamingContext *context = it->stream;
+    m_connections.erase(it);
+    cleanupStreamingContext(context);
+
+    qDebug() << "MediaStreamer: Client disconnected";
+    socket->disconnect(this);
+    socket->abort();
+    socket->deleteLater();
+}
+
+void MediaStreamer::closeConnectionsFor(const QString &token)
+{
+    QList<QTcpSocket *> sockets;
+    for (auto it = m_connections.cbegin(); it != m_connections.cend(); ++it) {
+        if (it->token == token)
+            sockets.append(it.key());
+    }
+    for (QTcpSocket *socket : std::as_const(sockets)) {
+        closeConnection(socket);
     }
+}
 
-    if (context->afcHandle != 0) {
-        ServiceManager::safeAfcFileClose(context->device, context->afcHandle,
-                                         m_afcClient);
-        context->afcHandle = 0;
+/*
+ * Scrubbing makes players open a new range before they let go of the old
+ * one. Ranges of the same file whose player stopped reading are closed so
+ * their read-ahead stops competing for the device, and so are the oldest
+ * ones beyond MAX_CONCURRENT_RANGES.
+ */
+void MediaStreamer::cancelSupersededRanges(QTcpSocket *socket,
+                                           const QString &token)
+{
+    QList<std::pair<quint64, QTcpSocket *>> ranges;
+    QList<QTcpSocket *> stalled;
+    for (auto it = m_connections.cbegin(); it != m_connections.cend(); ++it) {
+        if (it.key() == socket || !it->stream || it->token != token)
+            continue;
+        if (it->idle.hasExpired(SUPERSEDED_STALL_MS)) {
+            stalled.append(it.key());
+        } else {
+            ranges.append({it->stream->serial, it.key()});
+        }
     }
 
-    if (context->socket) {
-        // Disconnect all our custom signals to prevent further callbacks
-        disconnect(context->socket, &QTcpSocket::bytesWritten, this, nullptr);
-        disconnect(context->socket, &QTcpSocket::disconnected, this, nullptr);
+    std::sort(ranges.begin(), ranges.end());
+    for (qsizetype i = 0; i + MAX_CONCURRENT_RANGES <= ranges.size(); ++i) {
+        stalled.append(ranges[i].second);
+    }
 
-        context->socket->disconnectFromHost();
-        context->socket = nullptr; // Prevent further access
+    for (QTcpSocket *stale : std::as_const(stalled)) {
+        qDebug() << "MediaStreamer: Cancelling superseded range";
+        closeConnection(stale);
     }
+}
 
-    qDebug() << "Streaming context cleaned up for"
-             << QFileInfo(context->filePath).fileName();
-    delete context;
+void MediaStreamer::closeIdleConnections()
+{
+    QList<QTcpSocket *> sockets;
+    for (auto it = m_connections.cbegin(); it != m_connections.cend(); ++it) {
+        if (!it->stream && it->idle.hasExpired(KEEP_ALIVE_TIMEOUT_MS))
+            sockets.append(it.key());
+    }
+    for (QTcpSocket *socket : std::as_const(sockets)) {
+        closeConnection(socket);
+    }
 }
@@ -20,43 +20,107 @@
 #ifndef MEDIASTREAMER_H
 #define MEDIASTREAMER_H
 
+#include "faststartlayout.h"
 #include "iDescriptor.h"
+#include "readaheadbuffer.h"
+#include "streamblockcache.h"
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QHash>
 #include <QMap>
 #include <QMutex>
 #include <QTcpServer>
 #include <QUrl>
 #include <libimobiledevice/afc.h>
+#include <memory>
 
 QT_BEGIN_NAMESPACE
 class QTcpSocket;
+class QTimer;
 QT_END_NAMESPACE
 
 /**
  * @brief A lightweight HTTP server for streaming media files from iOS devices
  *
+ * One server serves every previewed file, each file is registered as a
+ * source and reachable under its own random token:
+ * http://127.0.0.1:port/<token>/<file name>
+ *
  * This class implements an HTTP server that supports:
- * - Basic HTTP GET requests
+ * - Basic HTTP GET and HEAD requests
  * - HTTP Range requests for video scrubbing
+ * - HTTP/1.1 keep-alive, several requests per connection
+ * - Concurrent ranges of one file on several connections, each with its own
+ *   AFC handle and a block cache shared between them
+ * - A local disk cache, replays and seeks into parts that were streamed
+ *   before don't touch USB
+ * - An optional fast start mode for MOV/MP4 files with the moov box at the
+ *   end, served as a virtual file with the moov box in front (see
+ *   FastStartLayout)
  * - Streaming from AFC (Apple File Conduit) without loading entire file into
- * memory
- * - Thread-safe operation
+ * memory, read ahead of the player by a ReadAheadBuffer per connection
  *
- * The server automatically shuts down when the client disconnects.
+ * The server lives on its own thread (see MediaStreamerManager), so socket
+ * events and AFC reads never run on the GUI thread. addSource() and
+ * removeSource() may be called from any thread.
  */
 class MediaStreamer : public QTcpServer
 {
     Q_OBJECT
 
 public:
-    explicit MediaStreamer(iDescriptorDevice *device, afc_client_t afcClient,
-                           const QString &filePath, QObject *parent = nullptr);
+    explicit MediaStreamer(QObject *parent = nullptr);
     ~MediaStreamer();
 
     /**
-     * @brief Get the URL that clients should use to connect to this server
-     * @return URL in format http://127.0.0.1:port
+     * @brief Start listening on localhost, must run on the server's thread
+     * @return true if the server is listening
+     */
+    bool start();
+
+    /**
+     * @brief Register a file to be served
+     * @param fastStart Serve MOV/MP4 files whose moov box is at the end as
+     * a remuxed file with the moov box first, other files are served as
+     * they are
+     * @return URL in format http://127.0.0.1:port/token/filename, empty if
+     * the server isn't listening
+     */
+    QUrl addSource(iDescriptorDevice *device, afc_client_t afcClient,
+                   const QString &filePath, bool fastStart = false);
+
+    /**
+     * @brief Stop serving a file, connections streaming it are closed
+     * @param url The URL returned by addSource()
+     */
+    void removeSource(const QUrl &url);
+
+    // Playback metrics of one source over all its requests
+    struct StreamStats {
+        int requests = 0;
+        qint64 bytesServed = 0;
+        // Time spent with a response body in flight
+        qint64 streamingMs = 0;
+        // Request received to first body byte written
+        qint64 lastTimeToFirstByteMs = -1;
+        qint64 totalTimeToFirstByteMs = 0;
+        // Times the player drained the socket while nothing was read yet
+        int underruns = 0;
+        // Time to first byte of range requests that don't start at 0
+        int seeks = 0;
+        qint64 lastSeekLatencyMs = -1;
+        qint64 totalSeekLatencyMs = 0;
+
+        // Bytes per second while streaming
+        qint64 throughput() const;
+        QString toString() const;
+    };
+
+    /**
+     * @brief Metrics of a source, may be called from any thread
+     * @param url The URL returned by addSource()
      */
-    QUrl getUrl() const;
+    StreamStats stats(const QUrl &url) const;
 
     /**
      * @brief Check if the server started successfully
@@ -67,54 +131,128 @@ public:
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
 
-private slots:
-    void handleClientDisconnected();
-
 private:
     struct HttpRequest {
         QString method;
         QString path;
         QString httpVersion;
         QMap<QString, QString> headers;
-        bool hasRange = false;
-        qint64 rangeStart = 0;
-        qint64 rangeEnd = -1;
     };
 
-    struct StreamingContext {
-        QTcpSocket *socket;
+    // What prepareSource() finds out about a file on a pool thread
+    struct SourceInfo {
+        qint64 fileSize = -1;
+        quint64 mtime = 0;
+        std::shared_ptr<const FastStartLayout> layout;
+    };
+
+    // A registered file, shared with the streams reading it so removing
+    // the source doesn't pull it from under a running request
+    struct Source {
+        QString token;
         iDescriptorDevice *device;
+        afc_client_t afcClient;
         QString filePath;
+        bool fastStart = false;
+        // Only touched on the server thread, set once prepareSource() is
+        // done. -1 until then or if the file couldn't be read.
+        qint64 fileSize = -1;
+        QFuture<SourceInfo> preparing;
+        std::shared_ptr<StreamBlockCache> cache;
+        // Set in fast start mode when the file needs remuxing
+        std::shared_ptr<const FastStartLayout> layout;
+        StreamStats stats; // guarded by m_statsMutex
+
+        // Size of the file as served
+        qint64 servedSize() const
+        {
+            return layout ? layout->size() : fileSize;
+        }
+    };
+
+    struct StreamingContext {
+        std::shared_ptr<Source> source;
         qint64 startByte;
         qint64 endByte;
         qint64 bytesRemaining;
-        uint64_t afcHandle;
+        quint64 serial; // start order, older ranges are cancelled first
+        qint64 position; // next byte to send, in the served file
+        // End of the reader's current window in the served file, in fast
+        // start mode the reader is moved at every run of the original file
+        qint64 readerEnd = -1;
+        // Started when the request was parsed
+        QElapsedTimer timer;
+        qint64 accountedMs = 0; // part of timer already in the stats
+        qint64 unaccountedBytes = 0;
+        bool firstByteSent = false;
+        bool isSeek = false;
+        bool starved = false; // the current underrun is counted
+    };
+
+    struct Connection {
+        QByteArray buffer; // received bytes not parsed yet
+        bool keepAlive = false;
+        QString token; // source of the last request
+        StreamingContext *stream = nullptr; // response body in flight
+        bool waiting = false; // request held until its source is prepared
+        // Kept across requests, a range request on the same connection
+        // only moves its window
+        std::shared_ptr<ReadAheadBuffer> reader;
+        QString readerToken;
+        QElapsedTimer idle;
     };
 
+    static QString tokenFromPath(const QString &path);
     HttpRequest parseHttpRequest(const QByteArray &requestData);
+    // Resolves a single "bytes=" range against the file size, end is
+    // inclusive. False if it can't be satisfied.
+    static bool parseRange(const QString &rangeHeader, qint64 fileSize,
+                           qint64 &start, qint64 &end);
+    void onReadyRead(QTcpSocket *socket);
+    void processRequests(QTcpSocket *socket);
     void handleRequest(QTcpSocket *socket, const HttpRequest &request);
+    void respond(QTcpSocket *socket, const HttpRequest &request,
+                 const std::shared_ptr<Source> &source,
+                 const QElapsedTimer &requestTimer);
     void sendErrorResponse(QTcpSocket *socket, int statusCode,
-                           const QString &statusText);
-    void streamFileRange(QTcpSocket *socket, qint64 startByte, qint64 endByte);
-    void streamNextChunk(StreamingContext *context);
+                           const QString &statusText,
+                           const QString &extraHeaders = QString());
+    void streamFileRange(QTcpSocket *socket,
+                         const std::shared_ptr<Source> &source,
+                         qint64 startByte, qint64 endByte,
+                         const QElapsedTimer &requestTimer);
+    void streamNextChunk(QTcpSocket *socket);
+    void updateStats(StreamingContext *context, qint64 bytesWritten,
+                     bool underrun);
+    QString dumpStats() const;
+    bool seekReader(ReadAheadBuffer *reader, StreamingContext *context);
+    void finishResponse(QTcpSocket *socket);
     void cleanupStreamingContext(StreamingContext *context);
-    qint64 getFileSize();
-    QString getMimeType() const;
-
-    // Core data
-    iDescriptorDevice *m_device;
-    QString m_filePath;
-
-    // File info cache
-    mutable QMutex m_fileSizeMutex;
-    mutable qint64 m_cachedFileSize;
-    mutable bool m_fileSizeCached;
+    void closeConnection(QTcpSocket *socket);
+    void closeConnectionsFor(const QString &token);
+    void cancelSupersededRanges(QTcpSocket *socket, const QString &token);
+    void closeIdleConnections();
+    void prepareSource(QTcpSocket *socket, const HttpRequest &request,
+                       const std::shared_ptr<Source> &source,
+                       const QElapsedTimer &requestTimer);
+    static SourceInfo readSourceInfo(iDescriptorDevice *device,
+                                     afc_client_t afcClient,
+                                     const QString &filePath, bool fastStart);
+    void applySourceInfo(Source &source, const SourceInfo &info);
+    static QString getMimeType(const QString &filePath);
 
-    // Connection management
-    QList<QTcpSocket *> m_activeConnections;
-    QMutex m_connectionsMutex;
+    // Registered files by token
+    QHash<QString, std::shared_ptr<Source>> m_sources;
+    mutable QMutex m_sourcesMutex;
+    mutable QMutex m_statsMutex;
+    int m_instrumentationId = -1;
+    quint16 m_port = 0;
 
-    afc_client_t m_afcClient;
+    // Connection management, server thread only
+    QHash<QTcpSocket *, Connection> m_connections;
+    QByteArray m_chunk; // reused for every write
+    quint64 m_nextSerial = 0;
+    QTimer *m_idleTimer = nullptr;
 };
 
-#endif // MEDIASTREAMER_H
\ No newline at end of file
+#endif // MEDIASTREAMER_H
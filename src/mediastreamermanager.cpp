@@ -30,84 +30,110 @@ MediaStreamerManager *MediaStreamerManager::sharedInstance()
     return &instance;
 }
 
+// Starts the shared server on its thread the first time it is needed,
+// called with m_streamsMutex held
+bool MediaStreamerManager::ensureServer()
+{
+    if (m_server)
+        return m_server->isListening();
+
+    m_serverThread.setObjectName("MediaStreamer");
+    m_server = new MediaStreamer();
+    m_server->moveToThread(&m_serverThread);
+    QObject::connect(&m_serverThread, &QThread::finished, m_server,
+                     &QObject::deleteLater);
+    m_serverThread.start();
+
+    bool listening = false;
+    QMetaObject::invokeMethod(
+        m_server, [server = m_server]() { return server->start(); },
+        Qt::BlockingQueuedConnection, &listening);
+    if (!listening) {
+        qWarning() << "MediaStreamerManager: Failed to start the server";
+    }
+    return listening;
+}
+
 QUrl MediaStreamerManager::getStreamUrl(iDescriptorDevice *device,
                                         afc_client_t afcClient,
-                                        const QString &filePath)
+                                        const QString &filePath,
+                                        bool fastStart)
 {
-    QMutexLocker locker(&m_streamersMutex);
-
-    // Check if we already have a streamer for this file
-    auto it = m_streamers.find(filePath);
-    if (it != m_streamers.end()) {
-        // Verify the streamer is still valid and listening
-        if (it->streamer && it->streamer->isListening()) {
-            it->refCount++;
-            qDebug() << "MediaStreamerManager: Reusing existing streamer for"
-                     << filePath << "refCount:" << it->refCount;
-            return it->streamer->getUrl();
-        } else {
-            // Clean up invalid streamer
-            qDebug() << "MediaStreamerManager: Cleaning up invalid streamer for"
-                     << filePath;
-            if (it->streamer) {
-                it->streamer->deleteLater();
-            }
-            m_streamers.erase(it);
-        }
+    QMutexLocker locker(&m_streamsMutex);
+
+    // The same path can exist on two devices, both modes serve different
+    // bytes
+    const QString key = QString::fromStdString(device->udid) + ':' +
+                        filePath + (fastStart ? ":fast-start" : "");
+
+    // Check if we already serve this file
+    auto it = m_streams.find(key);
+    if (it != m_streams.end()) {
+        it->refCount++;
+        qDebug() << "MediaStreamerManager: Reusing stream for" << filePath
+                 << "refCount:" << it->refCount;
+        return it->url;
     }
 
-    // Create new streamer without a QObject parent
-    auto *streamer = new MediaStreamer(device, afcClient, filePath, nullptr);
-    if (!streamer->isListening()) {
-        qWarning() << "MediaStreamerManager: Failed to create streamer for"
-                   << filePath;
-        delete streamer;
+    if (!ensureServer()) {
         return QUrl();
     }
 
-    // Store the streamer info
-    StreamerInfo info;
-    info.streamer = streamer;
-    info.device = device;
-    info.refCount = 1;
-    m_streamers[filePath] = info;
-
-    qDebug() << "MediaStreamerManager: Created new streamer for" << filePath
-             << "at" << streamer->getUrl().toString();
+    const QUrl url =
+        m_server->addSource(device, afcClient, filePath, fastStart);
+    if (url.isEmpty()) {
+        qWarning() << "MediaStreamerManager: Failed to add stream for"
+                   << filePath;
+        return QUrl();
+    }
 
-    return streamer->getUrl();
+    m_streams.insert(key, StreamInfo{url, 1});
+    qDebug() << "MediaStreamerManager: Serving" << filePath << "at"
+             << url.toString();
+    return url;
 }
 
-void MediaStreamerManager::releaseStreamer(const QString &filePath)
+void MediaStreamerManager::releaseStreamer(const QUrl &streamUrl)
 {
-    QMutexLocker locker(&m_streamersMutex);
-    auto it = m_streamers.find(filePath);
-    if (it != m_streamers.end()) {
+    QMutexLocker locker(&m_streamsMutex);
+    for (auto it = m_streams.begin(); it != m_streams.end(); ++it) {
+        if (it->url != streamUrl)
+            continue;
+
         it->refCount--;
-        qDebug() << "MediaStreamerManager: Released streamer for" << filePath
+        qDebug() << "MediaStreamerManager: Released stream" << streamUrl
                  << "refCount:" << it->refCount;
-
-        // If no more references, delete it immediately.
-        // deleteLater() will not work in a thread without an event loop.
         if (it->refCount <= 0) {
-            qDebug() << "MediaStreamerManager: Deleting streamer for"
-                     << filePath;
-            delete it->streamer;
-            m_streamers.erase(it);
+            m_server->removeSource(streamUrl);
+            m_streams.erase(it);
         }
+        return;
     }
 }
 
+MediaStreamer::StreamStats
+MediaStreamerManager::streamStats(const QUrl &streamUrl)
+{
+    QMutexLocker locker(&m_streamsMutex);
+    if (!m_server)
+        return MediaStreamer::StreamStats();
+    return m_server->stats(streamUrl);
+}
+
 void MediaStreamerManager::cleanup()
 {
-    QMutexLocker locker(&m_streamersMutex);
-    auto it = m_streamers.begin();
-    while (it != m_streamers.end()) {
-        qDebug() << "MediaStreamerManager: Cleaning up streamer for"
+    QMutexLocker locker(&m_streamsMutex);
+    for (auto it = m_streams.cbegin(); it != m_streams.cend(); ++it) {
+        qDebug() << "MediaStreamerManager: Cleaning up stream for"
                  << it.key();
-        if (it->streamer) {
-            delete it->streamer;
-        }
-        it = m_streamers.erase(it);
+        m_server->removeSource(it->url);
     }
-}
\ No newline at end of file
+    m_streams.clear();
+
+    // The server is deleted on its own thread once the loop exits
+    if (m_server) {
+        m_serverThread.quit();
+        m_serverThread.wait();
+        m_server = nullptr;
+    }
+}
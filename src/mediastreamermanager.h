@@ -24,16 +24,17 @@
 #include "mediastreamer.h"
 #include <QMap>
 #include <QMutex>
-#include <QObject>
+#include <QThread>
 #include <QUrl>
 #include <libimobiledevice/afc.h>
 
 /**
- * @brief Singleton manager for MediaStreamer instances
+ * @brief Singleton owning the process wide MediaStreamer
  *
- * This class manages MediaStreamer instances to avoid creating multiple
- * streamers for the same file. It automatically cleans up unused streamers
- * and provides thread-safe access.
+ * Every preview is served by one HTTP server running on its own thread.
+ * Files are registered with it on demand and reference counted, so
+ * previewing the same file twice shares one URL. Opening a preview no
+ * longer costs a listening socket and port of its own.
  */
 class MediaStreamerManager
 {
@@ -45,40 +46,47 @@ public:
     static MediaStreamerManager *sharedInstance();
 
     /**
-     * @brief Get or create a streamer for the specified file
+     * @brief Get or create a stream URL for the specified file
      * @param device The iOS device
      * @param filePath The file path on the device
+     * @param fastStart Remux MOV/MP4 files with the moov box at the end,
+     * see MediaStreamer::addSource()
      * @return URL to stream the file, or empty URL if failed
      */
     QUrl getStreamUrl(iDescriptorDevice *device, afc_client_t afcClient,
-                      const QString &filePath);
+                      const QString &filePath, bool fastStart = false);
 
     /**
-     * @brief Release a streamer for the specified file
-     * @param filePath The file path to release
+     * @brief Release a stream URL returned by getStreamUrl()
+     * @param streamUrl The URL to release
      */
-    void releaseStreamer(const QString &filePath);
+    void releaseStreamer(const QUrl &streamUrl);
 
     /**
-     * @brief Clean up all inactive streamers
+     * @brief Playback metrics of a stream URL returned by getStreamUrl()
+     */
+    MediaStreamer::StreamStats streamStats(const QUrl &streamUrl);
+
+    /**
+     * @brief Stop serving every file and shut the server down
      */
     void cleanup();
 
 private:
     ~MediaStreamerManager();
+    bool ensureServer();
 
-private:
-    struct StreamerInfo {
-        MediaStreamer *streamer;
-        iDescriptorDevice *device;
+    struct StreamInfo {
+        QUrl url;
         int refCount;
     };
 
-    static MediaStreamerManager *s_instance;
-    static QMutex s_instanceMutex;
+    // Keyed by device udid, path and mode, see getStreamUrl()
+    QMap<QString, StreamInfo> m_streams;
+    QMutex m_streamsMutex;
 
-    QMap<QString, StreamerInfo> m_streamers;
-    QMutex m_streamersMutex;
+    MediaStreamer *m_server = nullptr;
+    QThread m_serverThread;
 };
 
-#endif // MEDIASTREAMERMANAGER_H
\ No newline at end of file
+#endif // MEDIASTREAMERMANAGER_H
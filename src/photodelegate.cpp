@@ -0,0 +1,130 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "photodelegate.h"
+#include "photomodel.h"
+#include <QApplication>
+#include <QFontMetrics>
+#include <QPainter>
+#include <QStyle>
+
+namespace
+{
+// Room around the thumbnail and for one line of file name below it
+const int CELL_MARGIN = 6;
+const int LABEL_SPACING = 4;
+const int VIDEO_BADGE_SIZE = 20;
+
+QPixmap scaledPlaceholder(const QString &resource, const QSize &size)
+{
+    return QPixmap(resource).scaled(size, Qt::KeepAspectRatio,
+                                    Qt::SmoothTransformation);
+}
+} // namespace
+
+PhotoDelegate::PhotoDelegate(const QSize &thumbnailSize, QObject *parent)
+    : QStyledItemDelegate(parent), m_thumbnailSize(thumbnailSize)
+{
+    const QSize placeholderSize = thumbnailSize / 2;
+    m_imagePlaceholder = scaledPlaceholder(
+        ":/resources/icons/MaterialSymbolsLightImageOutlineSharp.png",
+        placeholderSize);
+    m_videoPlaceholder = scaledPlaceholder(
+        ":/resources/icons/video-x-generic.png", placeholderSize);
+    m_videoBadge =
+        scaledPlaceholder(":/resources/icons/video-x-generic.png",
+                          QSize(VIDEO_BADGE_SIZE, VIDEO_BADGE_SIZE));
+
+    const int labelHeight = QFontMetrics(QApplication::font()).height();
+    m_cellSize = QSize(thumbnailSize.width() + 2 * CELL_MARGIN,
+                       thumbnailSize.height() + LABEL_SPACING + labelHeight +
+                           2 * CELL_MARGIN);
+}
+
+QSize PhotoDelegate::sizeHint(const QStyleOptionViewItem &option,
+                              const QModelIndex &index) const
+{
+    Q_UNUSED(option)
+    Q_UNUSED(index)
+    return m_cellSize;
+}
+
+/*
+ * No initStyleOption() here, it would look up every role of the index and
+ * build an icon for the decoration. Only the two roles that are drawn are
+ * read.
+ */
+void PhotoDelegate::paint(QPainter *painter,
+                          const QStyleOptionViewItem &option,
+                          const QModelIndex &index) const
+{
+    const QWidget *widget = option.widget;
+    QStyle *style = widget ? widget->style() : QApplication::style();
+
+    // Selection and hover background
+    style->drawPrimitive(QStyle::PE_PanelItemViewItem, &option, painter,
+                         widget);
+
+    const QRect thumbnailRect(
+        option.rect.x() + (option.rect.width() - m_thumbnailSize.width()) / 2,
+        option.rect.y() + CELL_MARGIN, m_thumbnailSize.width(),
+        m_thumbnailSize.height());
+
+    const bool isVideo = index.data(PhotoModel::IsVideoRole).toBool();
+    const QPixmap thumbnail =
+        index.data(PhotoModel::ThumbnailRole).value<QPixmap>();
+    const QPixmap &pixmap =
+        !thumbnail.isNull()
+            ? thumbnail
+            : (isVideo ? m_videoPlaceholder : m_imagePlaceholder);
+
+    // Cached thumbnails are already decoded at thumbnail size, only
+    // oversized ones get scaled down while drawing
+    QSize pixmapSize = pixmap.deviceIndependentSize().toSize();
+    if (pixmapSize.width() > m_thumbnailSize.width() ||
+        pixmapSize.height() > m_thumbnailSize.height()) {
+        pixmapSize.scale(m_thumbnailSize, Qt::KeepAspectRatio);
+    }
+    QRect pixmapRect(QPoint(), pixmapSize);
+    pixmapRect.moveCenter(thumbnailRect.center());
+    painter->drawPixmap(pixmapRect, pixmap);
+
+    if (isVideo && !thumbnail.isNull()) {
+        const QRect badgeRect(pixmapRect.right() - VIDEO_BADGE_SIZE - 2,
+                              pixmapRect.bottom() - VIDEO_BADGE_SIZE - 2,
+                              VIDEO_BADGE_SIZE, VIDEO_BADGE_SIZE);
+        painter->drawPixmap(badgeRect, m_videoBadge);
+    }
+
+    const QRect labelRect(option.rect.x() + CELL_MARGIN,
+                          thumbnailRect.bottom() + LABEL_SPACING,
+                          option.rect.width() - 2 * CELL_MARGIN,
+                          option.fontMetrics.height());
+    const QString label = option.fontMetrics.elidedText(
+        index.data(Qt::DisplayRole).toString(), Qt::ElideMiddle,
+        labelRect.width());
+
+    const QPalette::ColorRole textRole = option.state & QStyle::State_Selected
+                                             ? QPalette::HighlightedText
+                                             : QPalette::Text;
+    painter->save();
+    painter->setPen(option.palette.color(textRole));
+    painter->drawText(labelRect, Qt::AlignHCenter | Qt::AlignTop, label);
+    painter->restore();
+}
@@ -0,0 +1,56 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PHOTODELEGATE_H
+#define PHOTODELEGATE_H
+
+#include <QPixmap>
+#include <QSize>
+#include <QStyledItemDelegate>
+
+/**
+ * @brief Paints gallery cells straight from the thumbnail cache.
+ *
+ * Every cell has the same size, so the view only has to ask for one size
+ * hint. The thumbnail comes from PhotoModel::ThumbnailRole as a QPixmap and
+ * is drawn as is, placeholders for rows that are still loading are scaled
+ * once up front instead of being rebuilt on every paint.
+ */
+class PhotoDelegate : public QStyledItemDelegate
+{
+    Q_OBJECT
+
+public:
+    explicit PhotoDelegate(const QSize &thumbnailSize,
+                           QObject *parent = nullptr);
+
+    void paint(QPainter *painter, const QStyleOptionViewItem &option,
+               const QModelIndex &index) const override;
+    QSize sizeHint(const QStyleOptionViewItem &option,
+                   const QModelIndex &index) const override;
+
+private:
+    QSize m_thumbnailSize;
+    QSize m_cellSize;
+    QPixmap m_imagePlaceholder;
+    QPixmap m_videoPlaceholder;
+    QPixmap m_videoBadge;
+};
+
+#endif // PHOTODELEGATE_H
@@ -21,14 +21,19 @@
 #include "httpserver.h"
 #include <QApplication>
 #include <QDateTime>
+#include <QDir>
 #include <QFileInfo>
 #include <QMessageBox>
 #include <QNetworkInterface>
 #include <QPainter>
 #include <QPixmap>
 #include <QRandomGenerator>
+#include <QStandardPaths>
 #include <qrencode.h>
 
+// Long edge and JPEG quality of the "smaller copies" option
+const ImageVariant SMALLER_IMAGES{2048, 85, true};
+
 PhotoImportDialog::PhotoImportDialog(const QStringList &files,
                                      bool hasDirectories, QWidget *parent)
     : QDialog(parent), selectedFiles(files),
@@ -76,6 +81,32 @@ void PhotoImportDialog::setupUI()
     }
     mainLayout->addWidget(fileList);
 
+    // Phones rarely need the full resolution of a DSLR photo, smaller
+    // copies make the import a lot faster over Wi-Fi
+    smallerImagesCheckBox = new QCheckBox(
+        "Send smaller copies of images (2048 px JPEG)", this);
+    mainLayout->addWidget(smallerImagesCheckBox);
+    connect(smallerImagesCheckBox, &QCheckBox::toggled, this,
+            [this](bool checked) {
+                if (!m_httpServer)
+                    return;
+                m_httpServer->setImageVariant(checked ? SMALLER_IMAGES
+                                                      : ImageVariant());
+            });
+
+    // Off unless asked for, the server is reachable from the whole network
+    uploadsCheckBox = new QCheckBox(
+        QString("Let the phone send files back (saved to %1)")
+            .arg(QDir::toNativeSeparators(uploadDirectory())),
+        this);
+    mainLayout->addWidget(uploadsCheckBox);
+    connect(uploadsCheckBox, &QCheckBox::toggled, this, [this](bool checked) {
+        if (!m_httpServer)
+            return;
+        m_httpServer->setUploadDirectory(checked ? uploadDirectory()
+                                                 : QString());
+    });
+
     // QR Code area
     qrCodeLabel = new QLabel(this);
     qrCodeLabel->setAlignment(Qt::AlignCenter);
@@ -124,6 +155,15 @@ void PhotoImportDialog::init()
             &PhotoImportDialog::onServerError);
     connect(m_httpServer, &HttpServer::downloadProgress, this,
             &PhotoImportDialog::onDownloadProgress);
+    connect(m_httpServer, &HttpServer::uploadProgress, this,
+            &PhotoImportDialog::onUploadProgress);
+    connect(m_httpServer, &HttpServer::uploadFinished, this,
+            &PhotoImportDialog::onUploadFinished);
+    if (smallerImagesCheckBox->isChecked())
+        m_httpServer->setImageVariant(SMALLER_IMAGES);
+    // Files the phone sends back while the server runs
+    if (uploadsCheckBox->isChecked())
+        m_httpServer->setUploadDirectory(uploadDirectory());
 
     m_httpServer->start(selectedFiles);
 }
@@ -156,11 +196,40 @@ void PhotoImportDialog::onServerStarted()
 }
 
 void PhotoImportDialog::onDownloadProgress(const QString &fileName,
-                                           int bytesDownloaded, int totalBytes)
+                                           qint64 bytesDownloaded,
+                                           qint64 totalBytes)
+{
+    const QString verb =
+        bytesDownloaded < totalBytes ? "Downloading" : "Downloaded";
+    progressLabel->setText(QString("%1: %2 (%3 of %4 KB)")
+                               .arg(verb, fileName)
+                               .arg(bytesDownloaded / 1024)
+                               .arg(totalBytes / 1024));
+}
+
+void PhotoImportDialog::onUploadProgress(const QString &fileName,
+                                         qint64 bytesReceived,
+                                         qint64 totalBytes)
 {
-    progressLabel->setText(QString("Downloaded: %1 (%2 KB)")
+    progressLabel->setVisible(true);
+    if (totalBytes < 0) {
+        progressLabel->setText(QString("Receiving: %1 (%2 KB)")
+                                   .arg(fileName)
+                                   .arg(bytesReceived / 1024));
+        return;
+    }
+    progressLabel->setText(QString("Receiving: %1 (%2 of %3 KB)")
                                .arg(fileName)
-                               .arg(bytesDownloaded / 1024));
+                               .arg(bytesReceived / 1024)
+                               .arg(totalBytes / 1024));
+}
+
+void PhotoImportDialog::onUploadFinished(const QString &fileName,
+                                         const QString &filePath)
+{
+    progressLabel->setVisible(true);
+    progressLabel->setText(QString("Received: %1 (saved to %2)")
+                               .arg(fileName, filePath));
 }
 
 void PhotoImportDialog::onServerError(const QString &error)
@@ -173,6 +242,13 @@ void PhotoImportDialog::onServerError(const QString &error)
     QDialog::reject();
 }
 
+QString PhotoImportDialog::uploadDirectory()
+{
+    return QStandardPaths::writableLocation(
+               QStandardPaths::PicturesLocation) +
+           "/iDescriptor";
+}
+
 void PhotoImportDialog::generateQRCode(const QString &url)
 {
     QRcode *qrcode = QRcode_encodeString(url.toUtf8().constData(), 0,
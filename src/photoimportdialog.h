@@ -21,6 +21,7 @@
 #define PHOTOIMPORTDIALOG_H
 
 #include "httpserver.h"
+#include <QCheckBox>
 #include <QDialog>
 #include <QHBoxLayout>
 #include <QLabel>
@@ -43,8 +44,11 @@ private slots:
     void init();
     void onServerStarted();
     void onServerError(const QString &error);
-    void onDownloadProgress(const QString &fileName, int bytesDownloaded,
-                            int totalBytes);
+    void onDownloadProgress(const QString &fileName, qint64 bytesDownloaded,
+                            qint64 totalBytes);
+    void onUploadProgress(const QString &fileName, qint64 bytesReceived,
+                          qint64 totalBytes);
+    void onUploadFinished(const QString &fileName, const QString &filePath);
 
 private:
     QStringList selectedFiles;
@@ -57,12 +61,15 @@ private:
     QPushButton *m_cancelButton;
     QProgressBar *progressBar;
     QLabel *progressLabel;
+    QCheckBox *smallerImagesCheckBox;
+    QCheckBox *uploadsCheckBox;
 
     HttpServer *m_httpServer;
 
     void setupUI();
     void generateQRCode(const QString &url);
     QString getLocalIP() const;
+    static QString uploadDirectory();
 };
 
 #endif // PHOTOIMPORTDIALOG_H
@@ -0,0 +1,467 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "photolibraryindex.h"
+#include "servicemanager.h"
+#include "settingsmanager.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QRegularExpression>
+#include <QSettings>
+#include <algorithm>
+#include <sqlite3.h>
+
+/*
+    Schema notes (see
+    https://github.com/ScottKjr3347/iOS_Local_PL_Photos.sqlite_Queries):
+    - iOS 14+ stores assets in ZASSET, older versions in ZGENERICASSET
+    - ZDATECREATED is a Core Data timestamp (seconds since 2001-01-01 UTC)
+    - ZKIND is 0 for photos and 1 for videos
+    - User albums live in ZGENERICALBUM (ZKIND 2) and are joined to assets
+      through a Z_<n>ASSETS table whose numbering differs between iOS versions
+*/
+
+#define PHOTO_DATA_DIR "/PhotoData"
+#define PHOTOS_DB_NAME "Photos.sqlite"
+#define PHOTOS_WAL_NAME "Photos.sqlite-wal"
+#define CORE_DATA_EPOCH_OFFSET 978307200LL
+
+namespace
+{
+
+struct DeviceFileStat {
+    bool exists = false;
+    uint64_t size = 0;
+    uint64_t mtime = 0;
+};
+
+DeviceFileStat statDeviceFile(iDescriptorDevice *device, const QString &path)
+{
+    DeviceFileStat stat;
+    plist_t info = nullptr;
+    afc_error_t err = ServiceManager::safeAfcGetFileInfoPlist(
+        device, path.toUtf8().constData(), &info);
+    if (err != AFC_E_SUCCESS || !info) {
+        return stat;
+    }
+
+    PlistNavigator nav(info);
+    stat.exists = true;
+    stat.size = nav["st_size"].getUInt();
+    stat.mtime = nav["st_mtime"].getUInt();
+    plist_free(info);
+    return stat;
+}
+
+bool copyDeviceFile(iDescriptorDevice *device, const QString &devicePath,
+                    const QString &localPath)
+{
+    uint64_t handle = 0;
+    afc_error_t openResult = ServiceManager::safeAfcFileOpen(
+        device, devicePath.toUtf8().constData(), AFC_FOPEN_RDONLY, &handle);
+    if (openResult != AFC_E_SUCCESS || handle == 0) {
+        qDebug() << "PhotoLibraryIndex: could not open" << devicePath
+                 << "Error:" << openResult;
+        return false;
+    }
+
+    QFile out(localPath);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "PhotoLibraryIndex: could not create" << localPath
+                   << out.errorString();
+        ServiceManager::safeAfcFileClose(device, handle);
+        return false;
+    }
+
+    const uint32_t CHUNK_SIZE = 1024 * 1024;
+    QByteArray buffer(CHUNK_SIZE, Qt::Uninitialized);
+    bool ok = true;
+
+    while (true) {
+        uint32_t bytesRead = 0;
+        afc_error_t readResult = ServiceManager::safeAfcFileRead(
+            device, handle, buffer.data(), CHUNK_SIZE, &bytesRead);
+        if (readResult != AFC_E_SUCCESS) {
+            qWarning() << "PhotoLibraryIndex: read failed for" << devicePath
+                       << "Error:" << readResult;
+            ok = false;
+            break;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        if (out.write(buffer.constData(), bytesRead) != bytesRead) {
+            qWarning() << "PhotoLibraryIndex: write failed for" << localPath;
+            ok = false;
+            break;
+        }
+    }
+
+    ServiceManager::safeAfcFileClose(device, handle);
+    out.close();
+    if (!ok) {
+        out.remove();
+    }
+    return ok;
+}
+
+QString columnText(sqlite3_stmt *stmt, int column)
+{
+    const unsigned char *text = sqlite3_column_text(stmt, column);
+    return text ? QString::fromUtf8(reinterpret_cast<const char *>(text))
+                : QString();
+}
+
+QStringList queryStrings(sqlite3 *db, const QString &sql, int column)
+{
+    QStringList result;
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.toUtf8().constData(), -1, &stmt,
+                           nullptr) != SQLITE_OK) {
+        return result;
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        result.append(columnText(stmt, column));
+    }
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+QStringList tableNames(sqlite3 *db)
+{
+    return queryStrings(
+        db, "SELECT name FROM sqlite_master WHERE type = 'table'", 0);
+}
+
+QStringList columnNames(sqlite3 *db, const QString &table)
+{
+    // PRAGMA table_info rows: cid, name, type, notnull, dflt_value, pk
+    return queryStrings(db, QString("PRAGMA table_info(%1)").arg(table), 1);
+}
+
+} // namespace
+
+PhotoLibraryIndex::PhotoLibraryIndex(iDescriptorDevice *device)
+    : m_device(device)
+{
+}
+
+bool PhotoLibraryIndex::load()
+{
+    if (!m_device) {
+        return false;
+    }
+
+    const QString cacheDir =
+        QDir(SettingsManager::cachePath())
+            .filePath(QString("photolibrary/%1")
+                          .arg(QString::fromStdString(m_device->udid)));
+    if (!QDir().mkpath(cacheDir)) {
+        qWarning() << "PhotoLibraryIndex: could not create" << cacheDir;
+        return false;
+    }
+
+    if (!copyDatabase(cacheDir)) {
+        return false;
+    }
+
+    const QString dbPath = QDir(cacheDir).filePath(PHOTOS_DB_NAME);
+    sqlite3 *db = nullptr;
+    if (sqlite3_open_v2(dbPath.toUtf8().constData(), &db,
+                        SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+        qWarning() << "PhotoLibraryIndex: could not open database"
+                   << sqlite3_errmsg(db);
+        sqlite3_close(db);
+        return false;
+    }
+
+    const bool ok = queryAssets(db);
+    if (ok) {
+        queryUserAlbums(db);
+    }
+    sqlite3_close(db);
+
+    if (ok) {
+        qDebug() << "PhotoLibraryIndex: indexed" << m_assets.size()
+                 << "assets in" << m_directories.size() << "folders and"
+                 << m_userAlbums.size() << "user albums";
+        m_loaded = true;
+    }
+    return ok;
+}
+
+/*
+    Only re-copies the database when its size or mtime on the device differs
+    from the last copy, so reopening the gallery does not pull hundreds of
+    megabytes over AFC every time.
+*/
+bool PhotoLibraryIndex::copyDatabase(const QString &cacheDir)
+{
+    const QString dbDevicePath =
+        QString(PHOTO_DATA_DIR) + "/" + PHOTOS_DB_NAME;
+    const QString walDevicePath =
+        QString(PHOTO_DATA_DIR) + "/" + PHOTOS_WAL_NAME;
+
+    DeviceFileStat dbStat = statDeviceFile(m_device, dbDevicePath);
+    if (!dbStat.exists || dbStat.size == 0) {
+        qDebug() << "PhotoLibraryIndex: Photos.sqlite is not accessible";
+        return false;
+    }
+    DeviceFileStat walStat = statDeviceFile(m_device, walDevicePath);
+
+    QDir dir(cacheDir);
+    const QString dbLocalPath = dir.filePath(PHOTOS_DB_NAME);
+    const QString walLocalPath = dir.filePath(PHOTOS_WAL_NAME);
+
+    QSettings source(dir.filePath("source.ini"), QSettings::IniFormat);
+    const bool upToDate =
+        QFile::exists(dbLocalPath) &&
+        source.value("db/size").toULongLong() == dbStat.size &&
+        source.value("db/mtime").toULongLong() == dbStat.mtime &&
+        source.value("wal/size").toULongLong() == walStat.size &&
+        source.value("wal/mtime").toULongLong() == walStat.mtime;
+    if (upToDate) {
+        qDebug() << "PhotoLibraryIndex: using cached Photos.sqlite";
+        return true;
+    }
+
+    // The shared-memory index is rebuilt by sqlite from the WAL
+    QFile::remove(dir.filePath("Photos.sqlite-shm"));
+    QFile::remove(walLocalPath);
+
+    if (!copyDeviceFile(m_device, dbDevicePath, dbLocalPath)) {
+        return false;
+    }
+    if (walStat.exists && walStat.size > 0 &&
+        !copyDeviceFile(m_device, walDevicePath, walLocalPath)) {
+        // Without the WAL we only miss the most recent changes
+        qDebug() << "PhotoLibraryIndex: continuing without WAL";
+    }
+
+    source.setValue("db/size", static_cast<qulonglong>(dbStat.size));
+    source.setValue("db/mtime", static_cast<qulonglong>(dbStat.mtime));
+    source.setValue("wal/size", static_cast<qulonglong>(walStat.size));
+    source.setValue("wal/mtime", static_cast<qulonglong>(walStat.mtime));
+    source.sync();
+    return true;
+}
+
+bool PhotoLibraryIndex::queryAssets(sqlite3 *db)
+{
+    const QStringList tables = tableNames(db);
+
+    QString assetTable;
+    if (tables.contains("ZASSET")) {
+        assetTable = "ZASSET";
+    } else if (tables.contains("ZGENERICASSET")) {
+        assetTable = "ZGENERICASSET";
+    } else {
+        qWarning() << "PhotoLibraryIndex: no asset table found";
+        return false;
+    }
+
+    const QString sql =
+        QString("SELECT Z_PK, ZDIRECTORY, ZFILENAME, ZDATECREATED, ZWIDTH, "
+                "ZHEIGHT, ZKIND, ZFAVORITE FROM %1 "
+                "WHERE ZDIRECTORY LIKE 'DCIM/%' AND ZFILENAME IS NOT NULL")
+            .arg(assetTable);
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.toUtf8().constData(), -1, &stmt,
+                           nullptr) != SQLITE_OK) {
+        qWarning() << "PhotoLibraryIndex: asset query failed"
+                   << sqlite3_errmsg(db);
+        return false;
+    }
+
+    m_assets.clear();
+    m_assetByPath.clear();
+    m_directories.clear();
+    m_primaryKeys.clear();
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const QString directory = "/" + columnText(stmt, 1);
+
+        PhotoLibraryAsset asset;
+        asset.filePath = directory + "/" + columnText(stmt, 2);
+        if (sqlite3_column_type(stmt, 3) != SQLITE_NULL) {
+            const double created = sqlite3_column_double(stmt, 3);
+            asset.captureTime = static_cast<qint64>(
+                (created + CORE_DATA_EPOCH_OFFSET) * 1000.0);
+        }
+        asset.width = sqlite3_column_int(stmt, 4);
+        asset.height = sqlite3_column_int(stmt, 5);
+        asset.isVideo = sqlite3_column_int(stmt, 6) == 1;
+        asset.favorite = sqlite3_column_int(stmt, 7) != 0;
+
+        const int index = m_assets.size();
+        m_assets.append(asset);
+        m_assetByPath.insert(asset.filePath, index);
+        m_directories[directory].append(index);
+        m_primaryKeys.insert(sqlite3_column_int64(stmt, 0), index);
+    }
+    sqlite3_finalize(stmt);
+
+    return true;
+}
+
+void PhotoLibraryIndex::queryUserAlbums(sqlite3 *db)
+{
+    const QStringList tables = tableNames(db);
+    m_userAlbums.clear();
+
+    if (!tables.contains("ZGENERICALBUM")) {
+        return;
+    }
+
+    // Find the album <-> asset join table, e.g. Z_28ASSETS(Z_28ALBUMS,
+    // Z_3ASSETS)
+    static const QRegularExpression joinTableRegex(R"(^Z_\d+ASSETS$)");
+    static const QRegularExpression albumColumnRegex(R"(^Z_\d+ALBUMS$)");
+    QString joinTable, albumColumn, assetColumn;
+    for (const QString &table : tables) {
+        if (!joinTableRegex.match(table).hasMatch()) {
+            continue;
+        }
+        QString albums, assets;
+        for (const QString &field : columnNames(db, table)) {
+            if (albumColumnRegex.match(field).hasMatch()) {
+                albums = field;
+            } else if (joinTableRegex.match(field).hasMatch()) {
+                assets = field;
+            }
+        }
+        if (!albums.isEmpty() && !assets.isEmpty()) {
+            joinTable = table;
+            albumColumn = albums;
+            assetColumn = assets;
+            break;
+        }
+    }
+
+    if (joinTable.isEmpty()) {
+        qDebug() << "PhotoLibraryIndex: album join table not found";
+        return;
+    }
+
+    QString albumFilter = "a.ZKIND = 2 AND a.ZTITLE IS NOT NULL";
+    if (columnNames(db, "ZGENERICALBUM").contains("ZTRASHEDSTATE")) {
+        albumFilter += " AND a.ZTRASHEDSTATE = 0";
+    }
+
+    const QString sql = QString("SELECT a.Z_PK, a.ZTITLE, j.%1 "
+                                "FROM ZGENERICALBUM a JOIN %2 j "
+                                "ON j.%3 = a.Z_PK WHERE %4 ORDER BY a.Z_PK")
+                            .arg(assetColumn, joinTable, albumColumn,
+                                 albumFilter);
+    sqlite3_stmt *stmt = nullptr;
+    if (sqlite3_prepare_v2(db, sql.toUtf8().constData(), -1, &stmt,
+                           nullptr) != SQLITE_OK) {
+        qWarning() << "PhotoLibraryIndex: album query failed"
+                   << sqlite3_errmsg(db);
+        return;
+    }
+
+    qint64 currentAlbum = -1;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const qint64 albumPk = sqlite3_column_int64(stmt, 0);
+        if (albumPk != currentAlbum) {
+            PhotoLibraryAlbum album;
+            album.title = columnText(stmt, 1);
+            album.kind = PhotoLibraryAlbum::User;
+            m_userAlbums.append(album);
+            currentAlbum = albumPk;
+        }
+
+        auto it = m_primaryKeys.constFind(sqlite3_column_int64(stmt, 2));
+        if (it != m_primaryKeys.constEnd()) {
+            m_userAlbums.last().assetPaths.append(
+                m_assets.at(it.value()).filePath);
+        }
+    }
+    sqlite3_finalize(stmt);
+}
+
+const PhotoLibraryAsset *
+PhotoLibraryIndex::asset(const QString &filePath) const
+{
+    if (!isLoaded()) {
+        return nullptr;
+    }
+    auto it = m_assetByPath.constFind(filePath);
+    return it != m_assetByPath.constEnd() ? &m_assets.at(it.value())
+                                          : nullptr;
+}
+
+QList<PhotoLibraryAsset>
+PhotoLibraryIndex::assetsInDirectory(const QString &directory) const
+{
+    QList<PhotoLibraryAsset> result;
+    if (!isLoaded()) {
+        return result;
+    }
+    const QList<int> indices = m_directories.value(directory);
+    result.reserve(indices.size());
+    for (int index : indices) {
+        result.append(m_assets.at(index));
+    }
+    return result;
+}
+
+QList<PhotoLibraryAlbum> PhotoLibraryIndex::albums() const
+{
+    QList<PhotoLibraryAlbum> result;
+    if (!isLoaded()) {
+        return result;
+    }
+
+    for (auto it = m_directories.constBegin(); it != m_directories.constEnd();
+         ++it) {
+        PhotoLibraryAlbum album;
+        album.kind = PhotoLibraryAlbum::Folder;
+        album.directory = it.key();
+        album.title = it.key().section('/', -1);
+
+        // Newest first so the first path doubles as the album cover
+        QList<int> indices = it.value();
+        std::sort(indices.begin(), indices.end(), [this](int a, int b) {
+            return m_assets.at(a).captureTime > m_assets.at(b).captureTime;
+        });
+        album.assetPaths.reserve(indices.size());
+        for (int index : indices) {
+            album.assetPaths.append(m_assets.at(index).filePath);
+        }
+        result.append(album);
+    }
+
+    PhotoLibraryAlbum favorites;
+    favorites.kind = PhotoLibraryAlbum::Favorites;
+    favorites.title = "Favorites";
+    for (const PhotoLibraryAsset &asset : m_assets) {
+        if (asset.favorite) {
+            favorites.assetPaths.append(asset.filePath);
+        }
+    }
+    if (!favorites.assetPaths.isEmpty()) {
+        result.append(favorites);
+    }
+
+    result.append(m_userAlbums);
+    return result;
+}
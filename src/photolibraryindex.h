@@ -0,0 +1,93 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PHOTOLIBRARYINDEX_H
+#define PHOTOLIBRARYINDEX_H
+
+#include "iDescriptor.h"
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+
+struct sqlite3;
+
+struct PhotoLibraryAsset {
+    QString filePath;       // AFC path, e.g. /DCIM/100APPLE/IMG_0001.HEIC
+    qint64 captureTime = 0; // msecs since epoch (UTC), 0 if unknown
+    int width = 0;
+    int height = 0;
+    bool isVideo = false;
+    bool favorite = false;
+};
+
+struct PhotoLibraryAlbum {
+    enum Kind { Folder, User, Favorites };
+
+    QString title;
+    Kind kind = Folder;
+    // For Folder albums this is the DCIM directory, e.g. /DCIM/100APPLE
+    QString directory;
+    QStringList assetPaths;
+};
+
+/**
+ * @brief Local index of the device photo library backed by Photos.sqlite
+ *
+ * Copies PhotoData/Photos.sqlite (and its WAL) from the device via AFC into
+ * the local cache and queries it once, so albums, capture dates, dimensions,
+ * media type and favorites are available without statting every file in
+ * DCIM. The copy is only refreshed when the files on the device change.
+ *
+ * load() blocks on AFC and sqlite, call it from a worker thread. All other
+ * accessors are only valid once load() has returned true.
+ */
+class PhotoLibraryIndex
+{
+public:
+    explicit PhotoLibraryIndex(iDescriptorDevice *device);
+
+    bool load();
+    bool isLoaded() const { return m_loaded.load(); }
+
+    const PhotoLibraryAsset *asset(const QString &filePath) const;
+    QList<PhotoLibraryAsset> assetsInDirectory(const QString &directory) const;
+    QList<PhotoLibraryAlbum> albums() const;
+    int assetCount() const { return m_assets.size(); }
+
+private:
+    bool copyDatabase(const QString &cacheDir);
+    bool queryAssets(sqlite3 *db);
+    void queryUserAlbums(sqlite3 *db);
+
+    iDescriptorDevice *m_device;
+    std::atomic<bool> m_loaded{false};
+
+    QList<PhotoLibraryAsset> m_assets;
+    QHash<QString, int> m_assetByPath;
+    // Directory -> indices into m_assets, ordered by directory name
+    QMap<QString, QList<int>> m_directories;
+    // Z_PK -> index into m_assets, used to resolve album membership
+    QHash<qint64, int> m_primaryKeys;
+    QList<PhotoLibraryAlbum> m_userAlbums;
+};
+
+#endif // PHOTOLIBRARYINDEX_H
@@ -18,40 +18,94 @@
  */
 
 #include "photomodel.h"
+#include "capturedate.h"
 #include "iDescriptor.h"
 #include "mediastreamermanager.h"
 #include "servicemanager.h"
+#include "thumbnailcache.h"
+#include "videoposterframe.h"
 #include <QDebug>
 #include <QEventLoop>
-#include <QIcon>
 #include <QImage>
 #include <QImageReader>
 #include <QMediaPlayer>
 #include <QPixmap>
-#include <QRegularExpression>
 #include <QSemaphore>
 #include <QTimer>
 #include <QVideoFrame>
 #include <QVideoSink>
 #include <QtConcurrent/QtConcurrent>
-extern "C" {
-#include <libavcodec/avcodec.h>
-#include <libavformat/avformat.h>
-#include <libavutil/imgutils.h>
-#include <libswscale/swscale.h>
-}
 
 // Limit concurrent video thumbnail generation to 2 to prevent resource
 // exhaustion
 QSemaphore PhotoModel::m_videoThumbnailSemaphore(4);
 
+namespace
+{
+// The first batch is kept small so the first screenful shows up right away
+constexpr int FIRST_BATCH_SIZE = 64;
+constexpr int BATCH_SIZE = 512;
+// Dates that have to be read from the files are fetched and posted in chunks
+// of this size
+constexpr int DATE_CHUNK_SIZE = 32;
+// Resorting is coalesced so a big album doesn't relayout on every chunk
+constexpr int DATE_FLUSH_INTERVAL_MS = 250;
+// Rows prefetched past the visible range in the scroll direction, at least
+// this many or half a screen
+constexpr int MIN_LOOKAHEAD_ROWS = 12;
+// Filter changes that would take more insert/remove runs than this (photos
+// and videos interleaved) are applied as a reset instead
+constexpr int MAX_FILTER_RUNS = 256;
+// Upper bound for prefetchRows(), about two screens of thumbnails
+constexpr int MAX_PREFETCH_ROWS = 96;
+
+// Capture dates are read with a couple of threads so they don't take the
+// whole global pool away from the rest of the app
+QThreadPool *captureDatePool()
+{
+    static QThreadPool *pool = [] {
+        auto *pool = new QThreadPool();
+        pool->setMaxThreadCount(2);
+        return pool;
+    }();
+    return pool;
+}
+} // namespace
+
 PhotoModel::PhotoModel(iDescriptorDevice *device, FilterType filterType,
                        QObject *parent)
     : QAbstractListModel(parent), m_device(device), m_thumbnailSize(120, 120),
-      m_sortOrder(NewestFirst), m_filterType(filterType)
+      m_sortOrder(NewestFirst), m_filterType(filterType),
+      m_dateFlushTimer(new QTimer(this))
 {
-    // 350 MB cache for thumbnails
-    m_thumbnailCache.setMaxCost(350 * 1024 * 1024);
+    m_thumbnailScheduler = new ThumbnailScheduler(
+        [device, size = m_thumbnailSize](const QString &filePath,
+                                         bool isVideo) {
+            QImage thumbnail;
+            if (!isVideo) {
+                thumbnail = loadThumbnailFromDevice(device, filePath, size);
+            } else {
+                // Limit concurrent video processing
+                m_videoThumbnailSemaphore.acquire();
+                thumbnail = VideoPosterFrame::extract(device, filePath, size);
+                m_videoThumbnailSemaphore.release();
+            }
+
+            // Compress while still off the GUI thread
+            if (!thumbnail.isNull()) {
+                ThumbnailCache::sharedInstance()->insertCompressed(
+                    ThumbnailCache::key(device, filePath), thumbnail);
+            }
+            return thumbnail;
+        },
+        this);
+    connect(m_thumbnailScheduler, &ThumbnailScheduler::thumbnailReady, this,
+            &PhotoModel::onThumbnailReady, Qt::QueuedConnection);
+
+    m_dateFlushTimer->setSingleShot(true);
+    m_dateFlushTimer->setInterval(DATE_FLUSH_INTERVAL_MS);
+    connect(m_dateFlushTimer, &QTimer::timeout, this,
+            &PhotoModel::flushPendingDates);
 
     connect(this, &PhotoModel::thumbnailNeedsToBeLoaded, this,
             &PhotoModel::requestThumbnail, Qt::QueuedConnection);
@@ -59,476 +113,235 @@ PhotoModel::PhotoModel(iDescriptorDevice *device, FilterType filterType,
 
 void PhotoModel::clear()
 {
-    // Clean up any active watchers
-    for (auto *watcher : m_activeLoaders.values()) {
-        if (watcher) {
-            watcher->cancel();
-            watcher->waitForFinished();
-            watcher->deleteLater();
-        }
-    }
-    m_activeLoaders.clear();
-    m_loadingPaths.clear();
-    m_thumbnailCache.clear();
+    // A cancelled population leaves the album half listed, forget the path so
+    // selecting the same album again lists it from scratch
+    cancelPopulation();
+    m_albumPaths.clear();
+    m_assetPaths.clear();
+
+    // Thumbnails stay in the shared ThumbnailCache for the next time the
+    // album is opened
+    m_thumbnailScheduler->cancelAll();
+    m_failedThumbnails.clear();
+    m_visibleFirst = -1;
+    m_visibleLast = -1;
+    m_prefetchFirst = -1;
+    m_prefetchLast = -1;
 }
 
 PhotoModel::~PhotoModel()
 {
     qDebug() << "PhotoModel destructor called";
     clear();
+    // Workers post back to this model, they have to be gone before it is
+    for (QFuture<void> &future : m_populateFutures) {
+        future.waitForFinished();
+    }
+    // Wait for running loads before the model goes away
+    delete m_thumbnailScheduler;
 }
 
-QPixmap PhotoModel::generateVideoThumbnailFFmpeg(iDescriptorDevice *device,
-                                                 const QString &filePath,
-                                                 const QSize &requestedSize)
+int PhotoModel::rowCount(const QModelIndex &parent) const
 {
-    QPixmap thumbnail;
-
-    uint64_t fileHandle = 0;
-
-    afc_error_t openResult = ServiceManager::safeAfcFileOpen(
-        device, filePath.toUtf8().constData(), AFC_FOPEN_RDONLY, &fileHandle);
-
-    if (openResult != AFC_E_SUCCESS || fileHandle == 0) {
-        qWarning() << "Failed to open video file for thumbnail:" << filePath;
-        return {};
-    }
-
-    // Get file size
-    char **fileInfo = nullptr;
-    afc_error_t infoResult = ServiceManager::safeAfcGetFileInfo(
-        device, filePath.toUtf8().constData(), &fileInfo);
-
-    uint64_t fileSize = 0;
-    if (infoResult == AFC_E_SUCCESS && fileInfo) {
-        for (int i = 0; fileInfo[i]; i += 2) {
-            if (strcmp(fileInfo[i], "st_size") == 0) {
-                fileSize = strtoull(fileInfo[i + 1], nullptr, 10);
-                break;
-            }
-        }
-        afc_dictionary_free(fileInfo);
-    }
-
-    if (fileSize == 0) {
-        ServiceManager::safeAfcFileClose(device, fileHandle);
-        qWarning() << "Invalid video file size for thumbnail:" << filePath;
-        return {};
-    }
-
-    // Create custom AVIOContext for reading from device on-demand
-    AVFormatContext *formatCtx = avformat_alloc_context();
-    if (!formatCtx) {
-        ServiceManager::safeAfcFileClose(device, fileHandle);
-        qWarning() << "Failed to allocate format context";
-        return {};
-    }
-
-    // Context for streaming read from device
-    struct StreamContext {
-        iDescriptorDevice *device;
-        uint64_t fileHandle;
-        uint64_t fileSize;
-        uint64_t currentPos;
-    };
+    Q_UNUSED(parent)
+    return m_rows.size();
+}
 
-    StreamContext *streamCtx =
-        new StreamContext{device, fileHandle, fileSize, 0};
+QVariant PhotoModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_rows.size())
+        return QVariant();
 
-    // Custom read function that reads from device on-demand
-    auto readPacket = [](void *opaque, uint8_t *buf, int bufSize) -> int {
-        StreamContext *ctx = static_cast<StreamContext *>(opaque);
+    const int id = m_rows.at(index.row());
+    const QString &fileName = m_store.fileName(id);
 
-        if (ctx->currentPos >= ctx->fileSize) {
-            return AVERROR_EOF;
-        }
+    switch (role) {
+    case Qt::DisplayRole:
+        return fileName;
 
-        uint32_t toRead =
-            std::min(static_cast<uint32_t>(bufSize),
-                     static_cast<uint32_t>(ctx->fileSize - ctx->currentPos));
-        uint32_t bytesRead = 0;
+    case FilePathRole:
+        return m_store.filePath(id);
 
-        afc_error_t result = ServiceManager::safeAfcFileRead(
-            ctx->device, ctx->fileHandle, reinterpret_cast<char *>(buf), toRead,
-            &bytesRead);
+    case IsVideoRole:
+        return m_store.fileType(id) == PhotoInfo::Video;
 
-        if (result != AFC_E_SUCCESS || bytesRead == 0) {
-            return AVERROR(EIO);
+    // Asked for every visible cell on every repaint, so no logging and no
+    // QIcon here. Placeholders are up to the delegate.
+    case ThumbnailRole:
+    case Qt::DecorationRole: {
+        const QString filePath = m_store.filePath(id);
+        QPixmap thumbnail;
+        if (ThumbnailCache::sharedInstance()->find(
+                ThumbnailCache::key(m_device, filePath), &thumbnail)) {
+            return thumbnail;
         }
 
-        ctx->currentPos += bytesRead;
-        return static_cast<int>(bytesRead);
-    };
-
-    // Custom seek function using AFC seek
-    auto seekPacket = [](void *opaque, int64_t offset, int whence) -> int64_t {
-        StreamContext *ctx = static_cast<StreamContext *>(opaque);
-
-        if (whence == AVSEEK_SIZE) {
-            return static_cast<int64_t>(ctx->fileSize);
+        // Start async loading for both images and videos
+        if (!m_failedThumbnails.contains(filePath) &&
+            !m_thumbnailScheduler->isScheduled(filePath)) {
+            emit const_cast<PhotoModel *>(this)->thumbnailNeedsToBeLoaded(
+                index.row());
         }
+        return QVariant();
+    }
 
-        int64_t newPos = 0;
-        int seekWhence = SEEK_SET;
-
-        if (whence == SEEK_SET) {
-            newPos = offset;
-            seekWhence = SEEK_SET;
-        } else if (whence == SEEK_CUR) {
-            newPos = static_cast<int64_t>(ctx->currentPos) + offset;
-            seekWhence = SEEK_SET;
-        } else if (whence == SEEK_END) {
-            newPos = static_cast<int64_t>(ctx->fileSize) + offset;
-            seekWhence = SEEK_SET;
-        } else {
-            return -1;
+    case Qt::ToolTipRole: {
+        QString toolTip = QString("Photo: %1").arg(fileName);
+        const QSize dimensions = m_store.dimensions(id);
+        if (!dimensions.isEmpty()) {
+            toolTip += QString("\n%1 x %2")
+                           .arg(dimensions.width())
+                           .arg(dimensions.height());
         }
-
-        if (newPos < 0 || newPos > static_cast<int64_t>(ctx->fileSize)) {
-            return -1;
+        if (m_store.isFavorite(id)) {
+            toolTip += "\nFavorite";
         }
+        return toolTip;
+    }
 
-        // Use AFC seek
-        afc_error_t result = ServiceManager::safeAfcFileSeek(
-            ctx->device, ctx->fileHandle, newPos, seekWhence);
+    default:
+        return QVariant();
+    }
+}
 
-        if (result != AFC_E_SUCCESS) {
-            return -1;
-        }
+void PhotoModel::requestThumbnail(int index)
+{
+    if (index < 0 || index >= m_rows.size())
+        return;
 
-        ctx->currentPos = static_cast<uint64_t>(newPos);
-        return newPos;
-    };
+    const int id = m_rows.at(index);
+    const QString filePath = m_store.filePath(id);
+    if (ThumbnailCache::sharedInstance()->contains(
+            ThumbnailCache::key(m_device, filePath)))
+        return;
 
-    const int avioBufferSize = 32768; // 32KB buffer for streaming
-    unsigned char *avioBuffer =
-        static_cast<unsigned char *>(av_malloc(avioBufferSize));
-    if (!avioBuffer) {
-        delete streamCtx;
-        ServiceManager::safeAfcFileClose(device, fileHandle);
-        avformat_free_context(formatCtx);
-        return {};
-    }
-
-    AVIOContext *avioCtx =
-        avio_alloc_context(avioBuffer, avioBufferSize, 0, streamCtx, readPacket,
-                           nullptr, seekPacket);
-
-    if (!avioCtx) {
-        av_free(avioBuffer);
-        delete streamCtx;
-        ServiceManager::safeAfcFileClose(device, fileHandle);
-        avformat_free_context(formatCtx);
-        return {};
-    }
-
-    formatCtx->pb = avioCtx;
-    formatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
-
-    // Open input
-    if (avformat_open_input(&formatCtx, nullptr, nullptr, nullptr) < 0) {
-        qWarning() << "Failed to open video format";
-        av_free(avioCtx->buffer);
-        avio_context_free(&avioCtx);
-        avformat_free_context(formatCtx);
-        return {};
-    }
-
-    // Find stream info
-    if (avformat_find_stream_info(formatCtx, nullptr) < 0) {
-        qWarning() << "Failed to find stream info";
-        avformat_close_input(&formatCtx);
-        av_free(avioCtx->buffer);
-        avio_context_free(&avioCtx);
-        return {};
-    }
-
-    // Find video stream
-    int videoStreamIndex = -1;
-    const AVCodec *codec = nullptr;
-    AVCodecParameters *codecParams = nullptr;
-
-    for (unsigned int i = 0; i < formatCtx->nb_streams; i++) {
-        if (formatCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            videoStreamIndex = i;
-            codecParams = formatCtx->streams[i]->codecpar;
-            codec = avcodec_find_decoder(codecParams->codec_id);
-            break;
+    // The request was queued, by now the row may have been scrolled far out
+    // of view. It is requested again if it gets painted.
+    if (m_visibleFirst >= 0) {
+        const int lookahead =
+            qMax(MIN_LOOKAHEAD_ROWS, (m_visibleLast - m_visibleFirst + 1) / 2);
+        if (index < m_visibleFirst - lookahead ||
+            index > m_visibleLast + lookahead) {
+            return;
         }
     }
 
-    if (videoStreamIndex == -1 || !codec) {
-        qWarning() << "No video stream found";
-        avformat_close_input(&formatCtx);
-        av_free(avioCtx->buffer);
-        avio_context_free(&avioCtx);
-        return {};
-    }
-
-    // Allocate codec context
-    AVCodecContext *codecCtx = avcodec_alloc_context3(codec);
-    if (!codecCtx) {
-        avformat_close_input(&formatCtx);
-        av_free(avioCtx->buffer);
-        avio_context_free(&avioCtx);
-        return {};
-    }
-
-    if (avcodec_parameters_to_context(codecCtx, codecParams) < 0) {
-        avcodec_free_context(&codecCtx);
-        avformat_close_input(&formatCtx);
-        av_free(avioCtx->buffer);
-        avio_context_free(&avioCtx);
-        return {};
-    }
-
-    // Open codec
-    if (avcodec_open2(codecCtx, codec, nullptr) < 0) {
-        avcodec_free_context(&codecCtx);
-        avformat_close_input(&formatCtx);
-        av_free(avioCtx->buffer);
-        avio_context_free(&avioCtx);
-        return {};
-    }
-
-    // Allocate frame
-    AVFrame *frame = av_frame_alloc();
-    AVPacket *packet = av_packet_alloc();
-
-    if (!frame || !packet) {
-        if (frame)
-            av_frame_free(&frame);
-        if (packet)
-            av_packet_free(&packet);
-        avcodec_free_context(&codecCtx);
-        avformat_close_input(&formatCtx);
-        av_free(avioCtx->buffer);
-        avio_context_free(&avioCtx);
-        return {};
-    }
-
-    // Read frames until we get a valid one
-    bool frameDecoded = false;
-    while (av_read_frame(formatCtx, packet) >= 0) {
-        if (packet->stream_index == videoStreamIndex) {
-            if (avcodec_send_packet(codecCtx, packet) >= 0) {
-                if (avcodec_receive_frame(codecCtx, frame) >= 0) {
-                    frameDecoded = true;
-                    av_packet_unref(packet);
-                    break;
-                }
-            }
-        }
-        av_packet_unref(packet);
-    }
-
-    if (frameDecoded) {
-        // Convert frame to RGB24
-        SwsContext *swsCtx =
-            sws_getContext(frame->width, frame->height,
-                           static_cast<AVPixelFormat>(frame->format),
-                           frame->width, frame->height, AV_PIX_FMT_RGB24,
-                           SWS_BILINEAR, nullptr, nullptr, nullptr);
-
-        if (swsCtx) {
-            AVFrame *rgbFrame = av_frame_alloc();
-            if (rgbFrame) {
-                rgbFrame->format = AV_PIX_FMT_RGB24;
-                rgbFrame->width = frame->width;
-                rgbFrame->height = frame->height;
-
-                if (av_frame_get_buffer(rgbFrame, 0) >= 0) {
-                    sws_scale(swsCtx, frame->data, frame->linesize, 0,
-                              frame->height, rgbFrame->data,
-                              rgbFrame->linesize);
-
-                    // Convert to QImage
-                    QImage img(rgbFrame->data[0], rgbFrame->width,
-                               rgbFrame->height, rgbFrame->linesize[0],
-                               QImage::Format_RGB888);
-
-                    // Create a deep copy since AVFrame will be freed
-                    QImage imgCopy = img.copy();
-
-                    // Scale to requested size
-                    thumbnail = QPixmap::fromImage(
-                        imgCopy.scaled(requestedSize, Qt::KeepAspectRatio,
-                                       Qt::SmoothTransformation));
-                }
-
-                av_frame_free(&rgbFrame);
-            }
+    m_thumbnailScheduler->request(filePath,
+                                  m_store.fileType(id) == PhotoInfo::Video);
+}
 
-            sws_freeContext(swsCtx);
-        }
+void PhotoModel::onThumbnailReady(const QString &filePath,
+                                  const QImage &thumbnail)
+{
+    if (thumbnail.isNull()) {
+        qDebug() << "Failed to load thumbnail for:"
+                 << QFileInfo(filePath).fileName();
+        // Don't retry on every repaint
+        m_failedThumbnails.insert(filePath);
+        return;
     }
 
-    // Cleanup
-    av_frame_free(&frame);
-    av_packet_free(&packet);
-    avcodec_free_context(&codecCtx);
-    avformat_close_input(&formatCtx);
-
-    // Close the AFC file handle
-    ServiceManager::safeAfcFileClose(device, fileHandle);
-
-    // Free AVIO context and stream context
-    av_free(avioCtx->buffer);
-    avio_context_free(&avioCtx);
-    delete streamCtx;
+    // QPixmaps are only created here on the GUI thread
+    ThumbnailCache::sharedInstance()->insert(
+        ThumbnailCache::key(m_device, filePath), QPixmap::fromImage(thumbnail));
 
-    return thumbnail;
-}
-
-int PhotoModel::rowCount(const QModelIndex &parent) const
-{
-    Q_UNUSED(parent)
-    return m_photos.size();
+    const int row = rowForId(m_store.find(filePath));
+    if (row >= 0) {
+        QModelIndex idx = createIndex(row, 0);
+        emit dataChanged(idx, idx, {ThumbnailRole, Qt::DecorationRole});
+    }
 }
 
-QVariant PhotoModel::data(const QModelIndex &index, int role) const
+void PhotoModel::setVisibleRange(int first, int last)
 {
-    if (!index.isValid() || index.row() >= m_photos.size())
-        return QVariant();
-
-    const PhotoInfo &info = m_photos.at(index.row());
+    if (m_rows.isEmpty() || first < 0 || last < first) {
+        m_visibleFirst = -1;
+        m_visibleLast = -1;
+        m_thumbnailScheduler->setViewport({});
+        return;
+    }
 
-    switch (role) {
-    case Qt::DisplayRole:
-        return info.fileName;
+    first = qBound(0, first, int(m_rows.size()) - 1);
+    last = qBound(first, last, int(m_rows.size()) - 1);
 
-    case Qt::UserRole:
-        return info.filePath;
+    const bool scrollingUp = m_visibleFirst >= 0 && first < m_visibleFirst;
+    m_visibleFirst = first;
+    m_visibleLast = last;
 
-    case Qt::DecorationRole: {
-        qDebug() << "DecorationRole requested for index:" << index.row();
+    const int lookahead = qMax(MIN_LOOKAHEAD_ROWS, (last - first + 1) / 2);
 
-        // Check memory cache first
-        if (QPixmap *cached = m_thumbnailCache.object(info.filePath)) {
-            qDebug() << "Cache HIT for:" << info.fileName;
-            return QIcon(*cached);
-        }
-
-        // Prevent duplicate requests
-        if (m_loadingPaths.contains(info.filePath) ||
-            m_activeLoaders.contains(info.filePath)) {
-            qDebug() << "Already loading:" << info.fileName;
-            // Return appropriate placeholder based on file type
-            if (info.fileName.endsWith(".MOV", Qt::CaseInsensitive) ||
-                info.fileName.endsWith(".MP4", Qt::CaseInsensitive) ||
-                info.fileName.endsWith(".M4V", Qt::CaseInsensitive)) {
-                return QIcon(":/resources/icons/video-x-generic.png");
-            } else {
-                return QIcon(":/resources/icons/"
-                             "MaterialSymbolsLightImageOutlineSharp.png");
-            }
-        }
+    // Visible rows first, then the rows we are about to scroll into
+    QStringList ordered;
+    for (int row = first; row <= last; ++row) {
+        ordered.append(m_store.filePath(m_rows.at(row)));
+    }
 
-        // Start async loading for both images and videos
-        if (!m_loadingPaths.contains(info.filePath)) {
-            qDebug() << "Starting load for:" << info.fileName;
-            emit const_cast<PhotoModel *>(this)->thumbnailNeedsToBeLoaded(
-                index.row());
-        }
+    QList<int> aheadRows;
+    if (scrollingUp) {
+        for (int row = first - 1; row >= 0 && row >= first - lookahead; --row)
+            aheadRows.append(row);
+    } else {
+        for (int row = last + 1;
+             row < m_rows.size() && row <= last + lookahead; ++row)
+            aheadRows.append(row);
+    }
+    for (int row : aheadRows) {
+        ordered.append(m_store.filePath(m_rows.at(row)));
+    }
 
-        // Return placeholder while loading
-        if (info.fileName.endsWith(".MOV", Qt::CaseInsensitive) ||
-            info.fileName.endsWith(".MP4", Qt::CaseInsensitive) ||
-            info.fileName.endsWith(".M4V", Qt::CaseInsensitive)) {
-            // return QIcon::fromTheme("video-x-generic");
-            return QIcon(":/resources/icons/video-x-generic.png");
-        } else {
-            return QIcon(
-                ":/resources/icons/MaterialSymbolsLightImageOutlineSharp.png");
+    // Keep a prefetch going until the view has moved away from it
+    if (m_prefetchFirst >= 0 && m_prefetchLast >= first - lookahead &&
+        m_prefetchFirst <= last + lookahead &&
+        m_prefetchLast < m_rows.size()) {
+        for (int row = m_prefetchFirst; row <= m_prefetchLast; ++row) {
+            ordered.append(m_store.filePath(m_rows.at(row)));
         }
+    } else {
+        m_prefetchFirst = -1;
+        m_prefetchLast = -1;
     }
 
-    case Qt::ToolTipRole:
-        return QString("Photo: %1").arg(info.fileName);
+    m_thumbnailScheduler->setViewport(ordered);
 
-    default:
-        return QVariant();
+    for (int row : aheadRows) {
+        const int id = m_rows.at(row);
+        const QString filePath = m_store.filePath(id);
+        if (!ThumbnailCache::sharedInstance()->contains(
+                ThumbnailCache::key(m_device, filePath)) &&
+            !m_failedThumbnails.contains(filePath)) {
+            m_thumbnailScheduler->request(
+                filePath, m_store.fileType(id) == PhotoInfo::Video);
+        }
     }
 }
 
-void PhotoModel::requestThumbnail(int index)
+void PhotoModel::prefetchRows(int first, int last)
 {
-    if (index < 0 || index >= m_photos.size())
-        return;
-
-    PhotoInfo &info = m_photos[index];
-    info.thumbnailRequested = true;
-
-    if (m_loadingPaths.contains(info.filePath))
+    if (m_rows.isEmpty() || first < 0 || last < first ||
+        first >= m_rows.size()) {
         return;
-
-    m_loadingPaths.insert(info.filePath);
-
-    auto *watcher = new QFutureWatcher<QPixmap>();
-    m_activeLoaders[info.filePath] = watcher;
-
-    connect(watcher, &QFutureWatcher<QPixmap>::finished, this,
-            [this, watcher, filePath = info.filePath]() {
-                qDebug() << "Thumbnail load finished for:" << filePath;
-                QPixmap thumbnail = watcher->result();
-
-                m_loadingPaths.remove(filePath);
-                m_activeLoaders.remove(filePath);
-                if (!thumbnail.isNull()) {
-                    int cost = thumbnail.width() * thumbnail.height() * 4;
-                    m_thumbnailCache.insert(filePath, new QPixmap(thumbnail),
-                                            cost);
-
-                    for (int i = 0; i < m_photos.size(); ++i) {
-                        if (m_photos[i].filePath == filePath) {
-                            QModelIndex idx = createIndex(i, 0);
-                            emit dataChanged(idx, idx, {Qt::DecorationRole});
-                            break;
-                        }
-                    }
-                } else {
-                    qDebug() << "Failed to load thumbnail for:"
-                             << QFileInfo(filePath).fileName();
-                }
-
-                watcher->deleteLater();
-            });
-
-    bool isVideo = info.fileName.endsWith(".MOV", Qt::CaseInsensitive) ||
-                   info.fileName.endsWith(".MP4", Qt::CaseInsensitive) ||
-                   info.fileName.endsWith(".M4V", Qt::CaseInsensitive);
-
-    QFuture<QPixmap> future;
-    if (isVideo) {
-        future = QtConcurrent::run([this, info]() {
-            // Acquire semaphore FIRST to limit concurrent video processing
-            qDebug() << "Waiting for semaphore for:" << info.fileName;
-            m_videoThumbnailSemaphore.acquire();
-            qDebug() << "Acquired semaphore for:" << info.fileName;
-
-            // Generate video thumbnail using FFmpeg directly (no QMediaPlayer)
-            QPixmap thumbnail = generateVideoThumbnailFFmpeg(
-                m_device, info.filePath, m_thumbnailSize);
-
-            // Release semaphore
-            qDebug() << "Releasing semaphore for:" << info.fileName;
-            m_videoThumbnailSemaphore.release();
-            return thumbnail;
-        });
-    } else {
-        future = QtConcurrent::run([info, this]() {
-            return loadThumbnailFromDevice(m_device, info.filePath,
-                                           m_thumbnailSize);
-        });
     }
 
-    watcher->setFuture(future);
+    last = qMin({last, first + MAX_PREFETCH_ROWS - 1, int(m_rows.size()) - 1});
+    m_prefetchFirst = first;
+    m_prefetchLast = last;
+
+    for (int row = first; row <= last; ++row) {
+        const int id = m_rows.at(row);
+        const QString filePath = m_store.filePath(id);
+        if (!ThumbnailCache::sharedInstance()->contains(
+                ThumbnailCache::key(m_device, filePath)) &&
+            !m_failedThumbnails.contains(filePath)) {
+            m_thumbnailScheduler->request(
+                filePath, m_store.fileType(id) == PhotoInfo::Video);
+        }
+    }
 }
 
 // Static function that runs in worker thread
-QPixmap PhotoModel::loadThumbnailFromDevice(iDescriptorDevice *device,
-                                            const QString &filePath,
-                                            const QSize &size)
+QImage PhotoModel::loadThumbnailFromDevice(iDescriptorDevice *device,
+                                           const QString &filePath,
+                                           const QSize &size)
 {
     // Load from device using ServiceManager
     QByteArray imageData = ServiceManager::safeReadAfcFileToByteArray(
@@ -536,15 +349,12 @@ QPixmap PhotoModel::loadThumbnailFromDevice(iDescriptorDevice *device,
 
     if (imageData.isEmpty()) {
         qDebug() << "Could not read from device:" << filePath;
-        return {}; // Return empty pixmap on error
+        return {}; // Return empty image on error
     }
 
     if (filePath.endsWith(".HEIC", Qt::CaseInsensitive)) {
-        qDebug() << "Loading HEIC image from data for:" << filePath;
-        QPixmap img = load_heic(imageData);
-        return img.isNull() ? QPixmap()
-                            : img.scaled(size, Qt::KeepAspectRatio,
-                                         Qt::SmoothTransformation);
+        // Decodes the embedded thumbnail instead of the full 12-48 MP image
+        return load_heic_image(imageData, size);
     }
 
     // Use QImageReader for efficient, low-memory scaled loading
@@ -552,191 +362,650 @@ QPixmap PhotoModel::loadThumbnailFromDevice(iDescriptorDevice *device,
     buffer.open(QIODevice::ReadOnly);
 
     QImageReader reader(&buffer);
+    reader.setAutoTransform(true);
     if (reader.canRead()) {
-        // This is the key optimization: it decodes a smaller image directly,
-        // saving a massive amount of memory.
-        reader.setScaledSize(size);
+        // For JPEG this scales in the DCT domain while decoding, so the full
+        // size image is never materialized. Keep the aspect ratio, a plain
+        // setScaledSize(size) would squash everything into a square.
+        const QSize originalSize = reader.size();
+        if (originalSize.isValid() && (originalSize.width() > size.width() ||
+                                       originalSize.height() > size.height())) {
+            reader.setScaledSize(
+                originalSize.scaled(size, Qt::KeepAspectRatio));
+        }
         QImage image = reader.read();
         if (!image.isNull()) {
-            return QPixmap::fromImage(image);
+            return image;
         }
         qDebug() << "QImageReader failed to decode" << filePath
                  << "Error:" << reader.errorString();
     }
 
     // Fallback for formats QImageReader might struggle with
-    QPixmap original;
+    QImage original;
     if (original.loadFromData(imageData)) {
-        return original.scaled(size, Qt::KeepAspectRatio,
-                               Qt::SmoothTransformation);
+        return downscale_image(original, size);
     }
 
     qDebug() << "Could not decode image data for:" << filePath;
     return {};
 }
 
-QPixmap PhotoModel::loadImage(iDescriptorDevice *device,
-                              const QString &filePath)
+QImage PhotoModel::loadImage(iDescriptorDevice *device,
+                             const QString &filePath)
 {
     QByteArray imageData = ServiceManager::safeReadAfcFileToByteArray(
         device, filePath.toUtf8().constData());
 
     if (imageData.isEmpty()) {
         qDebug() << "Could not read from device:" << filePath;
-        return QPixmap(); // Return empty pixmap on error
+        return QImage(); // Return empty image on error
     }
 
-    if (filePath.endsWith(".HEIC")) {
-        qDebug() << "Loading HEIC image from data for:" << filePath;
-        QPixmap img = load_heic(imageData);
-        return img.isNull() ? QPixmap() : img;
+    if (filePath.endsWith(".HEIC", Qt::CaseInsensitive)) {
+        return load_heic_image(imageData);
     }
 
-    QPixmap original;
+    QImage original;
     if (!original.loadFromData(imageData)) {
         qDebug() << "Could not decode image data for:" << filePath;
-        return QPixmap();
+        return QImage();
     }
 
     return original;
 }
 
+/*
+ * Populating used to list the album, stat every file for its date and only
+ * then reset the model, so the view stayed empty for the whole time on big
+ * albums. Now the listing runs on a worker thread and rows are inserted in
+ * batches at their sorted position as soon as the names are known. Files
+ * without a date from the library index are shown at the end and move into
+ * place as their dates are fetched in the background.
+ *
+ * Several albums can be listed into one model (the "All Photos" album). Each
+ * folder is posted as soon as it is listed and every batch is merged into
+ * the timeline by date, so the combined view is usable before the last
+ * folder has been read.
+ */
 void PhotoModel::populatePhotoPaths()
 {
-    // TODO:beginResetModel called on PhotoModel(0x600002d12a40) without calling
-    // endResetModel first
-    if (m_albumPath.isEmpty()) {
+    cancelPopulation();
+
+    beginResetModel();
+    m_store.clear();
+    m_sorted.clear();
+    m_rows.clear();
+    m_dateBuckets.clear();
+    endResetModel();
+    emit dateBucketsChanged();
+
+    if (m_albumPaths.isEmpty() && m_assetPaths.isEmpty()) {
         qDebug() << "No album path set, skipping population";
         return;
     }
 
-    m_allPhotos.clear();
+    m_populateFutures.removeIf(
+        [](const QFuture<void> &future) { return future.isFinished(); });
+
+    m_populateCancelled = std::make_shared<std::atomic<bool>>(false);
+    m_populateFutures.append(QtConcurrent::run(
+        [this, albumPaths = m_albumPaths, assetPaths = m_assetPaths,
+         index = m_libraryIndex, generation = m_generation,
+         cancelled = m_populateCancelled]() {
+            streamAlbumContents(albumPaths, assetPaths, index, generation,
+                                cancelled);
+        }));
+}
+
+void PhotoModel::cancelPopulation()
+{
+    // The stale worker stops at its next check, which may be after a whole
+    // directory read or date chunk. Don't wait for it here, anything it
+    // still posts is dropped by the generation check.
+    ++m_generation;
+    if (m_populateCancelled) {
+        m_populateCancelled->store(true);
+    }
+    m_populateCancelled.reset();
+
+    m_dateFlushTimer->stop();
+    m_pendingDates.clear();
+}
+
+// Runs on a worker thread, results are only handed back through queued calls
+void PhotoModel::streamAlbumContents(
+    const QStringList &albumPaths, const QStringList &assetPaths,
+    std::shared_ptr<PhotoLibraryIndex> index, quint64 generation,
+    std::shared_ptr<std::atomic<bool>> cancelled)
+{
+    QList<PhotoInfo> batch;
+    QStringList undated;
+    int batchSize = FIRST_BATCH_SIZE;
+    int total = 0;
+
+    auto postBatch = [&]() {
+        if (batch.isEmpty())
+            return;
+        QMetaObject::invokeMethod(
+            this,
+            [this, generation, batch]() { insertPhotos(generation, batch); },
+            Qt::QueuedConnection);
+        batch.clear();
+        batchSize = BATCH_SIZE;
+    };
+
+    auto addFile = [&](const QString &albumPath, const QString &fileName) {
+        if (!(fileName.endsWith(".JPG", Qt::CaseInsensitive) ||
+              fileName.endsWith(".PNG", Qt::CaseInsensitive) ||
+              fileName.endsWith(".HEIC", Qt::CaseInsensitive) ||
+              fileName.endsWith(".MOV", Qt::CaseInsensitive) ||
+              fileName.endsWith(".MP4", Qt::CaseInsensitive) ||
+              fileName.endsWith(".M4V", Qt::CaseInsensitive))) {
+            return;
+        }
+
+        PhotoInfo info;
+        info.albumPath = albumPath;
+        info.fileName = fileName;
+        info.fileType = determineFileType(fileName);
+
+        const QString filePath = info.filePath();
+        const PhotoLibraryAsset *asset =
+            index ? index->asset(filePath) : nullptr;
+        if (asset && asset->captureTime > 0) {
+            info.captureTime = asset->captureTime;
+            info.dimensions = QSize(asset->width, asset->height);
+            info.favorite = asset->favorite;
+        } else {
+            // Unknown for now, sorts after dated items
+            info.captureTime = PhotoStore::UnknownTime;
+            undated.append(filePath);
+        }
+
+        batch.append(info);
+        ++total;
+        if (batch.size() >= batchSize) {
+            postBatch();
+        }
+    };
+
+    // Albums from Photos.sqlite already know their files, nothing to list
+    for (const QString &filePath : assetPaths) {
+        if (cancelled->load())
+            return;
+        addFile(filePath.section('/', 0, -2), filePath.section('/', -1));
+    }
+    postBatch();
+
+    for (const QString &albumPath : albumPaths) {
+        if (cancelled->load())
+            return;
+
+        char **files = nullptr;
+        afc_error_t readResult = ServiceManager::safeAfcReadDirectory(
+            m_device, albumPath.toUtf8().constData(), &files);
+        if (readResult != AFC_E_SUCCESS) {
+            qDebug() << "Failed to read photo directory:" << albumPath
+                     << "Error:" << readResult;
+            continue;
+        }
+
+        for (int i = 0; files && files[i] && !cancelled->load(); i++) {
+            addFile(albumPath, QString::fromUtf8(files[i]));
+        }
+        if (files) {
+            afc_dictionary_free(files);
+        }
+
+        // Don't hold a finished folder back until the next one fills a batch
+        postBatch();
+    }
+
+    qDebug() << "Listed" << total << "media files in" << albumPaths.size()
+             << "albums -" << undated.size() << "need a date lookup";
+
+    // Each chunk is read on a few threads. AFC requests to one device are
+    // serialized, but header parsing and cache hits overlap with the reads.
+    iDescriptorDevice *device = m_device;
+    auto captureTime = [device](const QString &filePath) {
+        const QDateTime dateTime = CaptureDate::read(device, filePath);
+        return dateTime.isValid() ? dateTime.toMSecsSinceEpoch()
+                                  : PhotoStore::UnknownTime;
+    };
+
+    for (qsizetype i = 0; i < undated.size() && !cancelled->load();
+         i += DATE_CHUNK_SIZE) {
+        const QStringList chunk = undated.mid(i, DATE_CHUNK_SIZE);
+        const QList<qint64> times = QtConcurrent::blockingMapped<QList<qint64>>(
+            captureDatePool(), chunk, captureTime);
 
-    QByteArray albumPathBytes = m_albumPath.toUtf8();
-    const char *albumPathCStr = albumPathBytes.constData();
+        QHash<QString, qint64> dates;
+        for (qsizetype k = 0; k < chunk.size(); ++k) {
+            if (times[k] != PhotoStore::UnknownTime)
+                dates.insert(chunk[k], times[k]);
+        }
+        QMetaObject::invokeMethod(
+            this,
+            [this, generation, dates]() { applyDates(generation, dates); },
+            Qt::QueuedConnection);
+    }
+
+    ThumbnailCache::sharedInstance()->saveCaptureTimes();
+}
 
-    char **albumInfo = nullptr;
-    afc_error_t infoResult =
-        ServiceManager::safeAfcGetFileInfo(m_device, albumPathCStr, &albumInfo);
-    if (infoResult != AFC_E_SUCCESS) {
-        qDebug() << "Album path does not exist or cannot be accessed:"
-                 << m_albumPath << "Error:" << infoResult;
+void PhotoModel::insertPhotos(quint64 generation, const QList<PhotoInfo> &batch)
+{
+    if (generation != m_generation)
         return;
+
+    QList<int> ids;
+    ids.reserve(batch.size());
+    for (const PhotoInfo &info : batch) {
+        ids.append(m_store.append(info));
+    }
+
+    auto lessThan = [this](int a, int b) { return idLessThan(a, b); };
+    std::sort(ids.begin(), ids.end(), lessThan);
+    mergeIntoSorted(m_sorted, ids);
+
+    QList<int> visible;
+    for (int id : ids) {
+        if (matchesFilter(id, m_filterType)) {
+            visible.append(id);
+        }
     }
-    if (albumInfo) {
-        afc_dictionary_free(albumInfo);
+    insertSortedRows(visible);
+}
+
+// Merges already sorted ids into a sorted id list without notifying views
+void PhotoModel::mergeIntoSorted(QList<int> &ids,
+                                 const QList<int> &sortedIds) const
+{
+    const qsizetype middle = ids.size();
+    ids.append(sortedIds);
+    std::inplace_merge(ids.begin(), ids.begin() + middle, ids.end(),
+                       [this](int a, int b) { return idLessThan(a, b); });
+}
+
+// Inserts already sorted ids into the model rows, ids that land on the same
+// row are inserted with a single beginInsertRows()
+void PhotoModel::insertSortedRows(const QList<int> &sortedIds)
+{
+    auto lessThan = [this](int a, int b) { return idLessThan(a, b); };
+
+    addToBuckets(sortedIds);
+
+    int i = 0;
+    while (i < sortedIds.size()) {
+        const int row = std::upper_bound(m_rows.cbegin(), m_rows.cend(),
+                                         sortedIds[i], lessThan) -
+                        m_rows.cbegin();
+
+        int end = i + 1;
+        while (end < sortedIds.size() &&
+               (row == m_rows.size() ||
+                idLessThan(sortedIds[end], m_rows[row]))) {
+            ++end;
+        }
+
+        beginInsertRows(QModelIndex(), row, row + (end - i) - 1);
+        m_rows.insert(row, end - i, 0);
+        std::copy(sortedIds.cbegin() + i, sortedIds.cbegin() + end,
+                  m_rows.begin() + row);
+        endInsertRows();
+
+        i = end;
     }
 
-    // Fix: Store the QByteArray to keep the C string valid
-    QByteArray photoDirBytes = m_albumPath.toUtf8();
-    const char *photoDir = photoDirBytes.constData();
-    qDebug() << "Photo directory:" << m_albumPath;
-    qDebug() << "Photo directory C string:" << photoDir;
+    updateBucketRows();
+}
 
-    // Use ServiceManager for thread-safe AFC operations
-    char **files = nullptr;
-    afc_error_t readResult =
-        ServiceManager::safeAfcReadDirectory(m_device, photoDir, &files);
-    if (readResult != AFC_E_SUCCESS) {
-        qDebug() << "Failed to read photo directory:" << photoDir
-                 << "Error:" << readResult;
+void PhotoModel::applyDates(quint64 generation,
+                            const QHash<QString, qint64> &dates)
+{
+    if (generation != m_generation)
         return;
+
+    m_pendingDates.insert(dates);
+    if (!m_dateFlushTimer->isActive()) {
+        m_dateFlushTimer->start();
     }
+}
 
-    if (files) {
-        for (int i = 0; files[i]; i++) {
-            QString fileName = QString::fromUtf8(files[i]);
-            if (fileName.endsWith(".JPG", Qt::CaseInsensitive) ||
-                fileName.endsWith(".PNG", Qt::CaseInsensitive) ||
-                fileName.endsWith(".HEIC", Qt::CaseInsensitive) ||
-                fileName.endsWith(".MOV", Qt::CaseInsensitive) ||
-                fileName.endsWith(".MP4", Qt::CaseInsensitive) ||
-                fileName.endsWith(".M4V", Qt::CaseInsensitive)) {
-
-                PhotoInfo info;
-                info.filePath = m_albumPath + "/" + fileName;
-                info.fileName = fileName;
-                info.thumbnailRequested = false;
-                info.fileType = determineFileType(fileName);
-                info.dateTime = extractDateTimeFromFile(info.filePath);
-
-                m_allPhotos.append(info);
-            }
+/*
+ * Only the photos whose date changed are taken out of the sorted id lists
+ * and merged back in, instead of copying and resorting every photo of the
+ * album on each flush.
+ */
+void PhotoModel::flushPendingDates()
+{
+    if (m_pendingDates.isEmpty())
+        return;
+
+    QList<std::pair<int, qint64>> changed;
+    QList<bool> isChanged(m_store.size(), false);
+    for (auto it = m_pendingDates.cbegin(); it != m_pendingDates.cend();
+         ++it) {
+        const int id = m_store.find(it.key());
+        if (id >= 0 && m_store.captureTime(id) != it.value()) {
+            changed.append({id, it.value()});
+            isChanged[id] = true;
         }
-        afc_dictionary_free(files);
     }
+    m_pendingDates.clear();
+
+    if (changed.isEmpty())
+        return;
 
-    // Apply initial filtering and sorting, which will also reset the model
-    applyFilterAndSort();
+    relayout([this, &changed, &isChanged]() {
+        auto wasChanged = [&isChanged](int id) { return isChanged[id]; };
+        m_sorted.removeIf(wasChanged);
+        m_rows.removeIf(wasChanged);
+
+        QList<int> ids;
+        QList<int> shown;
+        ids.reserve(changed.size());
+        for (const auto &[id, captureTime] : changed) {
+            ids.append(id);
+            if (matchesFilter(id, m_filterType))
+                shown.append(id);
+        }
 
-    qDebug() << "Loaded" << m_allPhotos.size() << "media files from device";
-    qDebug() << "After filtering:" << m_photos.size() << "items shown";
+        // Moved out of the bucket of the old day into the one of the new
+        removeFromBuckets(shown);
+        for (const auto &[id, captureTime] : changed) {
+            m_store.setCaptureTime(id, captureTime);
+        }
+        addToBuckets(shown);
+
+        auto lessThan = [this](int a, int b) { return idLessThan(a, b); };
+        std::sort(ids.begin(), ids.end(), lessThan);
+        mergeIntoSorted(m_sorted, ids);
+        std::sort(shown.begin(), shown.end(), lessThan);
+        mergeIntoSorted(m_rows, shown);
+    });
+    updateBucketRows();
+}
+
+// Runs reorder() as a layout change, so selection, current item and scroll
+// position survive unlike with a model reset. reorder() must leave m_sorted
+// and m_rows sorted and must not change which photos are in m_rows.
+void PhotoModel::relayout(const std::function<void()> &reorder)
+{
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    const QModelIndexList persistent = persistentIndexList();
+    QList<int> persistentIds;
+    persistentIds.reserve(persistent.size());
+    for (const QModelIndex &index : persistent) {
+        persistentIds.append(m_rows.at(index.row()));
+    }
+
+    reorder();
+
+    if (!persistent.isEmpty()) {
+        QModelIndexList updated;
+        updated.reserve(persistent.size());
+        for (int id : persistentIds) {
+            updated.append(index(rowForId(id), 0));
+        }
+        changePersistentIndexList(persistent, updated);
+    }
+
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+void PhotoModel::resetRows()
+{
+    beginResetModel();
+    m_rows.clear();
+    for (int id : std::as_const(m_sorted)) {
+        if (matchesFilter(id, m_filterType)) {
+            m_rows.append(id);
+        }
+    }
+    rebuildBuckets();
+    endResetModel();
+    updateBucketRows();
+}
+
+// Binary search, m_rows is always sorted by idLessThan()
+int PhotoModel::rowForId(int id) const
+{
+    if (id < 0)
+        return -1;
+
+    auto it =
+        std::lower_bound(m_rows.cbegin(), m_rows.cend(), id,
+                         [this](int a, int b) { return idLessThan(a, b); });
+    if (it == m_rows.cend() || *it != id)
+        return -1;
+    return it - m_rows.cbegin();
 }
 
 // Sorting and filtering methods
 void PhotoModel::setSortOrder(SortOrder order)
 {
-    if (m_sortOrder != order) {
+    if (m_sortOrder == order)
+        return;
+
+    // Undated photos stay last in either order, flipping the order is just
+    // reversing the dated and the undated block
+    auto reverseBlocks = [this](QList<int> &ids) {
+        auto undated =
+            std::partition_point(ids.begin(), ids.end(), [this](int id) {
+                return m_store.captureTime(id) != PhotoStore::UnknownTime;
+            });
+        std::reverse(ids.begin(), undated);
+        std::reverse(undated, ids.end());
+    };
+
+    relayout([this, order, &reverseBlocks]() {
         m_sortOrder = order;
-        applyFilterAndSort();
-    }
+        reverseBlocks(m_sorted);
+        reverseBlocks(m_rows);
+
+        // Same for the buckets, the undated one is always the last
+        auto undated = m_dateBuckets.end();
+        if (!m_dateBuckets.isEmpty() && m_dateBuckets.last().day == 0)
+            --undated;
+        std::reverse(m_dateBuckets.begin(), undated);
+    });
+    updateBucketRows();
 }
 
+/*
+ * The old and the new rows are both subsequences of m_sorted, so walking it
+ * once gives the runs of rows to remove and insert. Applying those keeps the
+ * rows that stay in both filters, including their selection.
+ */
 void PhotoModel::setFilterType(FilterType filter)
 {
-    if (m_filterType != filter) {
-        m_filterType = filter;
-        applyFilterAndSort();
+    if (m_filterType == filter)
+        return;
+
+    const FilterType previous = m_filterType;
+    m_filterType = filter;
+
+    enum Change { Keep, Remove, Insert, Skip };
+    auto changeFor = [this, previous, filter](int id) {
+        const bool before = matchesFilter(id, previous);
+        const bool after = matchesFilter(id, filter);
+        if (before == after)
+            return before ? Keep : Skip;
+        return before ? Remove : Insert;
+    };
+
+    int runs = 0;
+    Change last = Keep;
+    for (int id : std::as_const(m_sorted)) {
+        const Change change = changeFor(id);
+        if (change == Skip)
+            continue;
+        if (change != Keep && change != last)
+            ++runs;
+        last = change;
+    }
+
+    if (runs > MAX_FILTER_RUNS) {
+        resetRows();
+        return;
+    }
+
+    int row = 0;
+    int i = 0;
+    while (i < m_sorted.size()) {
+        const Change change = changeFor(m_sorted[i]);
+        if (change != Remove && change != Insert) {
+            if (change == Keep)
+                ++row;
+            ++i;
+            continue;
+        }
+
+        QList<int> run;
+        for (; i < m_sorted.size(); ++i) {
+            const Change next = changeFor(m_sorted[i]);
+            if (next == Skip)
+                continue;
+            if (next != change)
+                break;
+            run.append(m_sorted[i]);
+        }
+
+        if (change == Remove) {
+            removeFromBuckets(run);
+            beginRemoveRows(QModelIndex(), row, row + run.size() - 1);
+            m_rows.remove(row, run.size());
+            endRemoveRows();
+        } else {
+            addToBuckets(run);
+            beginInsertRows(QModelIndex(), row, row + run.size() - 1);
+            m_rows.insert(row, run.size(), 0);
+            std::copy(run.cbegin(), run.cend(), m_rows.begin() + row);
+            endInsertRows();
+            row += run.size();
+        }
     }
+    updateBucketRows();
+
+    qDebug() << "Applied filter - showing" << m_rows.size() << "of"
+             << m_store.size() << "items in" << runs << "steps";
 }
 
-void PhotoModel::applyFilterAndSort()
+// Items whose date isn't known yet always go last, equal dates are ordered
+// by file name so rows don't jump around between batches. The id is the
+// final tie breaker, so this is a strict total order that flips exactly
+// with the sort order.
+bool PhotoModel::idLessThan(int a, int b) const
 {
-    beginResetModel();
+    const qint64 aTime = m_store.captureTime(a);
+    const qint64 bTime = m_store.captureTime(b);
+    const bool aDated = aTime != PhotoStore::UnknownTime;
+    const bool bDated = bTime != PhotoStore::UnknownTime;
+    if (aDated != bDated)
+        return aDated;
+
+    const bool newestFirst = m_sortOrder == NewestFirst;
+    if (aTime != bTime)
+        return newestFirst ? aTime > bTime : aTime < bTime;
+
+    const int byName = m_store.fileName(a).compare(m_store.fileName(b));
+    if (byName != 0)
+        return newestFirst ? byName > 0 : byName < 0;
+    return newestFirst ? a > b : a < b;
+}
+
+/*
+ * Rows are sorted by capture time, so all rows of a day are contiguous and
+ * the buckets are kept as a list of (day, count) in row order. Inserting or
+ * removing rows only touches the counts of the affected days, first rows
+ * are recomputed afterwards with one pass over the buckets, not the rows.
+ */
+bool PhotoModel::dayLessThan(int a, int b) const
+{
+    if ((a == 0) != (b == 0))
+        return a != 0;
+    return m_sortOrder == NewestFirst ? a > b : a < b;
+}
 
-    // int i = 0;
-    // Filter photos
-    m_photos.clear();
-    for (const PhotoInfo &info : m_allPhotos) {
-        if (matchesFilter(info)) {
-            m_photos.append(info);
-            // if (i == 3) {
-            //     break;
-            // }
-            // i++;
+void PhotoModel::addToBuckets(const QList<int> &ids)
+{
+    for (int id : ids) {
+        const int day = m_store.day(id);
+        auto it = std::lower_bound(m_dateBuckets.begin(), m_dateBuckets.end(),
+                                   day,
+                                   [this](const DateBucket &bucket, int day) {
+                                       return dayLessThan(bucket.day, day);
+                                   });
+        if (it != m_dateBuckets.end() && it->day == day) {
+            ++it->count;
+        } else {
+            m_dateBuckets.insert(it, DateBucket{day, 0, 1});
         }
     }
+}
 
-    // Sort photos
-    sortPhotos(m_photos);
+void PhotoModel::removeFromBuckets(const QList<int> &ids)
+{
+    for (int id : ids) {
+        const int day = m_store.day(id);
+        auto it = std::lower_bound(m_dateBuckets.begin(), m_dateBuckets.end(),
+                                   day,
+                                   [this](const DateBucket &bucket, int day) {
+                                       return dayLessThan(bucket.day, day);
+                                   });
+        if (it == m_dateBuckets.end() || it->day != day)
+            continue;
+        if (--it->count == 0)
+            m_dateBuckets.erase(it);
+    }
+}
 
-    endResetModel();
+void PhotoModel::updateBucketRows()
+{
+    int row = 0;
+    for (DateBucket &bucket : m_dateBuckets) {
+        bucket.firstRow = row;
+        row += bucket.count;
+    }
+    emit dateBucketsChanged();
+}
 
-    qDebug() << "Applied filter and sort - showing" << m_photos.size() << "of"
-             << m_allPhotos.size() << "items";
+void PhotoModel::rebuildBuckets()
+{
+    m_dateBuckets.clear();
+    for (int id : std::as_const(m_rows)) {
+        const int day = m_store.day(id);
+        if (m_dateBuckets.isEmpty() || m_dateBuckets.last().day != day) {
+            m_dateBuckets.append(DateBucket{day, 0, 0});
+        }
+        ++m_dateBuckets.last().count;
+    }
 }
 
-void PhotoModel::sortPhotos(QList<PhotoInfo> &photos) const
+int PhotoModel::bucketForRow(int row) const
 {
-    std::sort(photos.begin(), photos.end(),
-              [this](const PhotoInfo &a, const PhotoInfo &b) {
-                  if (m_sortOrder == NewestFirst) {
-                      return a.dateTime > b.dateTime;
-                  } else {
-                      return a.dateTime < b.dateTime;
-                  }
-              });
+    if (row < 0 || row >= m_rows.size() || m_dateBuckets.isEmpty())
+        return -1;
+
+    auto it = std::upper_bound(m_dateBuckets.cbegin(), m_dateBuckets.cend(),
+                               row, [](int row, const DateBucket &bucket) {
+                                   return row < bucket.firstRow;
+                               });
+    return int(it - m_dateBuckets.cbegin()) - 1;
 }
 
-bool PhotoModel::matchesFilter(const PhotoInfo &info) const
+bool PhotoModel::matchesFilter(int id, FilterType filter) const
 {
-    switch (m_filterType) {
+    switch (filter) {
     case All:
         return true;
     case ImagesOnly:
-        return info.fileType == PhotoInfo::Image;
+        return m_store.fileType(id) == PhotoInfo::Image;
     case VideosOnly:
-        return info.fileType == PhotoInfo::Video;
+        return m_store.fileType(id) == PhotoInfo::Video;
     default:
         return true;
     }
@@ -748,8 +1017,8 @@ PhotoModel::getSelectedFilePaths(const QModelIndexList &indexes) const
 {
     QStringList paths;
     for (const QModelIndex &index : indexes) {
-        if (index.isValid() && index.row() < m_photos.size()) {
-            paths.append(m_photos.at(index.row()).filePath);
+        if (index.isValid() && index.row() < m_rows.size()) {
+            paths.append(m_store.filePath(m_rows.at(index.row())));
         }
     }
     return paths;
@@ -757,16 +1026,16 @@ PhotoModel::getSelectedFilePaths(const QModelIndexList &indexes) const
 
 QString PhotoModel::getFilePath(const QModelIndex &index) const
 {
-    if (index.isValid() && index.row() < m_photos.size()) {
-        return m_photos.at(index.row()).filePath;
+    if (index.isValid() && index.row() < m_rows.size()) {
+        return m_store.filePath(m_rows.at(index.row()));
     }
     return QString();
 }
 
 PhotoInfo::FileType PhotoModel::getFileType(const QModelIndex &index) const
 {
-    if (index.isValid() && index.row() < m_photos.size()) {
-        return m_photos.at(index.row()).fileType;
+    if (index.isValid() && index.row() < m_rows.size()) {
+        return m_store.fileType(m_rows.at(index.row()));
     }
     return PhotoInfo::Image;
 }
@@ -774,8 +1043,9 @@ PhotoInfo::FileType PhotoModel::getFileType(const QModelIndex &index) const
 QStringList PhotoModel::getAllFilePaths() const
 {
     QStringList paths;
-    for (const PhotoInfo &info : m_allPhotos) {
-        paths.append(info.filePath);
+    paths.reserve(m_store.size());
+    for (int id = 0; id < m_store.size(); ++id) {
+        paths.append(m_store.filePath(id));
     }
     return paths;
 }
@@ -783,87 +1053,15 @@ QStringList PhotoModel::getAllFilePaths() const
 QStringList PhotoModel::getFilteredFilePaths() const
 {
     QStringList paths;
-    for (const PhotoInfo &info : m_photos) {
-        paths.append(info.filePath);
+    paths.reserve(m_rows.size());
+    for (int id : m_rows) {
+        paths.append(m_store.filePath(id));
     }
     return paths;
 }
 
 // Helper methods
-QDateTime PhotoModel::extractDateTimeFromFile(const QString &filePath) const
-{
-    plist_t info = nullptr;
-    afc_error_t afc_err = ServiceManager::safeAfcGetFileInfoPlist(
-        m_device, filePath.toUtf8().constData(), &info);
-
-    if (afc_err == AFC_E_SUCCESS && info) {
-        plist_t birthtime_node = plist_dict_get_item(info, "st_birthtime");
-        if (birthtime_node &&
-            plist_get_node_type(birthtime_node) == PLIST_UINT) {
-            uint64_t birthtime_ns = 0;
-            plist_get_uint_val(birthtime_node, &birthtime_ns);
-
-            // Convert nanoseconds since epoch to QDateTime
-            // The timestamp appears to be in nanoseconds since Unix epoch
-            uint64_t seconds = birthtime_ns / 1000000000ULL;
-            QDateTime dateTime =
-                QDateTime::fromSecsSinceEpoch(seconds, Qt::UTC);
-
-            plist_free(info);
-            if (dateTime.isValid()) {
-                return dateTime;
-            }
-        }
-
-        // Fallback to st_mtime (modification time) if birthtime not available
-        plist_t mtime_node = plist_dict_get_item(info, "st_mtime");
-        if (mtime_node && plist_get_node_type(mtime_node) == PLIST_UINT) {
-            uint64_t mtime_ns = 0;
-            plist_get_uint_val(mtime_node, &mtime_ns);
-
-            // Convert nanoseconds since epoch to QDateTime
-            uint64_t seconds = mtime_ns / 1000000000ULL;
-            QDateTime dateTime =
-                QDateTime::fromSecsSinceEpoch(seconds, Qt::UTC);
-
-            plist_free(info);
-            if (dateTime.isValid()) {
-                return dateTime;
-            }
-        }
-
-        plist_free(info);
-    }
-
-    // Final fallback: try to extract date from filename pattern like
-    // IMG_20231025_143052.jpg
-    QFileInfo fileInfo(filePath);
-    QString baseName = fileInfo.baseName();
-
-    QRegularExpression dateRegex(
-        R"((\d{4})(\d{2})(\d{2})_(\d{2})(\d{2})(\d{2}))");
-    QRegularExpressionMatch match = dateRegex.match(baseName);
-
-    if (match.hasMatch()) {
-        int year = match.captured(1).toInt();
-        int month = match.captured(2).toInt();
-        int day = match.captured(3).toInt();
-        int hour = match.captured(4).toInt();
-        int minute = match.captured(5).toInt();
-        int second = match.captured(6).toInt();
-
-        QDateTime dateTime(QDate(year, month, day),
-                           QTime(hour, minute, second));
-        if (dateTime.isValid()) {
-            return dateTime;
-        }
-    }
-
-    // Ultimate fallback: return current time
-    return QDateTime::currentDateTime();
-}
-
-PhotoInfo::FileType PhotoModel::determineFileType(const QString &fileName) const
+PhotoInfo::FileType PhotoModel::determineFileType(const QString &fileName)
 {
     if (fileName.endsWith(".MOV", Qt::CaseInsensitive) ||
         fileName.endsWith(".MP4", Qt::CaseInsensitive) ||
@@ -876,13 +1074,34 @@ PhotoInfo::FileType PhotoModel::determineFileType(const QString &fileName) const
 
 void PhotoModel::setAlbumPath(const QString &albumPath)
 {
-    if (m_albumPath != albumPath) {
-        qDebug() << "Setting new album path:" << albumPath;
+    setAlbumPaths({albumPath});
+}
+
+void PhotoModel::setAlbumPaths(const QStringList &albumPaths)
+{
+    if (!m_assetPaths.isEmpty() || m_albumPaths != albumPaths) {
+        qDebug() << "Setting new album paths:" << albumPaths;
         clear();
 
-        m_albumPath = albumPath;
+        m_albumPaths = albumPaths;
         populatePhotoPaths();
     }
 }
 
-void PhotoModel::refreshPhotos() { populatePhotoPaths(); }
\ No newline at end of file
+void PhotoModel::setAssetPaths(const QStringList &filePaths)
+{
+    if (!m_albumPaths.isEmpty() || m_assetPaths != filePaths) {
+        qDebug() << "Setting" << filePaths.size() << "album files";
+        clear();
+
+        m_assetPaths = filePaths;
+        populatePhotoPaths();
+    }
+}
+
+void PhotoModel::refreshPhotos() { populatePhotoPaths(); }
+
+void PhotoModel::setLibraryIndex(std::shared_ptr<PhotoLibraryIndex> index)
+{
+    m_libraryIndex = std::move(index);
+}
\ No newline at end of file
@@ -21,25 +21,22 @@
 #define PHOTOMODEL_H
 
 #include "iDescriptor.h"
+#include "photolibraryindex.h"
+#include "photostore.h"
+#include "thumbnailscheduler.h"
 #include <QAbstractListModel>
-#include <QCache>
 #include <QCryptographicHash>
 #include <QDateTime>
+#include <QFuture>
 #include <QFutureWatcher>
 #include <QPixmap>
 #include <QSemaphore>
 #include <QSize>
 #include <QStandardPaths>
-
-struct PhotoInfo {
-    QString filePath;
-    QString fileName;
-    QDateTime dateTime;
-    bool thumbnailRequested = false;
-
-    enum FileType { Image, Video };
-    FileType fileType;
-};
+#include <QTimer>
+#include <atomic>
+#include <functional>
+#include <memory>
 
 class PhotoModel : public QAbstractListModel
 {
@@ -50,6 +47,20 @@ public:
 
     enum FilterType { All, ImagesOnly, VideosOnly };
 
+    enum Roles {
+        FilePathRole = Qt::UserRole,
+        // QPixmap once the thumbnail is cached, invalid until then
+        ThumbnailRole,
+        IsVideoRole,
+    };
+
+    // A run of rows captured on the same local day
+    struct DateBucket {
+        int day; // yyyymmdd, 0 for photos without a known date
+        int firstRow;
+        int count;
+    };
+
     explicit PhotoModel(iDescriptorDevice *device, FilterType filterType,
                         QObject *parent = nullptr);
     ~PhotoModel();
@@ -61,8 +72,25 @@ public:
 
     // Album management
     void setAlbumPath(const QString &albumPath);
+    // Lists several albums into one timeline, e.g. every DCIM folder
+    void setAlbumPaths(const QStringList &albumPaths);
+    // Shows an explicit set of files, e.g. a user album from Photos.sqlite
+    void setAssetPaths(const QStringList &filePaths);
     void refreshPhotos();
 
+    // Rows currently on screen, drives thumbnail priority and prefetch
+    void setVisibleRange(int first, int last);
+    // Loads thumbnails for rows that are about to be shown, e.g. after a
+    // jump, they stay queued while the visible range overlaps them
+    void prefetchRows(int first, int last);
+
+    // Date buckets in row order, kept up to date as rows come and go
+    const QList<DateBucket> &dateBuckets() const { return m_dateBuckets; }
+    int bucketForRow(int row) const;
+
+    // Photos.sqlite backed metadata, used instead of statting every file
+    void setLibraryIndex(std::shared_ptr<PhotoLibraryIndex> index);
+
     // Sorting and filtering
     void setSortOrder(SortOrder order);
     SortOrder sortOrder() const { return m_sortOrder; }
@@ -79,49 +107,88 @@ public:
     QStringList getAllFilePaths() const;
     QStringList getFilteredFilePaths() const;
 
-    static QPixmap loadImage(iDescriptorDevice *device,
-                             const QString &filePath);
+    // Full resolution decode, runs on worker threads
+    static QImage loadImage(iDescriptorDevice *device,
+                            const QString &filePath);
     // Static helper methods
-    static QPixmap loadThumbnailFromDevice(iDescriptorDevice *device,
-                                           const QString &filePath,
-                                           const QSize &size);
+    // Decodes at (close to) the requested size, runs on worker threads
+    static QImage loadThumbnailFromDevice(iDescriptorDevice *device,
+                                          const QString &filePath,
+                                          const QSize &size);
     void clear();
 signals:
     void thumbnailNeedsToBeLoaded(int index);
     void exportRequested(const QStringList &filePaths);
+    void dateBucketsChanged();
 
 private slots:
     void requestThumbnail(int index);
+    void onThumbnailReady(const QString &filePath, const QImage &thumbnail);
+    void flushPendingDates();
 
 private:
     // Data members
     iDescriptorDevice *m_device;
-    QString m_albumPath;
-    QList<PhotoInfo> m_allPhotos; // All photos from device
-    QList<PhotoInfo> m_photos;    // Currently filtered/sorted photos
+    QStringList m_albumPaths;
+    QStringList m_assetPaths;
+    std::shared_ptr<PhotoLibraryIndex> m_libraryIndex;
+    PhotoStore m_store;
+    // Photo ids, m_sorted holds every photo in sort order and m_rows the
+    // ones passing the filter, which are the model rows
+    QList<int> m_sorted;
+    QList<int> m_rows;
 
     // Thumbnail management
     QSize m_thumbnailSize;
-    mutable QCache<QString, QPixmap> m_thumbnailCache;
-    mutable QHash<QString, QFutureWatcher<QPixmap> *> m_activeLoaders;
-    mutable QSet<QString> m_loadingPaths;
+    ThumbnailScheduler *m_thumbnailScheduler;
+    QSet<QString> m_failedThumbnails;
+    int m_visibleFirst = -1;
+    int m_visibleLast = -1;
+    int m_prefetchFirst = -1;
+    int m_prefetchLast = -1;
+
+    QList<DateBucket> m_dateBuckets;
 
     // Sorting and filtering
     SortOrder m_sortOrder;
     FilterType m_filterType;
 
+    // Streaming population, see populatePhotoPaths()
+    quint64 m_generation = 0;
+    // Cancelled populations are left to finish on their own, only the
+    // destructor waits for them
+    QList<QFuture<void>> m_populateFutures;
+    std::shared_ptr<std::atomic<bool>> m_populateCancelled;
+    QHash<QString, qint64> m_pendingDates;
+    QTimer *m_dateFlushTimer;
+
     // Helper methods
     void populatePhotoPaths();
-    void applyFilterAndSort();
-    void sortPhotos(QList<PhotoInfo> &photos) const;
-    bool matchesFilter(const PhotoInfo &info) const;
-
-    QDateTime extractDateTimeFromFile(const QString &filePath) const;
-    PhotoInfo::FileType determineFileType(const QString &fileName) const;
+    void cancelPopulation();
+    void streamAlbumContents(const QStringList &albumPaths,
+                             const QStringList &assetPaths,
+                             std::shared_ptr<PhotoLibraryIndex> index,
+                             quint64 generation,
+                             std::shared_ptr<std::atomic<bool>> cancelled);
+    void insertPhotos(quint64 generation, const QList<PhotoInfo> &batch);
+    void applyDates(quint64 generation,
+                    const QHash<QString, qint64> &dates);
+    void mergeIntoSorted(QList<int> &ids,
+                         const QList<int> &sortedIds) const;
+    void insertSortedRows(const QList<int> &sortedIds);
+    void relayout(const std::function<void()> &reorder);
+    void resetRows();
+    int rowForId(int id) const;
+    bool idLessThan(int a, int b) const;
+    bool dayLessThan(int a, int b) const;
+    void addToBuckets(const QList<int> &ids);
+    void removeFromBuckets(const QList<int> &ids);
+    void updateBucketRows();
+    void rebuildBuckets();
+    bool matchesFilter(int id, FilterType filter) const;
+
+    static PhotoInfo::FileType determineFileType(const QString &fileName);
 
-    static QPixmap generateVideoThumbnailFFmpeg(iDescriptorDevice *device,
-                                                const QString &filePath,
-                                                const QSize &requestedSize);
     static QSemaphore m_videoThumbnailSemaphore;
 };
 
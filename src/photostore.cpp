@@ -0,0 +1,92 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "photostore.h"
+#include <QDateTime>
+
+// Converting to local time is the expensive part of bucketing by date, so
+// it is done once per photo here rather than every time buckets change
+qint32 PhotoStore::dayOf(qint64 msecs)
+{
+    if (msecs == UnknownTime)
+        return 0;
+
+    const QDate date = QDateTime::fromMSecsSinceEpoch(msecs).date();
+    return date.year() * 10000 + date.month() * 100 + date.day();
+}
+
+void PhotoStore::clear()
+{
+    m_albums.clear();
+    m_albumIndex.clear();
+    m_fileNames.clear();
+    m_captureTimes.clear();
+    m_days.clear();
+    m_albumIds.clear();
+    m_widths.clear();
+    m_heights.clear();
+    m_flags.clear();
+    m_idsByName.clear();
+}
+
+int PhotoStore::append(const PhotoInfo &info)
+{
+    auto album = m_albumIndex.constFind(info.albumPath);
+    if (album == m_albumIndex.constEnd()) {
+        album = m_albumIndex.insert(info.albumPath, quint16(m_albums.size()));
+        m_albums.append(info.albumPath);
+    }
+
+    const int id = m_fileNames.size();
+    m_fileNames.append(info.fileName);
+    m_captureTimes.append(info.captureTime);
+    m_days.append(dayOf(info.captureTime));
+    m_albumIds.append(album.value());
+    m_widths.append(quint16(qBound(0, info.dimensions.width(), 0xffff)));
+    m_heights.append(quint16(qBound(0, info.dimensions.height(), 0xffff)));
+    m_flags.append(quint8((info.fileType == PhotoInfo::Video ? VideoFlag : 0) |
+                          (info.favorite ? FavoriteFlag : 0)));
+    m_idsByName.insert(m_fileNames.last(), id);
+    return id;
+}
+
+int PhotoStore::find(const QString &filePath) const
+{
+    const int slash = filePath.lastIndexOf('/');
+    const QString fileName = filePath.mid(slash + 1);
+    const QStringView albumPath = QStringView(filePath).left(qMax(slash, 0));
+
+    for (auto it = m_idsByName.constFind(fileName);
+         it != m_idsByName.cend() && it.key() == fileName; ++it) {
+        if (m_albums.at(m_albumIds.at(it.value())) == albumPath)
+            return it.value();
+    }
+    return -1;
+}
+
+void PhotoStore::setCaptureTime(int id, qint64 msecs)
+{
+    m_captureTimes[id] = msecs;
+    m_days[id] = dayOf(msecs);
+}
+
+QString PhotoStore::filePath(int id) const
+{
+    return albumPath(id) + "/" + m_fileNames.at(id);
+}
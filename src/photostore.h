@@ -0,0 +1,105 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PHOTOSTORE_H
+#define PHOTOSTORE_H
+
+#include <QHash>
+#include <QList>
+#include <QMultiHash>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <limits>
+
+// One listed media file, only used to hand listings over to the store
+struct PhotoInfo {
+    enum FileType { Image, Video };
+
+    QString albumPath;
+    QString fileName;
+    qint64 captureTime; // msecs since epoch, PhotoStore::UnknownTime if unset
+    QSize dimensions;
+    bool favorite = false;
+    FileType fileType = Image;
+
+    QString filePath() const { return albumPath + "/" + fileName; }
+};
+
+/**
+ * @brief Compact structure-of-arrays storage for the photos of a gallery
+ *
+ * Every photo gets a stable id (its insertion index). Album directories are
+ * interned, so a photo costs its file name plus a few integers instead of
+ * two paths and a QDateTime. Views are kept as permutations of ids.
+ */
+class PhotoStore
+{
+public:
+    static constexpr qint64 UnknownTime = std::numeric_limits<qint64>::min();
+
+    int size() const { return m_fileNames.size(); }
+    void clear();
+
+    int append(const PhotoInfo &info);
+    // Returns -1 for paths that aren't in the store
+    int find(const QString &filePath) const;
+
+    QString filePath(int id) const;
+    const QString &fileName(int id) const { return m_fileNames.at(id); }
+    const QString &albumPath(int id) const
+    {
+        return m_albums.at(m_albumIds.at(id));
+    }
+    qint64 captureTime(int id) const { return m_captureTimes.at(id); }
+    void setCaptureTime(int id, qint64 msecs);
+    // Local capture date as yyyymmdd, 0 if the capture time is unknown
+    int day(int id) const { return m_days.at(id); }
+    PhotoInfo::FileType fileType(int id) const
+    {
+        return (m_flags.at(id) & VideoFlag) ? PhotoInfo::Video
+                                            : PhotoInfo::Image;
+    }
+    bool isFavorite(int id) const { return m_flags.at(id) & FavoriteFlag; }
+    QSize dimensions(int id) const
+    {
+        return QSize(m_widths.at(id), m_heights.at(id));
+    }
+
+private:
+    static qint32 dayOf(qint64 msecs);
+
+    enum Flag : quint8 { VideoFlag = 1, FavoriteFlag = 2 };
+
+    QStringList m_albums;
+    QHash<QString, quint16> m_albumIndex;
+
+    QStringList m_fileNames;
+    QList<qint64> m_captureTimes;
+    QList<qint32> m_days;
+    QList<quint16> m_albumIds;
+    QList<quint16> m_widths;
+    QList<quint16> m_heights;
+    QList<quint8> m_flags;
+
+    // Keyed by the shared file name strings, names repeat across albums
+    QMultiHash<QString, int> m_idsByName;
+};
+
+#endif // PHOTOSTORE_H
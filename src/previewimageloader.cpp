@@ -0,0 +1,131 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "previewimageloader.h"
+#include <QDebug>
+#include <QFutureWatcher>
+#include <QThreadPool>
+#include <QtConcurrent/QtConcurrent>
+
+namespace
+{
+// Full size decodes are large, two at a time is plenty and leaves the
+// global pool to the rest of the app
+QThreadPool *previewPool()
+{
+    static QThreadPool *pool = [] {
+        auto *pool = new QThreadPool();
+        pool->setMaxThreadCount(2);
+        return pool;
+    }();
+    return pool;
+}
+} // namespace
+
+PreviewImageLoader::PreviewImageLoader(Loader loader, qint64 budget,
+                                       QObject *parent)
+    : QObject(parent), m_loader(std::move(loader)), m_budget(budget)
+{
+}
+
+std::shared_ptr<const ImagePyramid>
+PreviewImageLoader::image(const QString &filePath) const
+{
+    return m_images.value(filePath);
+}
+
+void PreviewImageLoader::setWanted(const QStringList &orderedPaths)
+{
+    m_wanted = orderedPaths;
+
+    for (auto it = m_images.begin(); it != m_images.end();) {
+        if (m_wanted.contains(it.key())) {
+            ++it;
+            continue;
+        }
+        m_cost -= cost(it.value());
+        it = m_images.erase(it);
+    }
+
+    for (const QString &filePath : std::as_const(m_wanted)) {
+        if (!m_images.contains(filePath) && !m_loading.contains(filePath))
+            start(filePath);
+    }
+}
+
+void PreviewImageLoader::start(const QString &filePath)
+{
+    m_loading.insert(filePath);
+
+    using Result = std::shared_ptr<const ImagePyramid>;
+    auto *watcher = new QFutureWatcher<Result>(this);
+    connect(watcher, &QFutureWatcher<Result>::finished, this,
+            [this, watcher, filePath]() {
+                const Result image = watcher->result();
+                watcher->deleteLater();
+                m_loading.remove(filePath);
+
+                if (!m_wanted.contains(filePath))
+                    return;
+                if (image->isNull()) {
+                    emit imageFailed(filePath);
+                    return;
+                }
+                store(filePath, image);
+                emit imageLoaded(filePath, image);
+            });
+    watcher->setFuture(QtConcurrent::run(
+        previewPool(), [loader = m_loader, filePath]() -> Result {
+            return std::make_shared<const ImagePyramid>(loader(filePath));
+        }));
+}
+
+/*
+ * Makes room by evicting images ranked below the new one. The image on
+ * screen is always kept, a neighbour that doesn't fit is simply not
+ * cached and gets decoded again if the user steps to it.
+ */
+void PreviewImageLoader::store(
+    const QString &filePath, const std::shared_ptr<const ImagePyramid> &image)
+{
+    const qint64 imageCost = cost(image);
+    const qsizetype rank = m_wanted.indexOf(filePath);
+
+    for (qsizetype i = m_wanted.size() - 1;
+         i > rank && m_cost + imageCost > m_budget; --i) {
+        auto it = m_images.find(m_wanted[i]);
+        if (it == m_images.end())
+            continue;
+        m_cost -= cost(it.value());
+        m_images.erase(it);
+    }
+
+    if (rank > 0 && m_cost + imageCost > m_budget) {
+        qDebug() << "Preview budget exceeded, not keeping" << filePath;
+        return;
+    }
+    m_images.insert(filePath, image);
+    m_cost += imageCost;
+}
+
+qint64
+PreviewImageLoader::cost(const std::shared_ptr<const ImagePyramid> &image)
+{
+    return image->sizeInBytes();
+}
@@ -0,0 +1,82 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PREVIEWIMAGELOADER_H
+#define PREVIEWIMAGELOADER_H
+
+#include "imagepyramid.h"
+#include <QHash>
+#include <QImage>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include <memory>
+
+/**
+ * @brief Decodes full resolution preview images ahead of time
+ *
+ * Keeps the decoded images of the photo on screen and of the ones the user
+ * is likely to step to next, within a byte budget. The zoom pyramid is
+ * built on the worker right after decoding, so a prefetched photo is ready
+ * to be painted as soon as the user steps onto it. The wanted paths are
+ * ranked, the first one (the photo on screen) is always kept and the
+ * others only as long as they fit, evicting lower ranked images first.
+ * Decodes that already started can't be interrupted, results nobody wants
+ * anymore are dropped when they arrive.
+ */
+class PreviewImageLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Runs on a worker thread
+    using Loader = std::function<QImage(const QString &filePath)>;
+
+    PreviewImageLoader(Loader loader, qint64 budget,
+                       QObject *parent = nullptr);
+
+    // The decoded image, null if it isn't in memory (yet)
+    std::shared_ptr<const ImagePyramid> image(const QString &filePath) const;
+
+    // Paths by priority, starts decoding the ones that aren't loaded or
+    // loading and drops every cached image that isn't listed
+    void setWanted(const QStringList &orderedPaths);
+
+signals:
+    void imageLoaded(const QString &filePath,
+                     std::shared_ptr<const ImagePyramid> image);
+    void imageFailed(const QString &filePath);
+
+private:
+    void start(const QString &filePath);
+    void store(const QString &filePath,
+               const std::shared_ptr<const ImagePyramid> &image);
+    static qint64 cost(const std::shared_ptr<const ImagePyramid> &image);
+
+    Loader m_loader;
+    qint64 m_budget;
+    qint64 m_cost = 0;
+    QStringList m_wanted;
+    QHash<QString, std::shared_ptr<const ImagePyramid>> m_images;
+    QSet<QString> m_loading;
+};
+
+#endif // PREVIEWIMAGELOADER_H
@@ -0,0 +1,218 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "readaheadbuffer.h"
+#include "servicemanager.h"
+#include <QDebug>
+#include <QMutexLocker>
+#include <QThread>
+#include <cstring>
+#include <memory>
+
+ReadAheadBuffer::ReadAheadBuffer(iDescriptorDevice *device,
+                                 afc_client_t afcClient,
+                                 const QString &filePath, qint64 fileSize,
+                                 std::shared_ptr<StreamBlockCache> cache,
+                                 qsizetype capacity, Notify notify)
+    : m_device(device), m_afcClient(afcClient), m_filePath(filePath),
+      m_fileSize(fileSize), m_cache(std::move(cache)),
+      m_notify(std::move(notify)), m_ring(capacity, Qt::Uninitialized)
+{
+    m_thread = QThread::create([this]() { produce(); });
+    m_thread->setObjectName("ReadAhead");
+    m_thread->start();
+}
+
+ReadAheadBuffer::~ReadAheadBuffer()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopping = true;
+        m_wakeProducer.wakeAll();
+    }
+    // At most one AFC read to wait for
+    m_thread->wait();
+    delete m_thread;
+}
+
+void ReadAheadBuffer::seek(qint64 offset, qint64 end)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (offset >= m_position && offset <= m_position + m_size) {
+        // Still inside the window, keep what is buffered past offset
+        const qsizetype skip = offset - m_position;
+        m_head = (m_head + skip) % m_ring.size();
+        m_size -= skip;
+    } else {
+        // The producer drops the read it may have in flight
+        m_head = 0;
+        m_size = 0;
+        ++m_generation;
+    }
+    m_position = offset;
+    m_end = end;
+    m_failed = false;
+    m_wakeProducer.wakeAll();
+}
+
+qint64 ReadAheadBuffer::read(char *data, qint64 maxSize)
+{
+    QMutexLocker locker(&m_mutex);
+
+    const qsizetype count = qMin<qint64>(maxSize, m_size);
+    if (count == 0) {
+        if (m_failed)
+            return -1;
+        m_consumerWaiting = true;
+        return 0;
+    }
+
+    // Up to two copies, the bytes may wrap around the end of the ring
+    const qsizetype capacity = m_ring.size();
+    const qsizetype first = qMin(count, capacity - m_head);
+    std::memcpy(data, m_ring.constData() + m_head, first);
+    std::memcpy(data + first, m_ring.constData(), count - first);
+
+    m_head = (m_head + count) % capacity;
+    m_size -= count;
+    m_position += count;
+    m_wakeProducer.wakeAll();
+    return count;
+}
+
+/*
+ * Copies the block holding the fetch position into the ring, as much of it
+ * as fits. A partly copied block is found in the cache again on the next
+ * round, so the ring never waits for room for a whole block.
+ */
+void ReadAheadBuffer::produce()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_stopping) {
+        const qint64 fetchOffset = m_position + m_size;
+        const qint64 space = m_ring.size() - m_size;
+        if (m_failed || space <= 0 || fetchOffset >= m_end) {
+            m_wakeProducer.wait(&m_mutex);
+            continue;
+        }
+        const quint64 generation = m_generation;
+
+        locker.unlock();
+        const qint64 block = fetchOffset / StreamBlockCache::BlockSize;
+        QByteArray data;
+        const bool ok = readBlock(block, &data);
+        locker.relock();
+
+        // A seek dropped the window while we were reading
+        if (generation != m_generation)
+            continue;
+
+        bool notify = false;
+        const qint64 skip = fetchOffset - block * StreamBlockCache::BlockSize;
+        if (!ok || skip >= data.size()) {
+            qWarning() << "ReadAheadBuffer: AFC read failed for"
+                       << m_filePath << "at" << fetchOffset;
+            m_failed = true;
+            notify = true;
+        } else {
+            // Nothing but us writes to the free part of the ring, and a
+            // seek inside the window leaves the fetch position alone
+            const qsizetype count =
+                qMin<qint64>({data.size() - skip, m_ring.size() - m_size,
+                              m_end - (m_position + m_size)});
+            if (count <= 0)
+                continue; // The window shrank meanwhile
+            const qsizetype capacity = m_ring.size();
+            const qsizetype tail = (m_head + m_size) % capacity;
+            const qsizetype first = qMin(count, capacity - tail);
+            std::memcpy(m_ring.data() + tail, data.constData() + skip, first);
+            std::memcpy(m_ring.data(), data.constData() + skip + first,
+                        count - first);
+            m_size += count;
+            notify = m_consumerWaiting;
+        }
+
+        if (notify) {
+            m_consumerWaiting = false;
+            locker.unlock();
+            m_notify();
+            locker.relock();
+        }
+    }
+    locker.unlock();
+
+    if (m_handle != 0) {
+        ServiceManager::safeAfcFileClose(m_device, m_handle, m_afcClient);
+    }
+}
+
+// From the shared cache, or from the device on a miss
+bool ReadAheadBuffer::readBlock(qint64 block, QByteArray *data)
+{
+    if (m_cache->find(block, data))
+        return true;
+
+    const qint64 blockStart = block * StreamBlockCache::BlockSize;
+    const qint64 length =
+        qMin(StreamBlockCache::BlockSize, m_fileSize - blockStart);
+    if (length <= 0)
+        return false;
+
+    if (m_handle == 0) {
+        const QByteArray pathBytes = m_filePath.toUtf8();
+        if (ServiceManager::safeAfcFileOpen(m_device, pathBytes.constData(),
+                                            AFC_FOPEN_RDONLY, &m_handle,
+                                            m_afcClient) != AFC_E_SUCCESS ||
+            m_handle == 0) {
+            m_handle = 0;
+            return false;
+        }
+        m_handleOffset = 0;
+    }
+    if (m_handleOffset != blockStart) {
+        if (ServiceManager::safeAfcFileSeek(m_device, m_handle, blockStart,
+                                            SEEK_SET, m_afcClient) !=
+            AFC_E_SUCCESS) {
+            m_handleOffset = -1;
+            return false;
+        }
+        m_handleOffset = blockStart;
+    }
+
+    // AFC may return less than asked for
+    data->resize(length);
+    qint64 filled = 0;
+    while (filled < length) {
+        uint32_t bytesRead = 0;
+        if (ServiceManager::safeAfcFileRead(
+                m_device, m_handle, data->data() + filled,
+                uint32_t(length - filled), &bytesRead,
+                m_afcClient) != AFC_E_SUCCESS ||
+            bytesRead == 0) {
+            m_handleOffset = -1;
+            return false;
+        }
+        filled += bytesRead;
+        m_handleOffset += bytesRead;
+    }
+
+    m_cache->insert(block, *data);
+    return true;
+}
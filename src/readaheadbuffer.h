@@ -0,0 +1,106 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef READAHEADBUFFER_H
+#define READAHEADBUFFER_H
+
+#include "iDescriptor.h"
+#include "streamblockcache.h"
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QWaitCondition>
+#include <functional>
+#include <libimobiledevice/afc.h>
+#include <memory>
+
+QT_BEGIN_NAMESPACE
+class QThread;
+QT_END_NAMESPACE
+
+/**
+ * @brief Reads a device file ahead of the playback position
+ *
+ * A producer thread keeps a ring buffer filled with the bytes following the
+ * read position, so USB and AFC latency spikes are absorbed by the buffer
+ * instead of stalling the player. The consumer never blocks: read() returns
+ * what is buffered and the notify callback fires from the producer thread
+ * once data arrives for a consumer that ran dry. A full buffer pauses the
+ * producer, which is how a slow socket throttles reading.
+ *
+ * seek() keeps whatever is already buffered past the new position, a jump
+ * outside the window just resets the indices and the producer continues
+ * from there on the same AFC handle.
+ *
+ * The file is read in StreamBlockCache blocks through a cache shared with
+ * the other readers of the same file, each reader has its own AFC handle
+ * for the blocks that aren't cached.
+ */
+class ReadAheadBuffer
+{
+public:
+    using Notify = std::function<void()>;
+
+    ReadAheadBuffer(iDescriptorDevice *device, afc_client_t afcClient,
+                    const QString &filePath, qint64 fileSize,
+                    std::shared_ptr<StreamBlockCache> cache,
+                    qsizetype capacity, Notify notify);
+    ~ReadAheadBuffer();
+
+    // Moves the read position to offset, the producer stops at end
+    // (exclusive)
+    void seek(qint64 offset, qint64 end);
+
+    // Copies up to maxSize bytes from the read position, 0 if nothing is
+    // buffered yet and -1 once the file can't be read anymore
+    qint64 read(char *data, qint64 maxSize);
+
+    const QString &filePath() const { return m_filePath; }
+
+private:
+    void produce();
+    bool readBlock(qint64 block, QByteArray *data);
+
+    iDescriptorDevice *m_device;
+    afc_client_t m_afcClient;
+    QString m_filePath;
+    qint64 m_fileSize;
+    std::shared_ptr<StreamBlockCache> m_cache;
+    Notify m_notify;
+    QThread *m_thread;
+
+    // Producer thread only
+    uint64_t m_handle = 0;
+    qint64 m_handleOffset = -1;
+
+    // Everything below is guarded by m_mutex
+    QMutex m_mutex;
+    QWaitCondition m_wakeProducer;
+    QByteArray m_ring;
+    qsizetype m_head = 0;     // ring index of the read position
+    qsizetype m_size = 0;     // buffered bytes after the read position
+    qint64 m_position = 0;    // file offset of the read position
+    qint64 m_end = 0;         // the producer stops here
+    quint64 m_generation = 0; // bumped by seeks that drop the window
+    bool m_consumerWaiting = false;
+    bool m_failed = false;
+    bool m_stopping = false;
+};
+
+#endif // READAHEADBUFFER_H
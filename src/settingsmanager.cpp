@@ -89,6 +89,11 @@ QString SettingsManager::homePath()
            "/.idescriptor";
 }
 
+QString SettingsManager::cachePath()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+}
+
 bool SettingsManager::autoCheckUpdates() const
 {
     return m_settings->value("autoCheckUpdates", true).toBool();
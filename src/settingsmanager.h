@@ -46,6 +46,7 @@ public:
         ConnectionTimeout
     };
     static QString homePath();
+    static QString cachePath();
     QString devdiskimgpath() const;
     void setDevDiskImgPath(const QString &path);
     QString mkDevDiskImgPath() const;
@@ -0,0 +1,64 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "streamblockcache.h"
+#include "streamdiskcache.h"
+#include <QMutexLocker>
+
+// Costs are in KB
+StreamBlockCache::StreamBlockCache(qint64 budget,
+                                   std::shared_ptr<StreamCacheFile> diskCache)
+    : m_blocks(qMax<qint64>(1, budget / 1024)),
+      m_diskCache(std::move(diskCache))
+{
+}
+
+StreamBlockCache::~StreamBlockCache() = default;
+
+bool StreamBlockCache::find(qint64 block, QByteArray *data) const
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (const QByteArray *cached = m_blocks.object(block)) {
+            *data = *cached;
+            return true;
+        }
+    }
+
+    // Disk reads happen outside the lock, other readers may hit memory
+    if (!m_diskCache || !m_diskCache->readBlock(block, data))
+        return false;
+
+    QMutexLocker locker(&m_mutex);
+    m_blocks.insert(block, new QByteArray(*data),
+                    qMax<qsizetype>(1, data->size() / 1024));
+    return true;
+}
+
+void StreamBlockCache::insert(qint64 block, const QByteArray &data)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_blocks.insert(block, new QByteArray(data),
+                        qMax<qsizetype>(1, data.size() / 1024));
+    }
+
+    if (m_diskCache)
+        m_diskCache->writeBlock(block, data);
+}
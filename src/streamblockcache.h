@@ -0,0 +1,62 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STREAMBLOCKCACHE_H
+#define STREAMBLOCKCACHE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <memory>
+
+class StreamCacheFile;
+
+/**
+ * @brief Recently read blocks of one streamed file
+ *
+ * Shared by every connection streaming the same file. Players open several
+ * overlapping ranges while scrubbing and re-read the index near the start
+ * or end of the file, those reads are answered from memory instead of
+ * going over USB again. Blocks are BlockSize aligned, only the last block
+ * of a file is shorter. Thread safe, readers fill it from their producer
+ * threads.
+ *
+ * With a StreamCacheFile behind it, every block read from the device is
+ * also written to local disk and blocks missing in memory are looked up
+ * there before the reader falls back to USB.
+ */
+class StreamBlockCache
+{
+public:
+    static constexpr qint64 BlockSize = 256 * 1024;
+
+    StreamBlockCache(qint64 budget,
+                     std::shared_ptr<StreamCacheFile> diskCache = nullptr);
+    ~StreamBlockCache();
+
+    bool find(qint64 block, QByteArray *data) const;
+    void insert(qint64 block, const QByteArray &data);
+
+private:
+    mutable QMutex m_mutex;
+    mutable QCache<qint64, QByteArray> m_blocks;
+    std::shared_ptr<StreamCacheFile> m_diskCache;
+};
+
+#endif // STREAMBLOCKCACHE_H
@@ -0,0 +1,272 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "streamdiskcache.h"
+#include "settingsmanager.h"
+#include "streamblockcache.h"
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <algorithm>
+
+namespace
+{
+constexpr qint64 MB = 1024 * 1024;
+constexpr qint64 DISK_CACHE_LIMIT = 2048 * MB;
+constexpr quint32 MAP_MAGIC = 0x69445343; // "iDSC"
+// Version 1 data files were sparse and laid out like the device file
+constexpr quint32 MAP_VERSION = 2;
+} // namespace
+
+StreamCacheFile::StreamCacheFile(const QString &basePath, qint64 fileSize)
+    : m_basePath(basePath), m_fileSize(fileSize),
+      m_data(basePath + ".bin")
+{
+    const qint64 blockCount =
+        (fileSize + StreamBlockCache::BlockSize - 1) /
+        StreamBlockCache::BlockSize;
+    loadMap();
+    if (m_slots.size() != blockCount) {
+        m_slots = QList<qint32>(blockCount, -1);
+        m_slotCount = 0;
+    }
+
+    if (!m_data.open(QIODevice::ReadWrite)) {
+        qWarning() << "StreamDiskCache: could not open" << m_data.fileName();
+        m_slots.fill(-1);
+        m_slotCount = 0;
+        return;
+    }
+
+    // A data file shorter than the table says can't be trusted, a longer
+    // one has blocks from a session that didn't get to save its table
+    for (qint64 block = 0; block < m_slots.size(); ++block) {
+        const qint32 slot = m_slots.at(block);
+        if (slot < 0)
+            continue;
+        const qint64 end =
+            qint64(slot) * StreamBlockCache::BlockSize + blockLength(block);
+        if (end > m_data.size()) {
+            m_slots.fill(-1);
+            m_slotCount = 0;
+            break;
+        }
+    }
+    const qint64 used = qMin(
+        m_data.size(), qint64(m_slotCount) * StreamBlockCache::BlockSize);
+    if (m_data.size() != used && !m_data.resize(used)) {
+        qWarning() << "StreamDiskCache: could not truncate"
+                   << m_data.fileName();
+    }
+}
+
+StreamCacheFile::~StreamCacheFile()
+{
+    const qint64 diskBytes = m_data.size();
+    m_data.close();
+    saveMap();
+    StreamDiskCache::sharedInstance()->fileClosed(
+        QFileInfo(m_basePath).fileName(), diskBytes);
+}
+
+void StreamCacheFile::loadMap()
+{
+    QFile file(m_basePath + ".map");
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint64 fileSize = 0;
+    QList<qint32> slots;
+    in >> magic >> version >> fileSize >> slots;
+    if (in.status() != QDataStream::Ok || magic != MAP_MAGIC ||
+        version != MAP_VERSION || fileSize != m_fileSize) {
+        return;
+    }
+
+    // Slots are handed out in order, the next one goes after the last
+    qint32 slotCount = 0;
+    for (qint32 slot : std::as_const(slots))
+        slotCount = qMax(slotCount, slot + 1);
+    m_slots = slots;
+    m_slotCount = slotCount;
+}
+
+// Also saved when nothing changed, the map's mtime is the LRU timestamp
+void StreamCacheFile::saveMap()
+{
+    QSaveFile file(m_basePath + ".map");
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "StreamDiskCache: could not write" << file.fileName();
+        return;
+    }
+
+    QDataStream out(&file);
+    out << MAP_MAGIC << MAP_VERSION << m_fileSize << m_slots;
+    if (out.status() != QDataStream::Ok || !file.commit()) {
+        qWarning() << "StreamDiskCache: could not write" << file.fileName();
+    }
+}
+
+qint64 StreamCacheFile::blockLength(qint64 block) const
+{
+    return qMin(StreamBlockCache::BlockSize,
+                m_fileSize - block * StreamBlockCache::BlockSize);
+}
+
+bool StreamCacheFile::readBlock(qint64 block, QByteArray *data)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_data.isOpen() || block < 0 || block >= m_slots.size() ||
+        m_slots.at(block) < 0) {
+        return false;
+    }
+
+    const qint64 start =
+        qint64(m_slots.at(block)) * StreamBlockCache::BlockSize;
+    const qint64 length = blockLength(block);
+    data->resize(length);
+    return m_data.seek(start) && m_data.read(data->data(), length) == length;
+}
+
+void StreamCacheFile::writeBlock(qint64 block, const QByteArray &data)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_data.isOpen() || block < 0 || block >= m_slots.size() ||
+        m_slots.at(block) >= 0 || data.size() != blockLength(block)) {
+        return;
+    }
+
+    // One clip never takes more than the whole cache, the rest of it is
+    // streamed from the device as before
+    const qint64 start = qint64(m_slotCount) * StreamBlockCache::BlockSize;
+    if (start + data.size() > DISK_CACHE_LIMIT)
+        return;
+
+    // A failed write leaves the slot free, the next block overwrites it
+    if (m_data.seek(start) && m_data.write(data) == data.size()) {
+        m_slots[block] = m_slotCount++;
+    }
+}
+
+// Never destroyed, cache files still open at exit report back to it from
+// other static destructors
+StreamDiskCache *StreamDiskCache::sharedInstance()
+{
+    static StreamDiskCache *self = new StreamDiskCache();
+    return self;
+}
+
+StreamDiskCache::StreamDiskCache()
+{
+    m_dir = SettingsManager::cachePath() + "/streams";
+    QDir().mkpath(m_dir);
+}
+
+QString StreamDiskCache::key(const std::string &udid, const QString &filePath,
+                             quint64 mtime)
+{
+    return QString::fromStdString(udid) + ':' + filePath + ':' +
+           QString::number(mtime);
+}
+
+std::shared_ptr<StreamCacheFile> StreamDiskCache::open(const QString &key,
+                                                       qint64 fileSize)
+{
+    const QString baseName = QString::fromLatin1(
+        QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1)
+            .toHex());
+
+    QMutexLocker locker(&m_mutex);
+    for (auto it = m_open.constFind(baseName); it != m_open.cend();
+         it = m_open.constFind(baseName)) {
+        if (std::shared_ptr<StreamCacheFile> file = it->lock())
+            return file;
+        // The last stream went away but its object is still closing the
+        // data file and saving the map, a new one would load them half
+        // written
+        m_fileClosed.wait(&m_mutex);
+    }
+
+    std::shared_ptr<StreamCacheFile> file(
+        new StreamCacheFile(m_dir + '/' + baseName, fileSize));
+    m_open.insert(baseName, file);
+    return file;
+}
+
+void StreamDiskCache::fileClosed(const QString &baseName, qint64 diskBytes)
+{
+    QMutexLocker locker(&m_mutex);
+    loadIndex();
+    // open() waits for this before it makes a new object for the file
+    m_open.remove(baseName);
+    m_fileClosed.wakeAll();
+    m_index.insert(baseName,
+                   {diskBytes, QDateTime::currentMSecsSinceEpoch()});
+    evict();
+}
+
+// Sizes are what the data files take on disk, the maps' mtimes are the
+// LRU timestamps. Data files without a map are leftovers and count too.
+void StreamDiskCache::loadIndex()
+{
+    if (m_indexLoaded)
+        return;
+    m_indexLoaded = true;
+
+    const QFileInfoList files =
+        QDir(m_dir).entryInfoList({"*.bin", "*.map"}, QDir::Files);
+    for (const QFileInfo &info : files) {
+        IndexEntry &entry = m_index[info.completeBaseName()];
+        if (info.suffix() == "bin") {
+            entry.bytes = info.size();
+        } else {
+            entry.lastUsed = info.lastModified().toMSecsSinceEpoch();
+        }
+    }
+}
+
+void StreamDiskCache::evict()
+{
+    qint64 total = 0;
+    QList<std::pair<qint64, QString>> candidates;
+    for (auto it = m_index.cbegin(); it != m_index.cend(); ++it) {
+        total += it->bytes;
+        if (!m_open.contains(it.key()))
+            candidates.append({it->lastUsed, it.key()});
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (const auto &[lastUsed, baseName] : std::as_const(candidates)) {
+        if (total <= DISK_CACHE_LIMIT)
+            break;
+        Q_UNUSED(lastUsed)
+        total -= m_index.take(baseName).bytes;
+        QFile::remove(m_dir + '/' + baseName + ".bin");
+        QFile::remove(m_dir + '/' + baseName + ".map");
+        qDebug() << "StreamDiskCache: evicted" << baseName;
+    }
+}
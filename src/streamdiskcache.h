@@ -0,0 +1,109 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef STREAMDISKCACHE_H
+#define STREAMDISKCACHE_H
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QWaitCondition>
+#include <memory>
+
+/**
+ * @brief Partial local copy of one streamed device file
+ *
+ * Blocks are appended to the data file in the order they were streamed,
+ * so it only ever takes the space of what was actually played, also on
+ * file systems without sparse files. A table next to it maps each block
+ * of the device file to its slot in the data file and is saved when the
+ * last stream of the file goes away. Thread safe, blocks are read and
+ * written from the readers' producer threads.
+ */
+class StreamCacheFile
+{
+public:
+    ~StreamCacheFile();
+
+    bool readBlock(qint64 block, QByteArray *data);
+    void writeBlock(qint64 block, const QByteArray &data);
+
+private:
+    friend class StreamDiskCache;
+    StreamCacheFile(const QString &basePath, qint64 fileSize);
+    void loadMap();
+    void saveMap();
+    qint64 blockLength(qint64 block) const;
+
+    QString m_basePath;
+    qint64 m_fileSize;
+    QMutex m_mutex;
+    QFile m_data;
+    // Slot of every block in the data file, -1 if it isn't cached
+    QList<qint32> m_slots;
+    qint32 m_slotCount = 0;
+};
+
+/**
+ * @brief On-disk cache of streamed video previews
+ *
+ * Files are keyed by device, path and modification time, so an edited clip
+ * doesn't serve stale bytes. Reopening a clip, or seeking back into a part
+ * that was already played, reads from local disk instead of USB. The
+ * total size is kept under a limit by dropping the least recently used
+ * files that aren't being streamed.
+ */
+class StreamDiskCache
+{
+public:
+    static StreamDiskCache *sharedInstance();
+
+    static QString key(const std::string &udid, const QString &filePath,
+                       quint64 mtime);
+
+    // The same object for every stream of a file that is open right now
+    std::shared_ptr<StreamCacheFile> open(const QString &key,
+                                          qint64 fileSize);
+
+private:
+    StreamDiskCache();
+    Q_DISABLE_COPY(StreamDiskCache)
+
+    friend class StreamCacheFile;
+    void fileClosed(const QString &baseName, qint64 diskBytes);
+    void loadIndex();
+    void evict();
+
+    struct IndexEntry {
+        qint64 bytes = 0;    // size of the data file
+        qint64 lastUsed = 0; // msecs since epoch
+    };
+
+    QString m_dir;
+    QMutex m_mutex;
+    bool m_indexLoaded = false;
+    QHash<QString, IndexEntry> m_index; // by base name
+    // Files with a stream, or whose last stream is still saving its map
+    QHash<QString, std::weak_ptr<StreamCacheFile>> m_open;
+    QWaitCondition m_fileClosed;
+};
+
+#endif // STREAMDISKCACHE_H
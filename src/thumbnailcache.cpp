@@ -0,0 +1,332 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "thumbnailcache.h"
+#include "appcontext.h"
+#include "settingsmanager.h"
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QMutexLocker>
+#include <QSaveFile>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_MACOS)
+#include <sys/sysctl.h>
+#include <sys/types.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+constexpr qint64 MB = 1024 * 1024;
+// Budget is 1/32 of system RAM within these bounds, a quarter of it goes to
+// decoded pixmaps
+constexpr qint64 MIN_BUDGET = 64 * MB;
+constexpr qint64 MAX_BUDGET = 512 * MB;
+constexpr int WARM_QUALITY = 85;
+constexpr quint32 CAPTURE_TIMES_MAGIC = 0x69444354; // "iDCT"
+constexpr quint32 CAPTURE_TIMES_VERSION = 1;
+} // namespace
+
+/*
+    Never destroyed, the first caller may be a worker thread and a static
+    instance would free its pixmaps after QApplication is gone. The hot tier
+    is emptied on aboutToQuit instead.
+*/
+ThumbnailCache *ThumbnailCache::sharedInstance()
+{
+    static ThumbnailCache *self = new ThumbnailCache();
+    return self;
+}
+
+ThumbnailCache::ThumbnailCache()
+{
+    const qint64 ram = systemMemory();
+    m_budget = ram > 0 ? qBound(MIN_BUDGET, ram / 32, MAX_BUDGET) : MIN_BUDGET;
+
+    // QCache costs are ints, keep them in KB
+    m_hot.setMaxCost(int(m_budget / 4 / 1024));
+    m_warm.setMaxCost(int((m_budget - m_budget / 4) / 1024));
+
+    qDebug() << "ThumbnailCache: system memory" << ram / MB << "MB, budget"
+             << m_budget / MB << "MB";
+
+    m_diskDir = SettingsManager::cachePath() + "/thumbnails";
+    QDir().mkpath(m_diskDir);
+
+    QObject::connect(AppContext::sharedInstance(), &AppContext::deviceRemoved,
+                     AppContext::sharedInstance(),
+                     [this](const std::string &udid) { removeDevice(udid); });
+
+    // Both connections run on the GUI thread whichever thread got here first
+    QObject::connect(QCoreApplication::instance(),
+                     &QCoreApplication::aboutToQuit,
+                     QCoreApplication::instance(), [this]() { m_hot.clear(); });
+}
+
+qint64 ThumbnailCache::systemMemory()
+{
+#if defined(Q_OS_WIN)
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status))
+        return qint64(status.ullTotalPhys);
+    return 0;
+#elif defined(Q_OS_MACOS)
+    int64_t memSize = 0;
+    size_t length = sizeof(memSize);
+    if (sysctlbyname("hw.memsize", &memSize, &length, nullptr, 0) == 0)
+        return qint64(memSize);
+    return 0;
+#else
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long pageSize = sysconf(_SC_PAGE_SIZE);
+    if (pages > 0 && pageSize > 0)
+        return qint64(pages) * pageSize;
+    return 0;
+#endif
+}
+
+QString ThumbnailCache::key(const iDescriptorDevice *device,
+                            const QString &filePath)
+{
+    return QString::fromStdString(device->udid) + ':' + filePath;
+}
+
+bool ThumbnailCache::find(const QString &key, QPixmap *pixmap)
+{
+    if (QPixmap *cached = m_hot.object(key)) {
+        *pixmap = *cached;
+        return true;
+    }
+
+    QByteArray compressed;
+    {
+        QMutexLocker locker(&m_warmMutex);
+        QByteArray *warm = m_warm.object(key);
+        if (!warm)
+            return false;
+        compressed = *warm;
+    }
+
+    QPixmap decoded;
+    if (!decoded.loadFromData(compressed)) {
+        QMutexLocker locker(&m_warmMutex);
+        m_warm.remove(key);
+        return false;
+    }
+
+    insert(key, decoded);
+    *pixmap = decoded;
+    return true;
+}
+
+void ThumbnailCache::insert(const QString &key, const QPixmap &pixmap)
+{
+    if (pixmap.isNull())
+        return;
+
+    const int costKb =
+        qMax(1, int(qint64(pixmap.width()) * pixmap.height() * 4 / 1024));
+    m_hot.insert(key, new QPixmap(pixmap), costKb);
+}
+
+bool ThumbnailCache::contains(const QString &key) const
+{
+    QMutexLocker locker(&m_warmMutex);
+    return m_warm.contains(key);
+}
+
+void ThumbnailCache::insertCompressed(const QString &key, const QImage &image)
+{
+    if (image.isNull())
+        return;
+
+    QByteArray compressed;
+    QBuffer buffer(&compressed);
+    buffer.open(QIODevice::WriteOnly);
+    // JPEG drops alpha, keep PNG screenshots with transparency lossless
+    const bool ok = image.hasAlphaChannel()
+                        ? image.save(&buffer, "PNG")
+                        : image.save(&buffer, "JPG", WARM_QUALITY);
+    if (!ok) {
+        qWarning() << "ThumbnailCache: could not compress thumbnail for"
+                   << key;
+        return;
+    }
+
+    QMutexLocker locker(&m_warmMutex);
+    const int costKb = qMax(1, int(compressed.size() / 1024));
+    m_warm.insert(key, new QByteArray(std::move(compressed)), costKb);
+}
+
+void ThumbnailCache::removeDevice(const std::string &udid)
+{
+    const QString prefix = QString::fromStdString(udid) + ':';
+
+    // Called from AppContext::deviceRemoved on the GUI thread, so the hot
+    // tier can be touched here
+    const QList<QString> hotKeys = m_hot.keys();
+    for (const QString &key : hotKeys) {
+        if (key.startsWith(prefix))
+            m_hot.remove(key);
+    }
+
+    QMutexLocker locker(&m_warmMutex);
+    const QList<QString> warmKeys = m_warm.keys();
+    for (const QString &key : warmKeys) {
+        if (key.startsWith(prefix))
+            m_warm.remove(key);
+    }
+}
+
+QString ThumbnailCache::diskBaseName(const QString &key) const
+{
+    return QString::fromLatin1(
+        QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1)
+            .toHex());
+}
+
+QImage ThumbnailCache::loadFromDisk(const QString &key,
+                                    const QString &version) const
+{
+    const QString path =
+        m_diskDir + '/' + diskBaseName(key) + '_' + version + ".jpg";
+    if (!QFile::exists(path))
+        return QImage();
+
+    QImage image(path);
+    if (image.isNull()) {
+        qDebug() << "ThumbnailCache: dropping unreadable" << path;
+        QFile::remove(path);
+    }
+    return image;
+}
+
+void ThumbnailCache::saveToDisk(const QString &key, const QString &version,
+                                const QImage &image) const
+{
+    if (image.isNull())
+        return;
+
+    const QString baseName = diskBaseName(key);
+
+    // Thumbnails of older revisions of the same file are stale now
+    const QStringList stale =
+        QDir(m_diskDir).entryList({baseName + "_*.jpg"}, QDir::Files);
+    for (const QString &name : stale) {
+        QFile::remove(m_diskDir + '/' + name);
+    }
+
+    QSaveFile file(m_diskDir + '/' + baseName + '_' + version + ".jpg");
+    if (!file.open(QIODevice::WriteOnly) ||
+        !image.save(&file, "JPG", WARM_QUALITY) || !file.commit()) {
+        qWarning() << "ThumbnailCache: could not write" << file.fileName();
+    }
+}
+
+void ThumbnailCache::loadCaptureTimes()
+{
+    m_captureTimesLoaded = true;
+
+    QFile file(m_diskDir + "/capturetimes.bin");
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream in(&file);
+    quint32 magic = 0;
+    quint32 version = 0;
+    in >> magic >> version;
+    if (magic != CAPTURE_TIMES_MAGIC || version != CAPTURE_TIMES_VERSION)
+        return;
+
+    quint32 count = 0;
+    in >> count;
+    m_captureTimes.reserve(count);
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        QString key;
+        CaptureTime entry;
+        in >> key >> entry.version >> entry.msecs;
+        m_captureTimes.insert(key, entry);
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        qDebug() << "ThumbnailCache: dropping unreadable capture times";
+        m_captureTimes.clear();
+    }
+}
+
+bool ThumbnailCache::findCaptureTime(const QString &key,
+                                     const QString &version, qint64 *msecs)
+{
+    QMutexLocker locker(&m_captureMutex);
+    if (!m_captureTimesLoaded)
+        loadCaptureTimes();
+
+    auto it = m_captureTimes.constFind(key);
+    if (it == m_captureTimes.constEnd() || it->version != version)
+        return false;
+    *msecs = it->msecs;
+    return true;
+}
+
+void ThumbnailCache::insertCaptureTime(const QString &key,
+                                       const QString &version, qint64 msecs)
+{
+    QMutexLocker locker(&m_captureMutex);
+    if (!m_captureTimesLoaded)
+        loadCaptureTimes();
+
+    m_captureTimes.insert(key, CaptureTime{version, msecs});
+    m_captureTimesDirty = true;
+}
+
+void ThumbnailCache::saveCaptureTimes()
+{
+    QMutexLocker locker(&m_captureMutex);
+    if (!m_captureTimesDirty)
+        return;
+
+    QSaveFile file(m_diskDir + "/capturetimes.bin");
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "ThumbnailCache: could not write" << file.fileName();
+        return;
+    }
+
+    QDataStream out(&file);
+    out << CAPTURE_TIMES_MAGIC << CAPTURE_TIMES_VERSION
+        << quint32(m_captureTimes.size());
+    for (auto it = m_captureTimes.cbegin(); it != m_captureTimes.cend();
+         ++it) {
+        out << it.key() << it->version << it->msecs;
+    }
+
+    if (!file.commit()) {
+        qWarning() << "ThumbnailCache: could not write" << file.fileName();
+        return;
+    }
+    m_captureTimesDirty = false;
+}
@@ -0,0 +1,107 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include "iDescriptor.h"
+#include <QByteArray>
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QMutex>
+#include <QPixmap>
+#include <QString>
+
+/**
+ * @brief Process wide thumbnail cache shared by all galleries and devices
+ *
+ * Two tiers share one memory budget derived from the amount of system RAM:
+ * a small hot tier of decoded pixmaps that the views paint from, and a
+ * larger warm tier of JPEG compressed thumbnails. Thumbnails evicted from
+ * the hot tier are still in the warm tier and only cost a small decode to
+ * bring back, instead of another read from the device.
+ *
+ * Thumbnails that are expensive to make (video poster frames) can also be
+ * kept on disk, tagged with a version describing the source file so they
+ * are remade when it changes. Capture dates parsed from file headers are
+ * kept next to them in a single table, versioned the same way.
+ *
+ * The hot tier holds QPixmaps and must only be used from the GUI thread,
+ * the warm and disk tiers can be used from worker threads.
+ */
+class ThumbnailCache
+{
+public:
+    static ThumbnailCache *sharedInstance();
+
+    static QString key(const iDescriptorDevice *device,
+                       const QString &filePath);
+
+    // GUI thread only
+    bool find(const QString &key, QPixmap *pixmap);
+    void insert(const QString &key, const QPixmap &pixmap);
+
+    // Thread safe
+    bool contains(const QString &key) const;
+    void insertCompressed(const QString &key, const QImage &image);
+    void removeDevice(const std::string &udid);
+
+    // Thread safe
+    QImage loadFromDisk(const QString &key, const QString &version) const;
+    void saveToDisk(const QString &key, const QString &version,
+                    const QImage &image) const;
+
+    // Thread safe, msecs since epoch
+    bool findCaptureTime(const QString &key, const QString &version,
+                         qint64 *msecs);
+    void insertCaptureTime(const QString &key, const QString &version,
+                           qint64 msecs);
+    // Writes new capture times to disk, call once a batch is done
+    void saveCaptureTimes();
+
+    qint64 budget() const { return m_budget; }
+
+private:
+    ThumbnailCache();
+    Q_DISABLE_COPY(ThumbnailCache)
+
+    static qint64 systemMemory();
+    QString diskBaseName(const QString &key) const;
+    void loadCaptureTimes();
+
+    qint64 m_budget;
+    QCache<QString, QPixmap> m_hot;
+
+    mutable QMutex m_warmMutex;
+    QCache<QString, QByteArray> m_warm;
+
+    QString m_diskDir;
+
+    struct CaptureTime {
+        QString version;
+        qint64 msecs = 0;
+    };
+    QMutex m_captureMutex;
+    QHash<QString, CaptureTime> m_captureTimes;
+    bool m_captureTimesLoaded = false;
+    bool m_captureTimesDirty = false;
+};
+
+#endif // THUMBNAILCACHE_H
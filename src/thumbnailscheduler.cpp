@@ -0,0 +1,135 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "thumbnailscheduler.h"
+#include <QDebug>
+#include <QMutexLocker>
+#include <QThread>
+#include <limits>
+
+ThumbnailScheduler::ThumbnailScheduler(Loader loader, QObject *parent)
+    : QObject(parent), m_loader(std::move(loader))
+{
+    // AFC reads are serialized per device anyway, more threads than this
+    // only adds decode contention
+    m_pool.setMaxThreadCount(qBound(2, QThread::idealThreadCount(), 4));
+}
+
+ThumbnailScheduler::~ThumbnailScheduler()
+{
+    cancelAll();
+    m_pool.waitForDone();
+}
+
+void ThumbnailScheduler::request(const QString &filePath, bool isVideo)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_pending.contains(filePath) || m_running.contains(filePath))
+            return;
+
+        m_pending.insert(filePath, Job{filePath, isVideo, m_sequence++});
+    }
+
+    // Workers don't own a job, each one picks the best pending job when it
+    // gets a thread
+    m_pool.start([this]() { runNext(); });
+}
+
+bool ThumbnailScheduler::isScheduled(const QString &filePath) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pending.contains(filePath) || m_running.contains(filePath);
+}
+
+void ThumbnailScheduler::setViewport(const QStringList &orderedPaths)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_rank.clear();
+    m_rank.reserve(orderedPaths.size());
+    for (int i = 0; i < orderedPaths.size(); ++i) {
+        m_rank.insert(orderedPaths.at(i), i);
+    }
+
+    int dropped = 0;
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        if (!m_rank.contains(it.key())) {
+            it = m_pending.erase(it);
+            ++dropped;
+        } else {
+            ++it;
+        }
+    }
+
+    if (dropped > 0) {
+        qDebug() << "ThumbnailScheduler: dropped" << dropped
+                 << "off-screen requests," << m_pending.size() << "pending";
+    }
+}
+
+void ThumbnailScheduler::cancelAll()
+{
+    QMutexLocker locker(&m_mutex);
+    m_pending.clear();
+    m_rank.clear();
+    // Results of loads that are still running are discarded
+    ++m_generation;
+}
+
+void ThumbnailScheduler::runNext()
+{
+    Job job;
+    quint64 generation;
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_pending.isEmpty())
+            return;
+
+        // Best rank in the viewport wins, requests the viewport doesn't know
+        // about yet go last in arrival order
+        auto best = m_pending.cend();
+        int bestRank = std::numeric_limits<int>::max();
+        for (auto it = m_pending.cbegin(); it != m_pending.cend(); ++it) {
+            const int rank =
+                m_rank.value(it.key(), std::numeric_limits<int>::max());
+            if (best == m_pending.cend() || rank < bestRank ||
+                (rank == bestRank && it->sequence < best->sequence)) {
+                best = it;
+                bestRank = rank;
+            }
+        }
+
+        job = best.value();
+        m_pending.remove(job.filePath);
+        m_running.insert(job.filePath);
+        generation = m_generation;
+    }
+
+    const QImage thumbnail = m_loader(job.filePath, job.isVideo);
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_running.remove(job.filePath);
+        if (generation != m_generation)
+            return;
+    }
+
+    emit thumbnailReady(job.filePath, thumbnail);
+}
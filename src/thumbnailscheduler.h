@@ -0,0 +1,86 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef THUMBNAILSCHEDULER_H
+#define THUMBNAILSCHEDULER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QImage>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <functional>
+
+/**
+ * @brief Prioritized, cancellable queue for gallery thumbnail loads
+ *
+ * Requests are not started in the order they arrive. Each worker pulls the
+ * pending request that ranks best in the current viewport (visible rows
+ * first, then the lookahead rows in the scroll direction), and whenever the
+ * viewport moves every pending request that is no longer part of it is
+ * dropped. Loads that already started can't be interrupted, their results
+ * are still delivered so they end up in the cache.
+ */
+class ThumbnailScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Runs on a worker thread
+    using Loader =
+        std::function<QImage(const QString &filePath, bool isVideo)>;
+
+    explicit ThumbnailScheduler(Loader loader, QObject *parent = nullptr);
+    ~ThumbnailScheduler();
+
+    void request(const QString &filePath, bool isVideo);
+    bool isScheduled(const QString &filePath) const;
+
+    // Paths in the order they should be loaded, anything else is dropped
+    void setViewport(const QStringList &orderedPaths);
+    void cancelAll();
+
+signals:
+    // Emitted from a worker thread, thumbnail is null if loading failed
+    void thumbnailReady(const QString &filePath, const QImage &thumbnail);
+
+private:
+    struct Job {
+        QString filePath;
+        bool isVideo = false;
+        quint64 sequence = 0;
+    };
+
+    void runNext();
+
+    Loader m_loader;
+    QThreadPool m_pool;
+
+    mutable QMutex m_mutex;
+    QHash<QString, Job> m_pending;
+    QSet<QString> m_running;
+    QHash<QString, int> m_rank;
+    quint64 m_sequence = 0;
+    quint64 m_generation = 0;
+};
+
+#endif // THUMBNAILSCHEDULER_H
@@ -0,0 +1,97 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "tiledimageitem.h"
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+
+TiledImageItem::TiledImageItem(std::shared_ptr<const ImagePyramid> pyramid,
+                               qint64 cacheBytes, QGraphicsItem *parent)
+    : QGraphicsItem(parent), m_pyramid(std::move(pyramid)),
+      m_tiles(int(qMax<qint64>(1, cacheBytes / 1024))) // KB
+{
+    // Needed for a meaningful exposedRect in paint()
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption);
+}
+
+QRectF TiledImageItem::boundingRect() const
+{
+    return QRectF(QPointF(0, 0), m_pyramid->size());
+}
+
+void TiledImageItem::paint(QPainter *painter,
+                           const QStyleOptionGraphicsItem *option,
+                           QWidget *widget)
+{
+    Q_UNUSED(widget)
+    if (m_pyramid->isNull())
+        return;
+
+    const qreal scale = QStyleOptionGraphicsItem::levelOfDetailFromTransform(
+        painter->worldTransform());
+    const int levelIndex = m_pyramid->levelForScale(scale);
+    const QImage &level = m_pyramid->level(levelIndex);
+
+    // Item coordinates are level 0 pixels
+    const QSize fullSize = m_pyramid->size();
+    const qreal sx = qreal(level.width()) / fullSize.width();
+    const qreal sy = qreal(level.height()) / fullSize.height();
+
+    const QRectF exposed = option->exposedRect.intersected(boundingRect());
+    const QRect levelRect =
+        QRectF(exposed.left() * sx, exposed.top() * sy, exposed.width() * sx,
+               exposed.height() * sy)
+            .toAlignedRect()
+            .intersected(level.rect());
+    if (levelRect.isEmpty())
+        return;
+
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, scale < sx);
+
+    const int tileSize = ImagePyramid::TileSize;
+    for (int row = levelRect.top() / tileSize;
+         row <= levelRect.bottom() / tileSize; ++row) {
+        for (int column = levelRect.left() / tileSize;
+             column <= levelRect.right() / tileSize; ++column) {
+            const QPixmap pixmap = tile(levelIndex, column, row);
+            const QRectF target(column * tileSize / sx, row * tileSize / sy,
+                                pixmap.width() / sx, pixmap.height() / sy);
+            painter->drawPixmap(target, pixmap, QRectF(pixmap.rect()));
+        }
+    }
+}
+
+QPixmap TiledImageItem::tile(int level, int column, int row)
+{
+    const quint64 key = (quint64(level) << 48) | (quint64(row) << 24) |
+                        quint64(column);
+    if (const QPixmap *cached = m_tiles.object(key))
+        return *cached;
+
+    const int tileSize = ImagePyramid::TileSize;
+    const QRect rect = QRect(column * tileSize, row * tileSize, tileSize,
+                             tileSize)
+                           .intersected(m_pyramid->level(level).rect());
+    auto *pixmap =
+        new QPixmap(QPixmap::fromImage(m_pyramid->level(level).copy(rect)));
+    const QPixmap result = *pixmap;
+    m_tiles.insert(key, pixmap,
+                   qMax<qsizetype>(1, rect.width() * rect.height() * 4 / 1024));
+    return result;
+}
@@ -0,0 +1,56 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TILEDIMAGEITEM_H
+#define TILEDIMAGEITEM_H
+
+#include "imagepyramid.h"
+#include <QCache>
+#include <QGraphicsItem>
+#include <QPixmap>
+#include <memory>
+
+/**
+ * @brief Graphics item that paints an ImagePyramid tile by tile
+ *
+ * Only the tiles intersecting the exposed area are drawn, from the pyramid
+ * level matching the current view scale, so zooming and panning a huge
+ * photo touch about a screenful of pixels. Tiles are turned into pixmaps on
+ * first use and kept in a cache of the size given by the owner.
+ */
+class TiledImageItem : public QGraphicsItem
+{
+public:
+    // cacheBytes bounds the tile pixmaps, it is part of the caller's
+    // memory budget on top of the pyramid itself
+    TiledImageItem(std::shared_ptr<const ImagePyramid> pyramid,
+                   qint64 cacheBytes, QGraphicsItem *parent = nullptr);
+
+    QRectF boundingRect() const override;
+    void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
+               QWidget *widget = nullptr) override;
+
+private:
+    QPixmap tile(int level, int column, int row);
+
+    std::shared_ptr<const ImagePyramid> m_pyramid;
+    QCache<quint64, QPixmap> m_tiles;
+};
+
+#endif // TILEDIMAGEITEM_H
@@ -0,0 +1,194 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+    Correctness check and benchmark for downscale_image(), built with
+    -DBUILD_DOWNSCALE_BENCHMARK=ON. For a few typical frame sizes it checks
+    that the SIMD kernels give exactly the same pixels as the scalar build
+    of the same file, compares both against
+    QImage::scaled(..., Qt::SmoothTransformation) and times all three.
+
+    Exits with a non-zero status if SIMD and scalar output differ or the
+    result drifts too far from Qt's scaler.
+*/
+
+#include "../iDescriptor.h"
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QImage>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+// downscale_image.cpp compiled with IDESCRIPTOR_DOWNSCALE_SCALAR
+QImage downscale_image_scalar(const QImage &image, const QSize &size,
+                              Qt::AspectRatioMode mode);
+
+namespace
+{
+// Mean absolute channel difference allowed against Qt's smooth scaler, the
+// two filters differ slightly at block edges
+constexpr double MAX_MEAN_DIFF_TO_QT = 3.0;
+constexpr int ITERATIONS = 7;
+
+struct Case {
+    QSize source;
+    QSize target;
+    QImage::Format format;
+};
+
+// Smooth gradients with some noise, close enough to photos and screen
+// content without shipping sample images
+QImage makeImage(const QSize &size, QImage::Format format)
+{
+    QImage image(size, QImage::Format_ARGB32);
+    QRandomGenerator random(size.width() * 31 + size.height());
+    for (int y = 0; y < size.height(); ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(image.scanLine(y));
+        for (int x = 0; x < size.width(); ++x) {
+            const int noise = int(random.bounded(16u));
+            line[x] = qRgba((x * 255 / size.width() + noise) & 0xff,
+                            (y * 255 / size.height() + noise) & 0xff,
+                            ((x + y) / 8 + noise) & 0xff, 255 - noise);
+        }
+    }
+    return image.convertToFormat(format);
+}
+
+// Median of a few runs in ms, the first run also warms up caches
+double timeMs(const std::function<QImage()> &run)
+{
+    double runs[ITERATIONS];
+    for (double &ms : runs) {
+        QElapsedTimer timer;
+        timer.start();
+        const QImage result = run();
+        ms = timer.nsecsElapsed() / 1e6;
+        Q_UNUSED(result)
+    }
+    std::sort(std::begin(runs), std::end(runs));
+    return runs[ITERATIONS / 2];
+}
+
+double meanDifference(const QImage &a, const QImage &b)
+{
+    const QImage x = a.convertToFormat(QImage::Format_ARGB32);
+    const QImage y = b.convertToFormat(QImage::Format_ARGB32);
+    if (x.size() != y.size())
+        return 255.0;
+
+    quint64 sum = 0;
+    for (int row = 0; row < x.height(); ++row) {
+        const uchar *p = x.constScanLine(row);
+        const uchar *q = y.constScanLine(row);
+        for (int i = 0; i < x.width() * 4; ++i)
+            sum += std::abs(int(p[i]) - int(q[i]));
+    }
+    return double(sum) / (qint64(x.width()) * x.height() * 4);
+}
+
+bool identical(const QImage &a, const QImage &b)
+{
+    if (a.size() != b.size() || a.format() != b.format())
+        return false;
+    const qsizetype rowBytes = qsizetype(a.width()) * a.depth() / 8;
+    for (int row = 0; row < a.height(); ++row) {
+        if (memcmp(a.constScanLine(row), b.constScanLine(row), rowBytes) != 0)
+            return false;
+    }
+    return true;
+}
+
+const char *formatName(QImage::Format format)
+{
+    switch (format) {
+    case QImage::Format_RGB32:
+        return "RGB32";
+    case QImage::Format_ARGB32_Premultiplied:
+        return "ARGB32_PM";
+    case QImage::Format_RGB888:
+        return "RGB888";
+    default:
+        return "other";
+    }
+}
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+
+    const QList<Case> cases = {
+        // 12 MP photo to a gallery thumbnail and to a preview
+        {{4032, 3024}, {120, 120}, QImage::Format_RGB32},
+        {{4032, 3024}, {1920, 1080}, QImage::Format_RGB32},
+        // 48 MP photo to a thumbnail
+        {{8064, 6048}, {120, 120}, QImage::Format_ARGB32_Premultiplied},
+        // Device screenshot and AirPlay frames into their widgets
+        {{1179, 2556}, {390, 844}, QImage::Format_ARGB32_Premultiplied},
+        {{1920, 1080}, {640, 360}, QImage::Format_RGB888},
+        {{2560, 1440}, {1280, 720}, QImage::Format_RGB888},
+        // Odd sizes leave partial blocks at the right and bottom edges
+        {{1001, 777}, {100, 100}, QImage::Format_RGB888},
+    };
+
+    std::printf("%-12s %-12s %-10s %9s %9s %9s %8s\n", "source", "target",
+                "format", "simd ms", "scalar ms", "qt ms", "diff qt");
+
+    bool ok = true;
+    for (const Case &c : cases) {
+        const QImage source = makeImage(c.source, c.format);
+
+        const QImage simd =
+            downscale_image(source, c.target, Qt::KeepAspectRatio);
+        const QImage scalar =
+            downscale_image_scalar(source, c.target, Qt::KeepAspectRatio);
+        const QImage qt = source.scaled(c.target, Qt::KeepAspectRatio,
+                                        Qt::SmoothTransformation);
+
+        const double diff = meanDifference(simd, qt);
+        const bool match = identical(simd, scalar);
+
+        const double simdMs = timeMs([&]() {
+            return downscale_image(source, c.target, Qt::KeepAspectRatio);
+        });
+        const double scalarMs = timeMs([&]() {
+            return downscale_image_scalar(source, c.target,
+                                          Qt::KeepAspectRatio);
+        });
+        const double qtMs = timeMs([&]() {
+            return source.scaled(c.target, Qt::KeepAspectRatio,
+                                 Qt::SmoothTransformation);
+        });
+
+        std::printf("%5dx%-6d %5dx%-6d %-10s %9.2f %9.2f %9.2f %8.2f%s\n",
+                    c.source.width(), c.source.height(), simd.width(),
+                    simd.height(), formatName(c.format), simdMs, scalarMs,
+                    qtMs, diff,
+                    !match                         ? "  SIMD != scalar"
+                    : diff > MAX_MEAN_DIFF_TO_QT ? "  too far from Qt"
+                                                   : "");
+
+        ok = ok && match && diff <= MAX_MEAN_DIFF_TO_QT;
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
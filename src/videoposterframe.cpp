@@ -0,0 +1,486 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "videoposterframe.h"
+#include "devicefile.h"
+#include "isobmff.h"
+#include "servicemanager.h"
+#include "thumbnailcache.h"
+#include <QByteArray>
+#include <QDebug>
+#include <QList>
+#include <QPair>
+#include <QTransform>
+#include <cstring>
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libswscale/swscale.h>
+}
+
+namespace
+{
+using namespace IsoBmff;
+
+constexpr int AVIO_BUFFER_SIZE = 32768;
+// The mov demuxer reads ftyp and friends from the start before seeking
+constexpr qint64 HEADER_PREFETCH = 4096;
+// Leave absurdly large moov atoms to the generic path
+constexpr qint64 MAX_MOOV_SIZE = 32 * 1024 * 1024;
+// Stop looking for a keyframe after this many packets
+constexpr int MAX_PACKETS = 256;
+
+/*
+    Just enough of the box tree to find the first video keyframe:
+    moov/trak/mdia/minf/stbl with stss, stsc, stsz and stco/co64.
+*/
+struct PosterSample {
+    qint64 offset = 0;
+    qint64 size = 0;
+    int rotation = 0; // clockwise degrees from the track matrix
+};
+
+int parseRotation(const uchar *data, const Box &tkhd)
+{
+    const uchar *body = data + tkhd.bodyOffset();
+    if (tkhd.bodySize() < 1)
+        return 0;
+
+    // version/flags, times, track id, duration, reserved, layer, group,
+    // volume and reserved come before the 3x3 matrix
+    const qint64 matrixOffset = body[0] == 1 ? 52 : 40;
+    if (tkhd.bodySize() < matrixOffset + 36)
+        return 0;
+
+    const qint32 a = qint32(readU32(body + matrixOffset));
+    const qint32 b = qint32(readU32(body + matrixOffset + 4));
+    const qint32 c = qint32(readU32(body + matrixOffset + 12));
+    const qint32 d = qint32(readU32(body + matrixOffset + 16));
+    constexpr qint32 one = 0x10000;
+
+    if (a == 0 && b == one && c == -one && d == 0)
+        return 90;
+    if (a == -one && b == 0 && c == 0 && d == -one)
+        return 180;
+    if (a == 0 && b == -one && c == one && d == 0)
+        return 270;
+    return 0;
+}
+
+bool locateFirstKeyframe(const uchar *data, const Box &stbl,
+                         PosterSample &sample)
+{
+    Box stsz, stsc, chunks;
+    bool largeOffsets = false;
+    if (!findChild(data, stbl, fourcc("stsz"), stsz) ||
+        !findChild(data, stbl, fourcc("stsc"), stsc))
+        return false;
+    if (!findChild(data, stbl, fourcc("stco"), chunks)) {
+        if (!findChild(data, stbl, fourcc("co64"), chunks))
+            return false;
+        largeOffsets = true;
+    }
+
+    // Sample numbers are 1-based, without stss every sample is a keyframe
+    quint64 keySample = 1;
+    Box stss;
+    if (findChild(data, stbl, fourcc("stss"), stss)) {
+        const uchar *body = data + stss.bodyOffset();
+        if (stss.bodySize() < 12 || readU32(body + 4) == 0)
+            return false;
+        keySample = readU32(body + 8);
+    }
+
+    const uchar *sizes = data + stsz.bodyOffset();
+    if (stsz.bodySize() < 12)
+        return false;
+    const quint32 uniformSize = readU32(sizes + 4);
+    const quint32 sampleCount = readU32(sizes + 8);
+    if (keySample == 0 || keySample > sampleCount)
+        return false;
+    if (uniformSize == 0 && stsz.bodySize() < 12 + qint64(sampleCount) * 4)
+        return false;
+    auto sampleSize = [&](quint64 n) -> qint64 {
+        return uniformSize ? uniformSize : readU32(sizes + 12 + (n - 1) * 4);
+    };
+
+    const uchar *offsets = data + chunks.bodyOffset();
+    const int entrySize = largeOffsets ? 8 : 4;
+    if (chunks.bodySize() < 8)
+        return false;
+    const quint32 chunkCount = readU32(offsets + 4);
+    if (chunks.bodySize() < 8 + qint64(chunkCount) * entrySize)
+        return false;
+    auto chunkOffset = [&](quint64 chunk) -> qint64 {
+        const uchar *p = offsets + 8 + (chunk - 1) * entrySize;
+        return largeOffsets ? qint64(readU64(p)) : qint64(readU32(p));
+    };
+
+    // stsc describes runs of chunks holding the same number of samples
+    const uchar *runs = data + stsc.bodyOffset();
+    if (stsc.bodySize() < 8)
+        return false;
+    const quint32 runCount = readU32(runs + 4);
+    if (runCount == 0 || stsc.bodySize() < 8 + qint64(runCount) * 12)
+        return false;
+
+    quint64 samplesBefore = 0;
+    for (quint32 i = 0; i < runCount; ++i) {
+        const quint64 firstChunk = readU32(runs + 8 + i * 12);
+        const quint64 perChunk = readU32(runs + 8 + i * 12 + 4);
+        const quint64 nextChunk = i + 1 < runCount
+                                      ? readU32(runs + 8 + (i + 1) * 12)
+                                      : quint64(chunkCount) + 1;
+        if (firstChunk == 0 || perChunk == 0 || nextChunk < firstChunk)
+            return false;
+
+        const quint64 runSamples = (nextChunk - firstChunk) * perChunk;
+        if (keySample > samplesBefore + runSamples) {
+            samplesBefore += runSamples;
+            continue;
+        }
+
+        const quint64 chunk =
+            firstChunk + (keySample - samplesBefore - 1) / perChunk;
+        if (chunk > chunkCount)
+            return false;
+
+        const quint64 firstInChunk =
+            samplesBefore + (chunk - firstChunk) * perChunk + 1;
+        qint64 offset = chunkOffset(chunk);
+        for (quint64 n = firstInChunk; n < keySample; ++n)
+            offset += sampleSize(n);
+
+        sample.offset = offset;
+        sample.size = sampleSize(keySample);
+        return sample.size > 0;
+    }
+    return false;
+}
+
+bool findPosterSample(const uchar *moov, qint64 moovSize, PosterSample &sample)
+{
+    Box root;
+    if (!parseBox(moov, 0, moovSize, root))
+        return false;
+
+    for (qint64 pos = root.bodyOffset(); pos < root.end();) {
+        Box trak;
+        if (!parseBox(moov, pos, root.end(), trak))
+            return false;
+        pos = trak.end();
+        if (trak.type != fourcc("trak"))
+            continue;
+
+        Box mdia, hdlr, minf, stbl, tkhd;
+        if (!findChild(moov, trak, fourcc("mdia"), mdia) ||
+            !findChild(moov, mdia, fourcc("hdlr"), hdlr) ||
+            hdlr.bodySize() < 12 ||
+            readU32(moov + hdlr.bodyOffset() + 8) != fourcc("vide"))
+            continue;
+
+        if (!findChild(moov, mdia, fourcc("minf"), minf) ||
+            !findChild(moov, minf, fourcc("stbl"), stbl) ||
+            !locateFirstKeyframe(moov, stbl, sample))
+            return false;
+
+        if (findChild(moov, trak, fourcc("tkhd"), tkhd))
+            sample.rotation = parseRotation(moov, tkhd);
+        return true;
+    }
+    return false;
+}
+
+// Serves the prefetched ranges from memory, everything else from the device
+struct SparseSource {
+    DeviceFile *file;
+    qint64 size;
+    qint64 position = 0;
+    QList<QPair<qint64, QByteArray>> ranges;
+};
+
+int readSparse(void *opaque, uint8_t *buf, int bufSize)
+{
+    auto *source = static_cast<SparseSource *>(opaque);
+    if (source->position >= source->size)
+        return AVERROR_EOF;
+
+    qint64 wanted = qMin<qint64>(bufSize, source->size - source->position);
+    qint64 nextRange = source->size;
+    for (const auto &range : source->ranges) {
+        const qint64 begin = range.first;
+        const qint64 end = begin + range.second.size();
+        if (source->position >= begin && source->position < end) {
+            const qint64 count = qMin(wanted, end - source->position);
+            memcpy(buf, range.second.constData() + (source->position - begin),
+                   count);
+            source->position += count;
+            return int(count);
+        }
+        if (begin > source->position)
+            nextRange = qMin(nextRange, begin);
+    }
+
+    wanted = qMin(wanted, nextRange - source->position);
+    const QByteArray data = source->file->read(source->position, wanted);
+    if (data.isEmpty())
+        return AVERROR(EIO);
+
+    memcpy(buf, data.constData(), data.size());
+    source->position += data.size();
+    return int(data.size());
+}
+
+int64_t seekSparse(void *opaque, int64_t offset, int whence)
+{
+    auto *source = static_cast<SparseSource *>(opaque);
+    whence &= ~AVSEEK_FORCE;
+
+    int64_t position;
+    switch (whence) {
+    case AVSEEK_SIZE:
+        return source->size;
+    case SEEK_SET:
+        position = offset;
+        break;
+    case SEEK_CUR:
+        position = source->position + offset;
+        break;
+    case SEEK_END:
+        position = source->size + offset;
+        break;
+    default:
+        return -1;
+    }
+
+    if (position < 0 || position > source->size)
+        return -1;
+    source->position = position;
+    return position;
+}
+
+QImage scaleFrame(const AVFrame *frame, const QSize &size, int rotation)
+{
+    // Scale before rotating, so fit the box as the frame will be shown
+    const QSize box =
+        rotation == 90 || rotation == 270 ? size.transposed() : size;
+    QSize target(frame->width, frame->height);
+    if (target.width() > box.width() || target.height() > box.height())
+        target = target.scaled(box, Qt::KeepAspectRatio);
+    target = target.expandedTo(QSize(1, 1));
+
+    SwsContext *swsCtx = sws_getContext(
+        frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+        target.width(), target.height(), AV_PIX_FMT_RGB24, SWS_AREA, nullptr,
+        nullptr, nullptr);
+    if (!swsCtx)
+        return QImage();
+
+    QImage image(target, QImage::Format_RGB888);
+    uint8_t *dst[4] = {image.bits(), nullptr, nullptr, nullptr};
+    int dstStride[4] = {int(image.bytesPerLine()), 0, 0, 0};
+    sws_scale(swsCtx, frame->data, frame->linesize, 0, frame->height, dst,
+              dstStride);
+    sws_freeContext(swsCtx);
+
+    if (rotation != 0)
+        image = image.transformed(QTransform().rotate(rotation));
+    return image;
+}
+
+/*
+    With knownLayout the container is opened as mov without probing and
+    without avformat_find_stream_info(), the sample tables already tell the
+    demuxer everything needed to hand out the first keyframe.
+*/
+QImage decodePosterFrame(SparseSource &source, bool knownLayout,
+                         const QSize &size, int rotation)
+{
+    AVFormatContext *formatCtx = avformat_alloc_context();
+    unsigned char *avioBuffer =
+        static_cast<unsigned char *>(av_malloc(AVIO_BUFFER_SIZE));
+    AVIOContext *avioCtx =
+        avioBuffer ? avio_alloc_context(avioBuffer, AVIO_BUFFER_SIZE, 0,
+                                        &source, readSparse, nullptr,
+                                        seekSparse)
+                   : nullptr;
+    if (!formatCtx || !avioCtx) {
+        if (avioCtx)
+            avio_context_free(&avioCtx);
+        av_free(avioBuffer);
+        avformat_free_context(formatCtx);
+        return QImage();
+    }
+
+    formatCtx->pb = avioCtx;
+    formatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    auto freeIo = [&avioCtx]() {
+        av_freep(&avioCtx->buffer);
+        avio_context_free(&avioCtx);
+    };
+
+    auto *inputFormat = knownLayout ? av_find_input_format("mov") : nullptr;
+    // Frees formatCtx on failure
+    if (avformat_open_input(&formatCtx, nullptr, inputFormat, nullptr) < 0) {
+        qWarning() << "Failed to open video format";
+        freeIo();
+        return QImage();
+    }
+
+    AVCodecContext *codecCtx = nullptr;
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *packet = av_packet_alloc();
+    QImage image;
+
+    int videoStream = -1;
+    const AVCodec *codec = nullptr;
+    if (frame && packet &&
+        (knownLayout || avformat_find_stream_info(formatCtx, nullptr) >= 0)) {
+        videoStream = av_find_best_stream(formatCtx, AVMEDIA_TYPE_VIDEO, -1,
+                                          -1, nullptr, 0);
+    }
+    if (videoStream >= 0) {
+        codec = avcodec_find_decoder(
+            formatCtx->streams[videoStream]->codecpar->codec_id);
+        codecCtx = codec ? avcodec_alloc_context3(codec) : nullptr;
+    }
+
+    if (codecCtx && avcodec_parameters_to_context(
+                        codecCtx,
+                        formatCtx->streams[videoStream]->codecpar) >= 0) {
+        // Only keyframes are wanted, and frame threading would hold the
+        // frame back until more packets arrive
+        codecCtx->skip_frame = AVDISCARD_NONKEY;
+        codecCtx->thread_type = FF_THREAD_SLICE;
+
+        // Don't let the demuxer read audio/metadata samples
+        for (unsigned int i = 0; i < formatCtx->nb_streams; ++i) {
+            if (int(i) != videoStream)
+                formatCtx->streams[i]->discard = AVDISCARD_ALL;
+        }
+
+        if (avcodec_open2(codecCtx, codec, nullptr) >= 0) {
+            for (int i = 0; i < MAX_PACKETS; ++i) {
+                if (av_read_frame(formatCtx, packet) < 0)
+                    break;
+
+                const bool keyframe = packet->stream_index == videoStream &&
+                                      (packet->flags & AV_PKT_FLAG_KEY);
+                if (keyframe && avcodec_send_packet(codecCtx, packet) >= 0) {
+                    // Flush so the one frame we need comes out right away
+                    avcodec_send_packet(codecCtx, nullptr);
+                    if (avcodec_receive_frame(codecCtx, frame) >= 0)
+                        image = scaleFrame(frame, size, rotation);
+                }
+                av_packet_unref(packet);
+                if (keyframe)
+                    break;
+            }
+        }
+    }
+
+    av_frame_free(&frame);
+    av_packet_free(&packet);
+    avcodec_free_context(&codecCtx);
+    avformat_close_input(&formatCtx);
+    freeIo();
+    return image;
+}
+
+} // namespace
+
+QImage VideoPosterFrame::extract(iDescriptorDevice *device,
+                                 const QString &filePath, const QSize &size)
+{
+    plist_t info = nullptr;
+    if (ServiceManager::safeAfcGetFileInfoPlist(
+            device, filePath.toUtf8().constData(), &info) != AFC_E_SUCCESS ||
+        !info) {
+        qWarning() << "Failed to stat video file for thumbnail:" << filePath;
+        return QImage();
+    }
+    PlistNavigator nav(info);
+    const qint64 fileSize = qint64(nav["st_size"].getUInt());
+    const quint64 mtime = nav["st_mtime"].getUInt();
+    plist_free(info);
+
+    if (fileSize <= 0) {
+        qWarning() << "Invalid video file size for thumbnail:" << filePath;
+        return QImage();
+    }
+
+    const QString cacheKey = ThumbnailCache::key(device, filePath);
+    const QString version = QString("%1_%2_%3x%4")
+                                .arg(fileSize)
+                                .arg(mtime)
+                                .arg(size.width())
+                                .arg(size.height());
+    QImage cached =
+        ThumbnailCache::sharedInstance()->loadFromDisk(cacheKey, version);
+    if (!cached.isNull())
+        return cached;
+
+    DeviceFile file(device, filePath);
+    if (!file.isOpen()) {
+        qWarning() << "Failed to open video file for thumbnail:" << filePath;
+        return QImage();
+    }
+
+    SparseSource source{&file, fileSize};
+    PosterSample sample;
+    bool knownLayout = false;
+
+    qint64 moovOffset = 0;
+    qint64 moovSize = 0;
+    if (locateTopLevelBox(file, fileSize, fourcc("moov"), moovOffset,
+                          moovSize) &&
+        moovSize <= MAX_MOOV_SIZE) {
+        const QByteArray moov = file.read(moovOffset, moovSize);
+        if (moov.size() == moovSize &&
+            findPosterSample(reinterpret_cast<const uchar *>(moov.constData()),
+                             moovSize, sample) &&
+            sample.offset >= 0 && sample.offset + sample.size <= fileSize) {
+            source.ranges.append(
+                {0, file.read(0, qMin(HEADER_PREFETCH, fileSize))});
+            source.ranges.append({moovOffset, moov});
+            source.ranges.append(
+                {sample.offset, file.read(sample.offset, sample.size)});
+            knownLayout = true;
+        }
+    }
+
+    QImage image =
+        decodePosterFrame(source, knownLayout, size, sample.rotation);
+    if (image.isNull() && knownLayout) {
+        // The prefetched ranges are still good, just let FFmpeg probe
+        qDebug() << "VideoPosterFrame: keyframe decode failed, probing"
+                 << filePath;
+        source.position = 0;
+        image = decodePosterFrame(source, false, size, sample.rotation);
+    }
+
+    qDebug() << "VideoPosterFrame:" << filePath
+             << (knownLayout ? "from first keyframe," : "probed,")
+             << file.bytesRead() << "of" << fileSize << "bytes read";
+
+    if (!image.isNull())
+        ThumbnailCache::sharedInstance()->saveToDisk(cacheKey, version, image);
+    return image;
+}
@@ -0,0 +1,48 @@
+/*
+ * iDescriptor: A free and open-source idevice management tool.
+ *
+ * Copyright (C) 2025 Uncore <https://github.com/uncor3>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published
+ * by the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef VIDEOPOSTERFRAME_H
+#define VIDEOPOSTERFRAME_H
+
+#include "iDescriptor.h"
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/**
+ * @brief Extracts a small poster frame from a video on the device
+ *
+ * For MOV/MP4 files the sample tables in the moov atom are parsed directly,
+ * so only the box headers, the moov atom and the first keyframe are read
+ * over AFC, no matter whether the moov sits before or after the media data.
+ * That single frame is decoded and scaled straight to the requested size.
+ * Anything the parser doesn't understand falls back to letting FFmpeg probe
+ * the file.
+ *
+ * Results are kept in the ThumbnailCache disk tier keyed by the file's size
+ * and modification time. Blocks on AFC, call it from a worker thread.
+ */
+class VideoPosterFrame
+{
+public:
+    static QImage extract(iDescriptorDevice *device, const QString &filePath,
+                          const QSize &size);
+};
+
+#endif // VIDEOPOSTERFRAME_H